@@ -19,20 +19,32 @@
 #define MIN_VALID_ID 1000000 //smallest id
 #define MAX_VALID_ID 9999999 //biggest id
 #define MAX_LINE_LENGTH 256
+#define DETECT_FORMAT_SCAN_BYTES 65536 //detect_file_format only looks at the start of the file
 #define MAX_NAME_LENGTH 40//max char for names
 #define MAX_PROGRAMME_LENGTH 40 //max char for programme names
-#define MAX_RECORDS 1000 //max no. of entries in the CMS
+#define RECORD_CHUNK_SHIFT 16 //each arena chunk holds 2^16 records
+#define RECORD_CHUNK_SIZE (1 << RECORD_CHUNK_SHIFT)
+#define RECORD_CHUNK_MASK (RECORD_CHUNK_SIZE - 1)
+#define INITIAL_ORDER_CAPACITY 1024 //first allocation for growable int arrays
 #define MAX_FILENAME_LENGTH 39 //max char for filename
 #define MAX_ID_LENGTH 7
-#define QUERY_CHOICES_MAX 5
+#define MENU_CHOICES_MIN 1
+#define MENU_CHOICES_MAX 12
+#define QUERY_CHOICES_MAX 11
 #define QUERY_CHOICES_MIN 1
-#define SORT_CHOICES_MAX 5
+#define SORT_CHOICES_MAX 7
 #define SORT_CHOICES_MIN 1
 /*Display Constant Var*/
 #define DISPLAY_ID_WIDTH 10
 #define DISPLAY_NAME_WIDTH 40
 #define DISPLAY_PROGRAMME_WIDTH 40
 #define DISPLAY_MARK_WIDTH 10
+/*File formats*/
+#define FILE_FORMAT_TEXT 0 //tab separated text, one record per line
+#define FILE_FORMAT_BINARY 1 //columnar binary (cms_binary.c)
+#define CMS_BINARY_MAGIC "CMSB" //first 4 bytes of a binary file
+#define CMS_BINARY_VERSION 1
+#define CMS_BINARY_EXTENSION ".cmsb"
 
 /*
 *StudentRecord structure
@@ -45,25 +57,427 @@ typedef struct {
 	float mark; //marks (0.0-100.0)
 } StudentRecord;
 
+/*
+* StoredRecord
+* how a StudentRecord is kept in the arena: the programme is not stored here but as a
+* 16 bit code in the chunk's programme column, the text lives once in db->programmes;
+* the mark is kept in tenths (marks have 1 decimal place) so it compares exactly
+*/
+#define MARK_TENTHS_MAX 1000 //100.0
+
+typedef struct {
+	int id;
+	char name[MAX_NAME_LENGTH];
+	short mark_tenths; //0..MARK_TENTHS_MAX
+} StoredRecord;
+
+/*
+* ProgrammeDictionary
+* every distinct programme text once, records refer to it by code (cms_dictionary.c)
+* real files have a few hundred programmes, so a programme filter compares 2 byte codes instead of strings
+*/
+#define PROGRAMME_CODE_LIMIT 65536 //codes are unsigned short
+
+typedef struct {
+	char (*names)[MAX_PROGRAMME_LENGTH]; //programme text of each code
+	char (*folded)[MAX_PROGRAMME_LENGTH]; //the same in lowercase, for searching
+	int count;
+	int capacity;
+	int* table; //code + 1 of each hash entry, 0 = empty (open addressing)
+	int table_capacity; //always a power of two
+} ProgrammeDictionary;
+
+/*
+* UndoJournal
+* the last options.undo_limit changes, stored as what they changed (cms_undo.c)
+*/
+#define UNDO_INSERT 1
+#define UNDO_UPDATE 2
+#define UNDO_DELETE 3
+#define UNDO_DEFAULT_LIMIT 100
+
+typedef struct {
+	int type; //UNDO_INSERT, UNDO_UPDATE or UNDO_DELETE
+	int index; //display position of the inserted or deleted record
+	StudentRecord before; //deleted record, or the values before an update
+	StudentRecord after; //inserted record, or the values after an update
+} UndoEntry;
+
+typedef struct {
+	UndoEntry* entries; //ring of "limit" entries, allocated on the first change
+	int limit;
+	int start; //ring position of the oldest entry
+	int count; //entries kept
+	int undo_count; //the first undo_count entries can be undone, the rest redone
+} UndoJournal;
+
+/*
+* RecordArena
+* records live in fixed size chunks that are never moved once allocated,
+* so a slot number stays valid for as long as the record exists.
+* the chunk table doubles when full, deleted slots are reused by later inserts
+* every chunk has two columns next to it: the programme code of each slot, and its name in lowercase
+* (MAX_NAME_LENGTH bytes apart) so searches scan it without copying (cms_search.c)
+*/
+typedef struct {
+	StoredRecord** chunks; //table of chunk pointers
+	unsigned short** programme_codes; //programme code of each slot, one block per chunk
+	char** folded_names; //lowercase names, one block per chunk
+	int chunk_count; //chunks allocated
+	int chunk_capacity; //size of the chunk table
+	int slot_count; //slots handed out so far (high water mark)
+	int* free_slots; //slots released by delete, reused first
+	int free_count;
+	int free_capacity;
+} RecordArena;
+
+/*
+* IdIndex
+* maps student ID to arena slot, the mode is chosen when the database is created
+* ID_INDEX_HASH: open addressing hash table (linear probing)
+* ID_INDEX_DIRECT: bitmap with one bit per possible ID plus a paged slot table (~1.1MB bitmap + 256KB per used page)
+*/
+#define ID_INDEX_HASH 0
+#define ID_INDEX_DIRECT 1
+
+typedef struct {
+	int id; //0 = empty entry
+	int slot;
+} IdIndexEntry;
+
+typedef struct {
+	int mode; //ID_INDEX_HASH or ID_INDEX_DIRECT
+	//hash mode
+	IdIndexEntry* entries;
+	int capacity; //always a power of two
+	int bits; //log2(capacity)
+	//direct mode
+	unsigned long long* bitmap; //bit (id - MIN_VALID_ID) set while the ID exists
+	int** slot_pages; //slot of each ID, pages allocated on first use
+	int count;
+} IdIndex;
+
+/*
+* SearchIndex
+* trigram posting lists over the folded name column (cms_search.c), programmes are searched in the dictionary
+* built by the first query of SEARCH_TRIGRAM_LENGTH or more characters, then kept up to date by every change
+*/
+#define SEARCH_MODE_TRIGRAM 0 //queries of 3+ characters use the trigram index
+#define SEARCH_MODE_SCAN 1 //every query scans the folded columns, no index memory
+#define SEARCH_TRIGRAM_LENGTH 3
+#define SEARCH_SCAN_FRACTION 16 //a trigram in more than 1/16 of the records is not selective, the query scans instead
+
+typedef struct {
+	int* slots; //arena slots whose text contains the trigram, ascending
+	int count;
+	int capacity;
+} PostingList;
+
+typedef struct {
+	unsigned int* keys; //the three folded bytes of each trigram, 0 = empty entry (open addressing)
+	PostingList* lists; //posting list of each entry
+	int capacity; //always a power of two
+	int count;
+} TrigramIndex;
+
+typedef struct {
+	int built; //0 = not built yet (or dropped after running out of memory)
+	TrigramIndex name;
+	int* positions; //display position of each arena slot, rebuilt after the order changes
+	int positions_capacity;
+	int positions_valid;
+} SearchIndex;
+
+/*
+* MarkIndex
+* the slots holding each mark, one bucket per tenth (cms_marks.c)
+* built by the first mark query, then kept up to date by every change
+* the histogram is always kept up to date, top-k, percentile and rank queries only need it
+*/
+typedef struct {
+	int built; //0 = not built yet (or dropped after running out of memory)
+	PostingList buckets[MARK_TENTHS_MAX + 1]; //slots with mark = bucket / 10, ascending
+	int histogram[MARK_TENTHS_MAX + 1]; //number of records with each mark
+} MarkIndex;
+
+/*
+* ProgrammeStats
+* running mark aggregates of every programme code (cms_stats.c), updated by every change
+* every programme also keeps a mark histogram, so removing the record with its lowest or highest mark
+* finds the next one by walking at most 1001 counts instead of the records
+*/
+typedef struct {
+	int count; //records of the programme, 0 = not in use
+	short min_tenths;
+	short max_tenths;
+	long long sum_tenths;
+	long long sum_squares; //sum of mark_tenths squared, for the standard deviation
+} ProgrammeStats;
+
+#define GROUP_STATS_CURRENT 0
+#define GROUP_STATS_LOST 1 //ran out of memory, nothing is kept until the next report recounts
+
+typedef struct {
+	ProgrammeStats* groups; //indexed by programme code
+	int** histograms; //per programme code MARK_TENTHS_MAX + 1 counts (records with each mark), NULL until the code has a record
+	//kept until the records are cleared, worst case PROGRAMME_CODE_LIMIT x 4 KB = 256 MB when every code gets records
+	int capacity;
+	int stale; //GROUP_STATS_*
+} GroupStats;
+
+/*
+* SortViews
+* the orders the sort menu switches between (cms_sort.c), each a permutation of the slots:
+* built the first time it is shown, then kept up to date by every change, so showing it again swaps one pointer
+* the view being shown is db->order itself, its entry here is empty
+*/
+#define SORT_VIEW_INSERTION 0 //order of loading and inserting
+#define SORT_VIEW_ID_ASC 1
+#define SORT_VIEW_ID_DESC 2
+#define SORT_VIEW_MARK_ASC 3 //equal marks by ascending ID
+#define SORT_VIEW_MARK_DESC 4 //equal marks by ascending ID
+#define SORT_VIEW_CUSTOM 5 //result of a multi-key sort, only exists while shown and is not kept sorted
+#define SORT_VIEW_COUNT 6
+
+typedef struct {
+	int* slots; //NULL while not built (or while shown)
+	int capacity;
+} SortPermutation;
+
+typedef struct {
+	int shown; //SORT_VIEW_* currently in db->order
+	int batch_view; //sorted view shown again when a batch of changes ends (SORT_VIEW_CUSTOM is shown until then), SORT_VIEW_INSERTION = none
+	SortPermutation views[SORT_VIEW_COUNT];
+} SortViews;
+
+/*
+* SortSpec
+* fields of a multi-key sort in order of importance, e.g. "programme asc, mark desc, name asc" (cms_sort.c)
+* a later field only orders records that are equal in all earlier ones
+*/
+#define SORT_KEY_ID 0
+#define SORT_KEY_MARK 1
+#define SORT_KEY_NAME 2 //ignoring case
+#define SORT_KEY_PROGRAMME 3 //ignoring case
+#define SORT_KEY_COUNT 4
+#define SORT_SPEC_MAX SORT_KEY_COUNT //each field at most once
+
 typedef struct {
-	StudentRecord backup_record[MAX_RECORDS]; // Backup of the last deleted record
-	int backup_count; // Number of records in backup
-	int can_undo; // Flag: 1 if undo available, 0 if undo not available
-	char last_operation[50]; // Description of last operation (e.g., "DELETE")
-} UndoInfo;
+	int count;
+	int keys[SORT_SPEC_MAX]; //SORT_KEY_*
+	int descending[SORT_SPEC_MAX];
+} SortSpec;
 
+/*
+* CMSOptions
+* settings fixed when the database is created (from the command line)
+*/
 typedef struct {
-	StudentRecord records[MAX_RECORDS]; //array of student records
+	int id_index_mode; //ID_INDEX_HASH or ID_INDEX_DIRECT
+	int thread_count; //worker threads for loading and sorting, 0 = one per CPU
+	int wal_enabled; //1 = log every change to "<file>.wal" (cms_wal.c)
+	int wal_sync_every; //sync the log to disk after this many changes
+	int undo_limit; //changes kept for undo / redo
+	int search_mode; //SEARCH_MODE_TRIGRAM or SEARCH_MODE_SCAN
+	const char* batch_file; //command file run instead of the menu ("-" = standard input), NULL = menu
+	int table_layout; //TABLE_LAYOUT_*
+	int page_size; //rows per page of long listings on a terminal, 0 = no paging
+} CMSOptions;
+
+/*
+* TableWriter
+* record table being printed to standard output (see cms_render.c)
+*/
+#define TABLE_LAYOUT_AUTO 0 //aligned on a terminal, tab separated when redirected
+#define TABLE_LAYOUT_ALIGNED 1 //padded columns
+#define TABLE_LAYOUT_TABS 2 //tab separated, like a CMS file
+
+typedef struct {
+	char* buffer; //formatted rows not written yet
+	size_t used;
+	int fd; //where the rows go
+	int aligned; //1 = padded columns, 0 = tabs
+	int rank_column; //1 = Rank column before the ID
+} TableWriter;
+
+/*
+* RecordCursor
+* page of a record listing (see cms_cursor.c)
+*/
+#define DEFAULT_PAGE_SIZE 50
+
+typedef struct {
+	const int* positions; //display positions listed, NULL = every record in display order
+	const int* ranks; //ranked listing (cursor_open_ranked): positions are arena slots, this is the rank of each row
+	int count; //rows in the listing
+	int offset; //first row of the page
+	int page_size;
+} RecordCursor;
+
+/*
+* WriteAheadLog
+* open change log of the current file, entry types below
+*/
+#define WAL_INSERT 1
+#define WAL_UPDATE 2
+#define WAL_DELETE 3
+#define WAL_DEFAULT_SYNC_EVERY 8
+
+typedef struct {
+	FILE* file; //NULL while logging is off
+	int pending; //entries written since the last disk sync
+	int deferred; //1 during a batch of changes: entries are flushed and synced once when it ends
+} WriteAheadLog;
+
+/*
+* SaveTracker
+* where each record sits in the saved file and what changed since then (cms_save.c),
+* so save_file can copy or skip unchanged records instead of rewriting them
+*/
+typedef struct {
+	long long offset; //text: byte offset of the record's line, binary: record number, -1 = not in the saved file
+	int length; //text: bytes of the line including its newline
+	int changed; //edited in place since the last save
+} RecordSource;
+
+typedef struct {
+	RecordSource* sources; //indexed by arena slot, slots past capacity are not in the saved file
+	int capacity;
+	int* changed_slots; //slots edited in place since the last save, each listed once
+	int changed_count;
+	int changed_capacity;
+	int layout_changed; //records inserted, deleted or reordered since the last save
+	int tracking; //1 = sources describe the current file
+	int format; //FILE_FORMAT_TEXT or FILE_FORMAT_BINARY, what offset means
+} SaveTracker;
+
+/*
+* SaveReport
+* what a save wrote, printed by save_file
+*/
+typedef struct {
+	long long file_bytes; //size of the saved file, a full rewrite writes all of it
+	long long bytes_written; //bytes written by the program
+	long long bytes_copied; //unchanged bytes copied from the old file
+	int records_written; //records formatted or patched
+	int incremental; //0 = the whole file was written
+} SaveReport;
+
+typedef struct {
+	CMSOptions options; //settings chosen at creation
+	RecordArena arena; //storage for student records
+	IdIndex id_index; //student ID -> arena slot
+	int* order; //slot of each record in display order
+	int order_capacity; //size of the order array
 	int record_count; // no. of records in db
 	int is_open; //flag: 0  = closed , 1 = open
 	char current_filename[100]; //name of the currently opened file
-	UndoInfo undo; //undo function
+	int file_format; //FILE_FORMAT_TEXT or FILE_FORMAT_BINARY, save_file writes the format the file was opened in
+	UndoJournal undo; //undo and redo
+	WriteAheadLog wal; //change log, only used when options.wal_enabled is set
+	SaveTracker save_tracker; //changes since the last save
+	ProgrammeDictionary programmes; //programme text of every code in use
+	SearchIndex search; //trigram index for name queries
+	MarkIndex marks; //mark buckets for exact and range queries
+	GroupStats stats; //mark aggregates per programme
+	SortViews views; //cached sort orders, one of them is db->order
 } CMSdb;
 
+/*
+* MappedFile
+* read-only view of a whole file (see cms_platform.c)
+*/
+typedef struct {
+	const char* data;
+	size_t size;
+	void* handle; //file mapping handle on Windows
+} MappedFile;
+
+/*
+* LoadStats
+* counters reported at the end of loading a file
+*/
+typedef struct {
+	int line_number; //lines processed
+	int header_lines_skipped;
+	int data_lines_found;
+	int data_lines_loaded;
+} LoadStats;
+
+/*
+* MergeReport
+* what merging a second CMS file into the open database did (see cms_merge.c)
+*/
+#define MERGE_INSERT_ONLY 0 //new IDs are added, records already in the database are kept as they are
+#define MERGE_UPSERT 1 //new IDs are added, existing records take the file's values
+#define MERGE_REPLACE 2 //as upsert, then records whose ID is not in the file are deleted (only if every row is valid)
+#define MERGE_REPLACE_FORCED 3 //as replace, deletes even when the file has no valid rows or some are rejected
+
+typedef struct {
+	int rows; //data lines (or binary records) in the file
+	int inserted;
+	int updated;
+	int unchanged; //already had the file's values
+	int skipped; //existing IDs left alone by MERGE_INSERT_ONLY
+	int rejected; //invalid lines, not merged
+	int deleted; //MERGE_REPLACE only
+	int refused; //MERGE_REPLACE deleted nothing, the file has no valid rows or some are rejected
+	double seconds;
+} MergeReport;
+
+/*
+* LookupReport
+* what looking up a file of student IDs found (see cms_lookup.c)
+*/
+typedef struct {
+	int requested; //IDs read
+	int duplicates; //IDs listed more than once, looked up once
+	int invalid; //lines that do not start with a valid ID (headers included)
+	int found;
+	int missing;
+	double seconds;
+} LookupReport;
+
+/*
+* Record access
+* records are addressed by display index (0..record_count-1), the arena slot is looked up through db->order
+*/
+static inline StoredRecord* arena_record(const RecordArena* arena, int slot) {
+	return &arena->chunks[slot >> RECORD_CHUNK_SHIFT][slot & RECORD_CHUNK_MASK];
+}
+static inline StoredRecord* db_record(const CMSdb* db, int index) {
+	return arena_record(&db->arena, db->order[index]);
+}
+static inline unsigned short* arena_programme_code(const RecordArena* arena, int slot) {
+	return &arena->programme_codes[slot >> RECORD_CHUNK_SHIFT][slot & RECORD_CHUNK_MASK];
+}
+static inline char* arena_folded_name(const RecordArena* arena, int slot) {
+	return arena->folded_names[slot >> RECORD_CHUNK_SHIFT] + (size_t)(slot & RECORD_CHUNK_MASK) * MAX_NAME_LENGTH;
+}
+static inline const char* slot_programme(const CMSdb* db, int slot) {
+	return db->programmes.names[*arena_programme_code(&db->arena, slot)];
+}
+static inline const char* db_programme(const CMSdb* db, int index) {
+	return slot_programme(db, db->order[index]);
+}
+static inline int mark_to_tenths(float mark) {
+	return (int)(mark * 10.0f + 0.5f); //marks are never negative
+}
+static inline float tenths_to_mark(int tenths) {
+	return (float)tenths / 10.0f;
+}
+static inline int sort_view_is_keyed(int view) { //sorted by ID or mark: kept in order as records change
+	return view >= SORT_VIEW_ID_ASC && view <= SORT_VIEW_MARK_DESC;
+}
+
 //Function Declaration
 
 //public interface functions
+void default_options(CMSOptions *options);
+int worker_thread_count(const CMSOptions *options);
 void initialize_db(CMSdb *db);
+void initialize_db_with_options(CMSdb *db, const CMSOptions *options);
+void free_db(CMSdb *db);
 void show_menu(void);
 int handle_menu_choice(int choice, CMSdb *db);
 
@@ -75,27 +489,238 @@ int get_valid_student_id(void);
 int is_header_line(const char* line);
 int parse_student_record(const char* line, StudentRecord* record);
 int valid_student_record(const StudentRecord* record);
+int check_student_record(const StudentRecord* record, int print_errors);
 int detect_file_format(const char* filename);
 void sanitize_input_fields(StudentRecord* record);
 
 //Core functions (called by menu handler)
 int open_file(CMSdb *db); 
+int open_file_path(CMSdb *db, const char* filename);
+int merge_file(CMSdb *db);
 int show_all_records(const CMSdb *db);
 int insert_record(CMSdb *db);
-int query_record(const CMSdb *db);
+int query_record(CMSdb *db);
 void query_by_id(const CMSdb *db);
-void query_by_name(const CMSdb *db);
-void query_by_programme(const CMSdb* db);
-void query_by_mark(const CMSdb* db);
+void query_by_name(CMSdb *db);
+void query_by_programme(CMSdb* db);
+void query_by_mark(CMSdb* db);
+void query_by_mark_range(CMSdb* db);
+void query_top_marks(CMSdb* db);
+void query_mark_percentile(CMSdb* db);
+void query_mark_rank(CMSdb* db);
+void query_programme_stats(CMSdb* db);
+void query_id_file(const CMSdb* db);
 int update_record(CMSdb *db);
 int delete_record(CMSdb *db);
-int save_file(const CMSdb *db);
-void save_undo_state(CMSdb* db, const char* operation);
+int save_file(CMSdb *db);
+int save_text_records(const CMSdb *db, const char* filename);
 int undo_last_operation(CMSdb* db);
+int redo_last_operation(CMSdb* db);
 int sort_records(CMSdb *db); //sort functions
 void sort_by_id_asc(CMSdb *db);
 void sort_by_id_desc(CMSdb *db);
 void sort_by_mark_asc(CMSdb *db);
 void sort_by_mark_desc(CMSdb *db);
+void sort_by_insertion_order(CMSdb *db);
+void sort_by_keys(CMSdb *db);
+void print_query_matches(const CMSdb* db, const int* matches, int count);
+
+//record store functions (cms_store.c)
+int grow_int_array(int** array, int* capacity, int needed);
+int arena_alloc_slot(RecordArena* arena);
+void arena_release_slot(RecordArena* arena, int slot);
+void arena_free(RecordArena* arena);
+int db_insert_record_at(CMSdb* db, int index, const StudentRecord* record);
+int db_append_record(CMSdb* db, const StudentRecord* record);
+void db_remove_record_at(CMSdb* db, int index);
+void db_remove_marked(CMSdb* db, const unsigned char* marked);
+void db_mark_removed(CMSdb* db, unsigned char* marked, int slot);
+int db_update_record(CMSdb* db, int slot, const StudentRecord* record);
+void db_get_record(const CMSdb* db, int slot, StudentRecord* record);
+void db_order_changed(CMSdb* db);
+void db_begin_changes(CMSdb* db, int change_count);
+void db_end_changes(CMSdb* db);
+void db_clear_records(CMSdb* db);
+int db_find_slot(const CMSdb* db, int id);
+int db_contains_id(const CMSdb* db, int id);
+int db_index_of_slot(const CMSdb* db, int slot);
+
+//ID index functions (cms_index.c)
+void id_index_init(IdIndex* index, int mode);
+int id_index_contains(const IdIndex* index, int id);
+int id_index_find(const IdIndex* index, int id);
+int id_index_insert(IdIndex* index, int id, int slot);
+void id_index_remove(IdIndex* index, int id);
+void id_index_clear(IdIndex* index);
+void id_index_free(IdIndex* index);
+
+//loader functions (cms_loader.c)
+int parse_record_fields(const char* line, size_t length, const unsigned int* tabs, int tab_count, StudentRecord* record);
+int parse_record_span(const char* line, size_t length, StudentRecord* record);
+int is_header_span(const char* line, size_t length);
+void load_records(CMSdb* db, const char* data, size_t size, LoadStats* stats);
+void load_records_parallel(CMSdb* db, const char* data, size_t size, int thread_count, LoadStats* stats);
+int scan_records(const char* data, size_t size, int (*visit)(void* context, const StudentRecord* record, int line_number),
+	void* context, LoadStats* stats);
+
+//binary file format (cms_binary.c)
+int is_binary_cms(const char* data, size_t size);
+int has_binary_extension(const char* filename);
+int load_binary_records(CMSdb* db, const char* data, size_t size, LoadStats* stats);
+int save_binary_records(const CMSdb* db, const char* filename);
+int patch_binary_records(CMSdb* db, const char* filename, SaveReport* report);
+
+//undo journal (cms_undo.c)
+void undo_journal_init(UndoJournal* journal, int limit);
+void undo_journal_clear(UndoJournal* journal);
+void undo_journal_free(UndoJournal* journal);
+void undo_record_insert(CMSdb* db, int index, const StudentRecord* record);
+void undo_record_update(CMSdb* db, const StudentRecord* before, const StudentRecord* after);
+void undo_record_delete(CMSdb* db, int index, const StudentRecord* record);
+int undo_journal_undo(CMSdb* db, UndoEntry* undone);
+int undo_journal_redo(CMSdb* db, UndoEntry* redone);
+
+//change tracking and incremental save (cms_save.c)
+void tracker_set_source(CMSdb* db, int slot, long long offset, int length);
+void tracker_forget_slot(CMSdb* db, int slot);
+void tracker_mark_changed(CMSdb* db, int slot);
+void tracker_mark_layout_changed(CMSdb* db);
+void tracker_reset(CMSdb* db);
+void tracker_start(CMSdb* db, int format);
+void tracker_start_binary(CMSdb* db);
+void tracker_free(CMSdb* db);
+int save_text_incremental(CMSdb* db, const char* source_filename, const char* filename, SaveReport* report);
+
+//text search (cms_search.c)
+#define SEARCH_FIELD_NAME 0
+#define SEARCH_FIELD_PROGRAMME 1
+void fold_text(char* folded, const char* text, size_t size);
+int search_records(CMSdb* db, int field, const char* text, int** matches, int* capacity);
+int search_records_scan(const CMSdb* db, int field, const char* text, int** matches, int* capacity);
+void search_index_init(SearchIndex* search);
+void search_index_free(SearchIndex* search);
+int search_index_build(CMSdb* db);
+void search_index_add(CMSdb* db, int slot);
+void search_index_remove(CMSdb* db, int slot);
+void search_index_update(CMSdb* db, int slot, const char* name);
+int search_positions(CMSdb* db);
+int search_display_order(CMSdb* db, int* slots, int count, int** matches, int* capacity);
+int posting_insert(PostingList* list, int slot);
+void posting_remove(PostingList* list, int slot);
+
+//mark index (cms_marks.c)
+int mark_index_build(CMSdb* db);
+void mark_index_free(MarkIndex* marks);
+void mark_index_drop_buckets(MarkIndex* marks);
+void mark_index_add(CMSdb* db, int slot);
+void mark_index_remove(CMSdb* db, int slot);
+int mark_range_query(CMSdb* db, int low_tenths, int high_tenths, int** matches, int* capacity);
+int mark_count_range(const CMSdb* db, int low_tenths, int high_tenths);
+int mark_percentile(const CMSdb* db, int percent_tenths);
+int mark_top_k(CMSdb* db, int k, int** slots, int* capacity);
+
+//per-programme aggregates (cms_stats.c)
+void group_stats_add(CMSdb* db, int slot);
+void group_stats_remove(CMSdb* db, int slot);
+int group_stats_refresh(CMSdb* db);
+int group_stats_codes(const CMSdb* db, int* codes);
+void group_stats_free(GroupStats* stats);
+
+//sort engine (cms_sort.c)
+int sort_slots_radix(const RecordArena* arena, int* slots, int count, int key, int descending, int thread_count);
+void sort_slots_qsort(const RecordArena* arena, int* slots, int count, int key, int descending);
+void sort_view_show(CMSdb* db, int view);
+void sort_views_add(CMSdb* db, int slot);
+void sort_views_remove(CMSdb* db, int slot);
+void sort_views_remove_marked(CMSdb* db, const unsigned char* marked);
+void sort_views_update_mark(CMSdb* db, int slot, int tenths);
+int sort_view_insert_position(const CMSdb* db, int slot);
+int sort_view_index_of_slot(const CMSdb* db, int slot);
+void sort_views_free(SortViews* views);
+void sort_views_begin_changes(CMSdb* db);
+void sort_views_end_changes(CMSdb* db);
+int sort_spec_parse(const char* text, SortSpec* spec);
+void sort_spec_format(const SortSpec* spec, char* text, size_t size);
+int sort_slots_by_spec(const CMSdb* db, const SortSpec* spec, int* slots, int count, int thread_count);
+int sort_view_show_spec(CMSdb* db, const SortSpec* spec);
+
+//programme dictionary (cms_dictionary.c)
+int programme_intern(ProgrammeDictionary* dictionary, const char* programme);
+int programme_find(const ProgrammeDictionary* dictionary, const char* programme);
+void programme_dictionary_clear(ProgrammeDictionary* dictionary);
+void programme_dictionary_free(ProgrammeDictionary* dictionary);
+
+//write-ahead log (cms_wal.c)
+int wal_open(CMSdb* db);
+int wal_sync(CMSdb* db);
+void wal_close(CMSdb* db);
+void wal_discard(CMSdb* db, const char* filename);
+void wal_defer(CMSdb* db, int deferred);
+int wal_replay(CMSdb* db, const char* filename);
+void wal_log_insert(CMSdb* db, int index, const StudentRecord* record);
+void wal_log_update(CMSdb* db, const StudentRecord* record);
+void wal_log_delete(CMSdb* db, int id);
+
+//delimiter scanning (cms_simd.c)
+#define DELIM_SCANNER_SCALAR 0
+#define DELIM_SCANNER_SSE2 1
+#define DELIM_SCANNER_AVX2 2
+size_t scan_delimiters(const char* data, size_t length, unsigned int* offsets);
+size_t scan_delimiters_with(int scanner, const char* data, size_t length, unsigned int* offsets);
+int delimiter_scanner_available(int scanner);
+
+//platform functions (cms_platform.c)
+int map_file(const char* filename, MappedFile* map);
+void unmap_file(MappedFile* map);
+int flush_to_disk(FILE* file);
+int replace_file(const char* from, const char* to);
+int file_open_read(const char* filename);
+int file_open_update(const char* filename);
+int file_create(const char* filename);
+int file_write(int fd, const void* data, size_t length);
+int stdin_is_terminal(void);
+int stdout_is_terminal(void);
+int stdout_descriptor(void);
+int file_read_at(int fd, void* data, size_t length, long long offset);
+int file_write_at(int fd, const void* data, size_t length, long long offset);
+int file_copy_range(int from_fd, long long offset, long long length, int to_fd);
+int file_close(int fd, int sync);
+int cpu_count(void);
+void parallel_for(int task_count, int thread_count, void (*task)(void* context, int index), void* context);
+
+//merging a second file (cms_merge.c)
+int merge_file_path(CMSdb* db, const char* filename, int policy, MergeReport* report);
+const char* merge_policy_name(int policy);
+void print_merge_report(const MergeReport* report, int policy);
+
+//looking up a file of IDs (cms_lookup.c)
+int lookup_ids_path(const CMSdb* db, const char* input, const char* output, LookupReport* report);
+void print_lookup_report(const LookupReport* report, const char* output);
+
+//record tables (cms_render.c)
+void table_begin(TableWriter* table, int layout, int rank_column);
+void table_begin_fd(TableWriter* table, int fd, int aligned, int rank_column);
+void table_row(TableWriter* table, int rank, int id, const char* name, const char* programme, int mark_tenths);
+void table_slot(TableWriter* table, const CMSdb* db, int slot);
+void table_end(TableWriter* table);
+
+//paging through records (cms_cursor.c)
+void cursor_open(RecordCursor* cursor, const int* positions, int count, int page_size);
+void cursor_open_ranked(RecordCursor* cursor, const int* slots, const int* ranks, int count, int page_size);
+void cursor_seek(RecordCursor* cursor, int offset);
+int cursor_next(RecordCursor* cursor);
+int cursor_prev(RecordCursor* cursor);
+void cursor_last(RecordCursor* cursor);
+int cursor_page_end(const RecordCursor* cursor);
+void cursor_print(const CMSdb* db, const RecordCursor* cursor, TableWriter* table);
+void print_record_window(const CMSdb* db, const int* positions, int count, int offset, int limit);
+void browse_records(const CMSdb* db, const int* positions, int count);
+void browse_ranked(const CMSdb* db, const int* slots, const int* ranks, int count);
+
+//batch mode (cms_batch.c)
+int run_batch(CMSdb* db, const char* filename);
+
+//benchmarks (cms_benchmark.c)
+int run_benchmarks(int argc, char* argv[]);
 #endif
 
@@ -0,0 +1,612 @@
+/*
+* Course Management System (CMS)
+* Batch mode - "--batch=<file>" runs a command file ("-" reads standard input) instead of the menu,
+* without prompts or confirmations
+*
+* one command per line, blank lines and lines starting with # are skipped; fields are separated by tabs,
+* or by spaces when the line has no tab (then a field with spaces goes in "double quotes"):
+*   OPEN <file>
+*   INSERT <id> <name> <programme> <mark>
+*   UPDATE <id> <name> <programme> <mark>      "-" keeps the current value of a field
+*   DELETE <id>
+*   QUERY ID <id> | QUERY NAME <text> | QUERY PROGRAMME <text> | QUERY MARK <mark> [<highest mark>]
+*                                              any query can end with [LIMIT n] [OFFSET m]
+*   SORT <field> [asc|desc], ...               as in Sort by Several Keys, or SORT INSERTION
+*   MERGE <file> [insert|upsert|replace]      merge policy, upsert if not given
+*   MERGE <file> replace force                 replace even if rows of the file are rejected
+*   LOOKUP <ID file> <output file>             records of every ID in the file, then the IDs not found
+*   SHOW [LIMIT n] [OFFSET m]                  only n rows, starting after the first m
+*   SAVE
+* commands are not case sensitive
+*
+* consecutive INSERT, UPDATE and DELETE commands (up to BATCH_SIZE) are read first and applied as one batch:
+* the indexes are brought up to date once per batch (db_begin_changes), the deleted records are taken out
+* together in one pass at the end of the batch (their IDs are free at once), the change log is synced once,
+* and one summary line is printed per batch, plus one line for every rejected command
+* batch changes are not kept for undo, the program ends when the file does
+*/
+
+#include "cms.h"
+
+#define BATCH_SIZE 10000 //changes applied together
+#define BATCH_LINE_MAX 512
+#define BATCH_FIELDS_MAX 8
+
+typedef struct {
+	char text[BATCH_LINE_MAX];
+	int line_number;
+} BatchLine;
+
+typedef struct {
+	CMSdb* db;
+	FILE* input;
+	int line_number;
+	int batch_number;
+	int failures; //rejected commands, the exit code is 1 if there are any
+	BatchLine* pending; //change commands read ahead for the next batch
+	int pending_count;
+	unsigned char* deleted; //slots deleted by the batch being applied, removed by db_remove_marked at its end
+	int* deleted_slots; //the same slots as a list
+	int deleted_count;
+	int deleted_capacity;
+} BatchRun;
+
+/*
+* Split line into fields (in place), returns how many there are, -1 for an unclosed quote or too many fields
+*/
+static int batch_fields(char* line, char** fields)
+{
+	int count = 0;
+
+	if (strchr(line, '\t') != NULL) {
+		char* cursor = line;
+		while (count < BATCH_FIELDS_MAX) {
+			fields[count++] = cursor;
+			cursor = strchr(cursor, '\t');
+			if (cursor == NULL) {
+				break;
+			}
+			*cursor++ = '\0';
+		}
+		if (cursor != NULL) {
+			return -1;
+		}
+		for (int i = 0; i < count; i++) {
+			//tab separated fields keep inner spaces, only the ends are trimmed
+			while (isspace((unsigned char)*fields[i])) fields[i]++;
+			char* end = fields[i] + strlen(fields[i]);
+			while (end > fields[i] && isspace((unsigned char)end[-1])) *--end = '\0';
+		}
+		return count;
+	}
+
+	char* cursor = line;
+	while (1) {
+		while (*cursor == ' ') cursor++;
+		if (*cursor == '\0') {
+			return count;
+		}
+		if (count == BATCH_FIELDS_MAX) {
+			return -1;
+		}
+		if (*cursor == '"') {
+			fields[count++] = ++cursor;
+			cursor = strchr(cursor, '"');
+			if (cursor == NULL) {
+				return -1;
+			}
+		}
+		else {
+			fields[count++] = cursor;
+			cursor += strcspn(cursor, " ");
+		}
+		if (*cursor != '\0') {
+			*cursor++ = '\0';
+		}
+	}
+}
+
+/*
+* field equals keyword, ignoring case (keywords are lowercase)
+*/
+static int batch_keyword(const char* field, const char* keyword)
+{
+	char folded[16];
+	if (strlen(field) >= sizeof(folded)) {
+		return 0;
+	}
+	fold_text(folded, field, sizeof(folded));
+	return strcmp(folded, keyword) == 0;
+}
+
+/*
+* A 7 digit student ID, returns 0 if text is not one
+*/
+static int batch_id(const char* text, int* id)
+{
+	if (strlen(text) != MAX_ID_LENGTH) {
+		return 0;
+	}
+	for (int i = 0; i < MAX_ID_LENGTH; i++) {
+		if (!isdigit((unsigned char)text[i])) {
+			return 0;
+		}
+	}
+	*id = atoi(text);
+	return *id >= MIN_VALID_ID && *id <= MAX_VALID_ID;
+}
+
+/*
+* A mark from 0 to 100 with at most 1 decimal place, returns 0 if text is not one
+*/
+static int batch_mark(const char* text, float* mark)
+{
+	int digits = 0, decimals = 0, has_decimal = 0;
+
+	for (const char* p = text; *p != '\0'; p++) {
+		if (*p == '.' && !has_decimal) {
+			has_decimal = 1;
+		}
+		else if (isdigit((unsigned char)*p)) {
+			if (has_decimal) decimals++;
+			else digits++;
+		}
+		else {
+			return 0;
+		}
+	}
+	if (digits == 0 || decimals > 1 || (has_decimal && decimals == 0)) {
+		return 0;
+	}
+	*mark = (float)atof(text);
+	return *mark >= 0 && *mark <= 100;
+}
+
+/*
+* Name, programme and mark fields of INSERT / UPDATE on top of record ("-" keeps a field when keep is set)
+* returns NULL if they are valid, otherwise why not
+*/
+static const char* batch_record_fields(char** fields, StudentRecord* record, int keep)
+{
+	if (!(keep && strcmp(fields[0], "-") == 0)) {
+		if (strlen(fields[0]) >= MAX_NAME_LENGTH) return "name too long";
+		strcpy_s(record->name, sizeof(record->name), fields[0]);
+	}
+	if (!(keep && strcmp(fields[1], "-") == 0)) {
+		if (strlen(fields[1]) >= MAX_PROGRAMME_LENGTH) return "programme too long";
+		strcpy_s(record->programme, sizeof(record->programme), fields[1]);
+	}
+	if (!(keep && strcmp(fields[2], "-") == 0) && !batch_mark(fields[2], &record->mark)) {
+		return "mark must be 0-100 with at most 1 decimal place";
+	}
+	sanitize_input_fields(record);
+	if (!check_student_record(record, 0)) {
+		return "name and programme cannot be empty";
+	}
+	return NULL;
+}
+
+/*
+* Display position of a record inserted by the batch as the change log replays it:
+* the records deleted earlier in the batch are still in db->order, but the log has already removed them
+*/
+static int batch_logged_position(const BatchRun* run, int slot)
+{
+	const CMSdb* db = run->db;
+
+	if (!sort_view_is_keyed(db->views.shown)) {
+		return db->record_count - 1 - run->deleted_count; //appended after all of them
+	}
+	int index = sort_view_index_of_slot(db, slot);
+	int position = index;
+	for (int i = 0; i < run->deleted_count; i++) {
+		if (sort_view_index_of_slot(db, run->deleted_slots[i]) < index) {
+			position--;
+		}
+	}
+	return position;
+}
+
+/*
+* Apply one INSERT, UPDATE or DELETE, returns NULL if it was applied, otherwise why not
+*/
+static const char* batch_change(BatchRun* run, char** fields, int count)
+{
+	CMSdb* db = run->db;
+	StudentRecord record;
+	int id;
+
+	if (count < 2 || !batch_id(fields[1], &id)) {
+		return "expected a 7 digit student ID";
+	}
+	int slot = db_find_slot(db, id);
+
+	if (batch_keyword(fields[0], "insert")) {
+		if (count != 5) return "expected INSERT <id> <name> <programme> <mark>";
+		if (slot >= 0) return "a record with this ID already exists";
+		memset(&record, 0, sizeof(record));
+		record.id = id;
+		const char* error = batch_record_fields(fields + 2, &record, 0);
+		if (error != NULL) return error;
+		if (db_append_record(db, &record) != 1) return "out of memory";
+		wal_log_insert(db, batch_logged_position(run, db_find_slot(db, id)), &record);
+	}
+	else if (batch_keyword(fields[0], "update")) {
+		if (count != 5) return "expected UPDATE <id> <name|-> <programme|-> <mark|->";
+		if (slot < 0) return "no record with this ID";
+		db_get_record(db, slot, &record);
+		const char* error = batch_record_fields(fields + 2, &record, 1);
+		if (error != NULL) return error;
+		if (!db_update_record(db, slot, &record)) return "out of memory";
+		wal_log_update(db, &record);
+	}
+	else {
+		if (count != 2) return "expected DELETE <id>";
+		if (slot < 0) return "no record with this ID";
+		if (!grow_int_array(&run->deleted_slots, &run->deleted_capacity, run->deleted_count + 1)) return "out of memory";
+		run->deleted_slots[run->deleted_count++] = slot;
+		db_mark_removed(db, run->deleted, slot); //taken out with the batch's other deletes by batch_apply
+		wal_log_delete(db, id);
+	}
+	return NULL;
+}
+
+/*
+* Read the next command line, returns 0 at the end of the input
+* comments and blank lines are skipped, a line too long for the buffer is returned empty (and rejected)
+*/
+static int batch_read_line(BatchRun* run, BatchLine* line)
+{
+	while (fgets(line->text, sizeof(line->text), run->input) != NULL) {
+		line->line_number = ++run->line_number;
+		if (strchr(line->text, '\n') == NULL && !feof(run->input)) {
+			int c;
+			while ((c = fgetc(run->input)) != '\n' && c != EOF) {}
+			line->text[0] = '\0';
+			return 1;
+		}
+		line->text[strcspn(line->text, "\r\n")] = '\0';
+		const char* start = line->text;
+		while (*start == ' ' || *start == '\t') start++;
+		if (*start != '\0' && *start != '#') {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+* The command word of a line (empty if it does not fit in word), returns where the rest of the line starts
+*/
+static const char* batch_command_word(const char* text, char* word, size_t size)
+{
+	text += strspn(text, " \t");
+	size_t length = strcspn(text, " \t");
+	word[0] = '\0';
+	if (length < size) {
+		memcpy(word, text, length);
+		word[length] = '\0';
+	}
+	text += length;
+	return text + strspn(text, " \t");
+}
+
+static int batch_is_change(const char* text)
+{
+	char word[16];
+	batch_command_word(text, word, sizeof(word));
+	return batch_keyword(word, "insert") || batch_keyword(word, "update") || batch_keyword(word, "delete");
+}
+
+static void batch_reject(BatchRun* run, int line_number, const char* reason)
+{
+	printf("CMS: Line %d rejected - %s\n", line_number, reason);
+	run->failures++;
+}
+
+/*
+* Apply the change commands read ahead as one batch
+*/
+static void batch_apply(BatchRun* run)
+{
+	CMSdb* db = run->db;
+	int applied = 0;
+	char* fields[BATCH_FIELDS_MAX];
+
+	if (run->pending_count == 0) {
+		return;
+	}
+	run->batch_number++;
+	//every insert takes at most one new slot, a record inserted and deleted in the same batch fits in the bitmap
+	run->deleted = db->is_open ? (unsigned char*)calloc((size_t)(db->arena.slot_count + run->pending_count) / 8 + 1, 1) : NULL;
+	if (run->deleted == NULL) {
+		for (int i = 0; i < run->pending_count; i++) {
+			batch_reject(run, run->pending[i].line_number, db->is_open ? "out of memory" : "no database is open");
+		}
+		run->pending_count = 0;
+		return;
+	}
+
+	db_begin_changes(db, run->pending_count);
+	for (int i = 0; i < run->pending_count; i++) {
+		BatchLine* line = &run->pending[i];
+		int count = batch_fields(line->text, fields);
+		const char* error = (count < 0) ? "unclosed quote or too many fields" : batch_change(run, fields, count);
+		if (error != NULL) {
+			batch_reject(run, line->line_number, error);
+		}
+		else {
+			applied++;
+		}
+	}
+	if (run->deleted_count > 0) {
+		db_remove_marked(db, run->deleted);
+	}
+	free(run->deleted);
+	run->deleted = NULL;
+	run->deleted_count = 0;
+	db_end_changes(db);
+
+	printf("CMS: Batch %d (lines %d-%d): %d change(s) applied, %d rejected, %d records\n",
+		run->batch_number, run->pending[0].line_number, run->pending[run->pending_count - 1].line_number,
+		applied, run->pending_count - applied, db->record_count);
+	run->pending_count = 0;
+}
+
+/*
+* Take "LIMIT n" and "OFFSET m" off the end of a command (in either order)
+* *limit is -1 and *offset 0 when they are not given, returns NULL or why the command is rejected
+*/
+static const char* batch_window(char** fields, int* count, int* offset, int* limit)
+{
+	*offset = 0;
+	*limit = -1;
+	while (*count >= 3 && (batch_keyword(fields[*count - 2], "limit") || batch_keyword(fields[*count - 2], "offset"))) {
+		const char* number = fields[*count - 1];
+		size_t length = strlen(number);
+		if (length < 1 || length > 9 || strspn(number, "0123456789") != length) {
+			return "LIMIT and OFFSET take a number of rows";
+		}
+		if (batch_keyword(fields[*count - 2], "limit")) *limit = atoi(number);
+		else *offset = atoi(number);
+		*count -= 2;
+	}
+	return NULL;
+}
+
+/*
+* QUERY ID / NAME / PROGRAMME / MARK, then only the rows in the LIMIT / OFFSET window are printed
+*/
+static const char* batch_query(CMSdb* db, char** fields, int count, int offset, int limit)
+{
+	int* matches = NULL;
+	int capacity = 0;
+	int found;
+
+	if (count < 3) {
+		return "expected QUERY ID|NAME|PROGRAMME|MARK <value>";
+	}
+	if (batch_keyword(fields[1], "id")) {
+		int id;
+		if (count != 3 || !batch_id(fields[2], &id)) return "expected QUERY ID <7 digit id>";
+		int slot = db_find_slot(db, id);
+		if (slot < 0) {
+			printf("CMS: The record with ID=%d does not exist.\n", id);
+			return NULL;
+		}
+		if (!grow_int_array(&matches, &capacity, 1)) return "out of memory";
+		matches[0] = db_index_of_slot(db, slot);
+		found = 1;
+	}
+	else if (batch_keyword(fields[1], "name") || batch_keyword(fields[1], "programme")) {
+		if (count != 3) return "expected QUERY NAME|PROGRAMME <text>";
+		int field = batch_keyword(fields[1], "name") ? SEARCH_FIELD_NAME : SEARCH_FIELD_PROGRAMME;
+		found = search_records(db, field, fields[2], &matches, &capacity);
+	}
+	else if (batch_keyword(fields[1], "mark")) {
+		float low, high;
+		if (count > 4 || !batch_mark(fields[2], &low) || !batch_mark(fields[count - 1], &high) || low > high) {
+			return "expected QUERY MARK <mark> [<highest mark>]";
+		}
+		found = mark_range_query(db, mark_to_tenths(low), mark_to_tenths(high), &matches, &capacity);
+	}
+	else {
+		return "expected QUERY ID|NAME|PROGRAMME|MARK <value>";
+	}
+
+	if (found < 0) {
+		free(matches);
+		return "out of memory";
+	}
+	print_record_window(db, matches, found, offset, limit);
+	printf("Total records found: %d\n", found);
+	free(matches);
+	return NULL;
+}
+
+/*
+* SORT: a single ID or mark key shows the cached sorted view, anything else the multi-key sort
+*/
+static const char* batch_sort(CMSdb* db, const char* text)
+{
+	static const int keyed_views[2][2] = {
+		{ SORT_VIEW_ID_ASC, SORT_VIEW_ID_DESC },
+		{ SORT_VIEW_MARK_ASC, SORT_VIEW_MARK_DESC },
+	};
+	SortSpec spec;
+
+	if (batch_keyword(text, "insertion")) {
+		sort_view_show(db, SORT_VIEW_INSERTION);
+		printf("Back to Insertion Order\n");
+		return NULL;
+	}
+	if (!sort_spec_parse(text, &spec)) {
+		return "expected SORT <field> [asc|desc], ... (fields id, name, programme, mark) or SORT INSERTION";
+	}
+	if (spec.count == 1 && (spec.keys[0] == SORT_KEY_ID || spec.keys[0] == SORT_KEY_MARK)) {
+		sort_view_show(db, keyed_views[spec.keys[0] == SORT_KEY_MARK][spec.descending[0]]);
+	}
+	else if (!sort_view_show_spec(db, &spec)) {
+		return "out of memory";
+	}
+	char spec_text[100];
+	sort_spec_format(&spec, spec_text, sizeof(spec_text));
+	printf("Sorted by %s\n", spec_text);
+	return NULL;
+}
+
+/*
+* MERGE <file> [insert|upsert|replace], or replace force
+* returns NULL on success or why the command was rejected
+*/
+static const char* batch_merge(CMSdb* db, char** fields, int count)
+{
+	int policy = MERGE_UPSERT;
+
+	if (count < 2 || count > 4) {
+		return "expected MERGE <file> [insert|upsert|replace]";
+	}
+	if (count >= 3) {
+		if (batch_keyword(fields[2], "insert")) policy = MERGE_INSERT_ONLY;
+		else if (batch_keyword(fields[2], "upsert")) policy = MERGE_UPSERT;
+		else if (batch_keyword(fields[2], "replace")) policy = MERGE_REPLACE;
+		else return "merge policy must be insert, upsert or replace";
+	}
+	if (count == 4) {
+		if (policy != MERGE_REPLACE || !batch_keyword(fields[3], "force")) return "expected MERGE <file> replace force";
+		policy = MERGE_REPLACE_FORCED;
+	}
+	MergeReport report;
+	int merged = merge_file_path(db, fields[1], policy, &report);
+	if (report.rows > 0 || merged) {
+		print_merge_report(&report, policy);
+	}
+	if (report.refused) {
+		return "replace deleted nothing, MERGE <file> replace force deletes anyway";
+	}
+	return merged ? NULL : "the file could not be merged";
+}
+
+/*
+* Run one command that is not a change
+*/
+static void batch_command(BatchRun* run, BatchLine* line)
+{
+	CMSdb* db = run->db;
+	char* fields[BATCH_FIELDS_MAX];
+	const char* error = NULL;
+
+	//SORT takes the rest of the line as its key spec, before the line is split
+	char word[16];
+	const char* rest = batch_command_word(line->text, word, sizeof(word));
+	if (batch_keyword(word, "sort")) {
+		error = db->is_open ? batch_sort(db, rest) : "no database is open";
+		if (error != NULL) {
+			batch_reject(run, line->line_number, error);
+		}
+		return;
+	}
+
+	int count = batch_fields(line->text, fields);
+	if (count <= 0) {
+		error = (line->text[0] == '\0') ? "line too long" : "unclosed quote or too many fields";
+	}
+	else if (batch_keyword(fields[0], "open")) {
+		if (count != 2) error = "expected OPEN <file>";
+		else if (db->is_open) error = "a database is already open";
+		else if (!open_file_path(db, fields[1])) error = "the file could not be opened";
+	}
+	else if (!db->is_open) {
+		error = "no database is open";
+	}
+	else if (batch_keyword(fields[0], "query")) {
+		int offset, limit;
+		error = batch_window(fields, &count, &offset, &limit);
+		if (error == NULL) error = batch_query(db, fields, count, offset, limit);
+	}
+	else if (batch_keyword(fields[0], "merge")) {
+		error = batch_merge(db, fields, count);
+	}
+	else if (batch_keyword(fields[0], "lookup")) {
+		LookupReport report;
+		if (count != 3) error = "expected LOOKUP <ID file> <output file>";
+		else if (!lookup_ids_path(db, fields[1], fields[2], &report)) error = "the IDs could not be looked up";
+		else print_lookup_report(&report, fields[2]);
+	}
+	else if (batch_keyword(fields[0], "show")) {
+		int offset, limit;
+		error = batch_window(fields, &count, &offset, &limit);
+		if (error == NULL && count != 1) error = "expected SHOW [LIMIT n] [OFFSET m]";
+		else if (error == NULL && (limit >= 0 || offset > 0)) {
+			//only the rows asked for are read, however many records there are
+			print_record_window(db, NULL, db->record_count, offset, limit);
+			printf("Total records: %d\n", db->record_count);
+		}
+		else if (error == NULL) show_all_records(db);
+	}
+	else if (batch_keyword(fields[0], "save")) {
+		if (count != 1) error = "expected SAVE";
+		else if (!save_file(db)) error = "the file could not be saved";
+	}
+	else {
+		error = "unknown command (OPEN, INSERT, UPDATE, DELETE, QUERY, SORT, MERGE, LOOKUP, SHOW, SAVE)";
+	}
+	if (error != NULL) {
+		batch_reject(run, line->line_number, error);
+	}
+}
+
+/*
+* Run the commands in filename ("-" = standard input)
+* returns 0 if every command succeeded, 1 if any was rejected or the file cannot be read
+*/
+int run_batch(CMSdb* db, const char* filename)
+{
+	BatchRun run;
+	memset(&run, 0, sizeof(run));
+	run.db = db;
+	run.input = (strcmp(filename, "-") == 0) ? stdin : fopen(filename, "r");
+	if (run.input == NULL) {
+		printf("CMS: Error - Cannot open command file \"%s\"\n", filename);
+		return 1;
+	}
+	run.pending = (BatchLine*)malloc(BATCH_SIZE * sizeof(BatchLine));
+	if (run.pending == NULL) {
+		printf("CMS: Error - Not enough memory for batch mode.\n");
+		if (run.input != stdin) fclose(run.input);
+		return 1;
+	}
+	//output goes out in large writes instead of a system call per line
+	setvbuf(stdout, NULL, _IOFBF, 1 << 16);
+
+	int done = 0;
+	while (!done) {
+		//collect the change commands up to the next other command (or BATCH_SIZE of them)
+		BatchLine next;
+		int have_next = 0;
+		while (run.pending_count < BATCH_SIZE) {
+			if (!batch_read_line(&run, &next)) {
+				done = 1;
+				break;
+			}
+			if (!batch_is_change(next.text)) {
+				have_next = 1;
+				break;
+			}
+			run.pending[run.pending_count++] = next;
+		}
+		batch_apply(&run);
+		if (have_next) {
+			batch_command(&run, &next);
+		}
+	}
+
+	if (run.input != stdin) {
+		fclose(run.input);
+	}
+	free(run.pending);
+	free(run.deleted_slots);
+	printf("CMS: Batch mode finished, %d line(s) read, %d command(s) rejected\n", run.line_number, run.failures);
+	fflush(stdout);
+	return run.failures > 0;
+}
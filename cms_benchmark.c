@@ -0,0 +1,1606 @@
+/*
+* Course Management System (CMS)
+* Benchmarks - run with "p7_7_CMS --bench <name> [limit]"
+* the limit is the largest record count (or file size in MB) a benchmark goes up to
+*/
+
+#include "cms.h"
+#include <time.h>
+
+#define PARALLEL_BENCH_MAX_THREADS 16
+
+/*
+* Wall clock time in seconds
+*/
+static double bench_now(void)
+{
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/*
+* Deterministic record generator so every run uses the same data
+*/
+static unsigned int bench_seed = 12345u;
+
+static unsigned int bench_rand(void)
+{
+	bench_seed = bench_seed * 1103515245u + 12345u;
+	return (bench_seed >> 8) & 0xFFFFFF;
+}
+
+static void bench_make_record(StudentRecord* record, int n)
+{
+	static const char* first_names[] = { "Joshua", "Isaac", "John", "Wei Liang", "Xinlong", "Zhongjiang", "Qianhui", "Mei Ling" };
+	static const char* last_names[] = { "Chen", "Teo", "Levoy", "Tan", "Lim", "Ng", "Wong", "Goh" };
+	static const char* programmes[] = { "Software Engineering", "Computer Science", "Digital Supply Chain",
+		"Applied Artificial Intelligence", "Information Security", "Game Design" };
+
+	record->id = MIN_VALID_ID + n; //unique while n < 9000000
+	snprintf(record->name, sizeof(record->name), "%s %s",
+		first_names[bench_rand() % 8], last_names[bench_rand() % 8]);
+	strcpy_s(record->programme, sizeof(record->programme), programmes[bench_rand() % 6]);
+	record->mark = (float)(bench_rand() % 1001) / 10.0f;
+}
+
+/*
+* Empty db and add the records 0..n-1, the same records on every call
+*/
+static void bench_fill(CMSdb* db, long n)
+{
+	StudentRecord record;
+
+	db_clear_records(db);
+	bench_seed = 12345u;
+	for (long i = 0; i < n; i++) {
+		bench_make_record(&record, (int)i);
+		db_append_record(db, &record);
+	}
+}
+
+/*
+* Record store: time to load n records and to scan them in display order
+*/
+static int bench_store(long max_records)
+{
+	CMSdb db;
+	initialize_db(&db);
+
+	printf("%-12s %-14s %-14s %-16s\n", "Records", "Load (s)", "Scan (s)", "Load (rec/s)");
+	for (long n = 1000; n <= max_records; n *= 10) {
+		StudentRecord record;
+		db_clear_records(&db);
+		bench_seed = 12345u;
+
+		double start = bench_now();
+		for (long i = 0; i < n; i++) {
+			bench_make_record(&record, (int)i);
+			if (db_append_record(&db, &record) != 1) {
+				printf("Out of memory at %ld records\n", i);
+				free_db(&db);
+				return 1;
+			}
+		}
+		double load_time = bench_now() - start;
+
+		//full scan touching every record, like show_all_records and the queries do
+		start = bench_now();
+		double mark_sum = 0;
+		long programme_hits = 0;
+		for (int i = 0; i < db.record_count; i++) {
+			const StoredRecord* current = db_record(&db, i);
+			mark_sum += tenths_to_mark(current->mark_tenths);
+			if (db_programme(&db, i)[0] == 'S') programme_hits++;
+		}
+		double scan_time = bench_now() - start;
+
+		printf("%-12ld %-14.4f %-14.4f %-16.0f (checksum %.1f/%ld)\n",
+			n, load_time, scan_time, load_time > 0 ? n / load_time : 0.0, mark_sum, programme_hits);
+	}
+
+	free_db(&db);
+	return 0;
+}
+
+/*
+* Scattered unique IDs: i * 4999999 mod 9000000 is a permutation because the two are coprime
+*/
+static int bench_scattered_id(long i)
+{
+	return MIN_VALID_ID + (int)((i * 4999999LL) % (MAX_VALID_ID - MIN_VALID_ID + 1));
+}
+
+/*
+* ID index: hash table vs direct mapped bitmap for insert, hit and miss lookups
+*/
+static int bench_index(long max_records)
+{
+	static const char* mode_names[] = { "hash", "direct" };
+
+	if (max_records > 4000000) {
+		max_records = 4000000; //misses use the next n IDs, 2n must stay inside the 9M ID range
+	}
+
+	printf("%-8s %-10s %-12s %-16s %-16s %-16s\n", "Mode", "Records", "Insert (s)", "Hits (op/s)", "Misses (op/s)", "Contains (op/s)");
+	for (long n = 1000; n <= max_records; n *= 10) {
+		for (int mode = ID_INDEX_HASH; mode <= ID_INDEX_DIRECT; mode++) {
+			IdIndex index;
+			id_index_init(&index, mode);
+
+			double start = bench_now();
+			for (long i = 0; i < n; i++) {
+				id_index_insert(&index, bench_scattered_id(i), (int)i);
+			}
+			double insert_time = bench_now() - start;
+
+			long found = 0;
+			start = bench_now();
+			for (long i = 0; i < n; i++) {
+				found += id_index_find(&index, bench_scattered_id(i)) >= 0;
+			}
+			double hit_time = bench_now() - start;
+
+			start = bench_now();
+			for (long i = n; i < 2 * n; i++) {
+				found += id_index_find(&index, bench_scattered_id(i)) >= 0;
+			}
+			double miss_time = bench_now() - start;
+
+			//duplicate check as done by open_file
+			start = bench_now();
+			for (long i = 0; i < 2 * n; i++) {
+				found += id_index_contains(&index, bench_scattered_id(i));
+			}
+			double contains_time = bench_now() - start;
+
+			printf("%-8s %-10ld %-12.4f %-16.0f %-16.0f %-16.0f (found %ld)\n",
+				mode_names[mode], n, insert_time,
+				hit_time > 0 ? n / hit_time : 0.0,
+				miss_time > 0 ? n / miss_time : 0.0,
+				contains_time > 0 ? 2 * n / contains_time : 0.0,
+				found);
+			id_index_free(&index);
+		}
+	}
+	return 0;
+}
+
+/*
+* Write n generated records as a CMS text file
+*/
+static int bench_write_text_file(const char* filename, long n)
+{
+	FILE* file = fopen(filename, "w");
+	if (file == NULL) {
+		printf("Cannot create \"%s\"\n", filename);
+		return 0;
+	}
+
+	StudentRecord record;
+	bench_seed = 12345u;
+	fprintf(file, "ID\tName\tProgramme\tMark\n");
+	for (long i = 0; i < n; i++) {
+		bench_make_record(&record, (int)i);
+		fprintf(file, "%d\t%s\t%s\t%.1f\n", record.id, record.name, record.programme, record.mark);
+	}
+	fclose(file);
+	return 1;
+}
+
+/*
+* Previous open_file loop: fgets into a fixed buffer and sscanf_s per line
+*/
+static int bench_load_stdio(CMSdb* db, const char* filename)
+{
+	FILE* file = fopen(filename, "r");
+	if (file == NULL) {
+		return 0;
+	}
+
+	char line[MAX_LINE_LENGTH];
+	int lines = 0;
+	db_clear_records(db);
+	while (fgets(line, sizeof(line), file) != NULL) {
+		lines++;
+		line[strcspn(line, "\n")] = 0;
+		if (strlen(line) == 0 || is_header_line(line)) {
+			continue;
+		}
+
+		StudentRecord record;
+		int parsed = sscanf_s(line, "%d %49[^\t] %49[^\t] %f",
+			&record.id,
+			record.name, (rsize_t)sizeof(record.name),
+			record.programme, (rsize_t)sizeof(record.programme),
+			&record.mark);
+		if (parsed == 4 && valid_student_record(&record)) {
+			db_append_record(db, &record); //skips duplicates
+		}
+	}
+	fclose(file);
+	return lines;
+}
+
+/*
+* Loader: memory mapped hand tokenizer vs the old fgets/sscanf_s loop
+*/
+static int bench_load(long max_records)
+{
+	const char* filename = "cms_bench_load.txt";
+	CMSdb db;
+	initialize_db(&db);
+
+	printf("%-10s %-14s %-16s %-14s %-16s %-8s\n", "Lines", "stdio (s)", "stdio (lines/s)", "mmap (s)", "mmap (lines/s)", "Speedup");
+	for (long n = 10000; n <= max_records; n *= 10) {
+		if (!bench_write_text_file(filename, n)) {
+			free_db(&db);
+			return 1;
+		}
+
+		double start = bench_now();
+		int lines = bench_load_stdio(&db, filename);
+		double stdio_time = bench_now() - start;
+		int stdio_count = db.record_count;
+
+		start = bench_now();
+		MappedFile map;
+		LoadStats stats;
+		if (!map_file(filename, &map)) {
+			printf("Cannot map \"%s\"\n", filename);
+			break;
+		}
+		db_clear_records(&db);
+		load_records(&db, map.data, map.size, &stats);
+		unmap_file(&map);
+		double mmap_time = bench_now() - start;
+
+		printf("%-10d %-14.4f %-16.0f %-14.4f %-16.0f %-8.1f (records %d/%d)\n",
+			lines, stdio_time, stdio_time > 0 ? lines / stdio_time : 0.0,
+			mmap_time, mmap_time > 0 ? lines / mmap_time : 0.0,
+			mmap_time > 0 ? stdio_time / mmap_time : 0.0,
+			stdio_count, db.record_count);
+	}
+
+	remove(filename);
+	free_db(&db);
+	return 0;
+}
+
+/*
+* Parallel loading of a max_records line file with 1, 2, 4 ... threads up to PARALLEL_BENCH_MAX_THREADS
+*/
+static int bench_parallel_load(long max_records)
+{
+	const char* filename = "cms_bench_pload.txt";
+	CMSdb db;
+	MappedFile map;
+	LoadStats stats;
+	double single_time = 0;
+
+	initialize_db(&db);
+	if (!bench_write_text_file(filename, max_records) || !map_file(filename, &map)) {
+		printf("Cannot create \"%s\"\n", filename);
+		free_db(&db);
+		return 1;
+	}
+
+	printf("%ld lines, %d CPUs\n", max_records, cpu_count());
+	printf("%-8s %-12s %-16s %-8s\n", "Threads", "Time (s)", "Lines/s", "Speedup");
+	for (int threads = 1; threads <= PARALLEL_BENCH_MAX_THREADS; threads *= 2) {
+		db_clear_records(&db);
+		double start = bench_now();
+		load_records_parallel(&db, map.data, map.size, threads, &stats);
+		double elapsed = bench_now() - start;
+		if (threads == 1) {
+			single_time = elapsed;
+		}
+		printf("%-8d %-12.4f %-16.0f %-8.2f (records %d)\n", threads, elapsed,
+			elapsed > 0 ? stats.line_number / elapsed : 0.0,
+			elapsed > 0 ? single_time / elapsed : 0.0, db.record_count);
+	}
+
+	unmap_file(&map);
+	remove(filename);
+	free_db(&db);
+	return 0;
+}
+
+/*
+* Time to load a file through open_file's loaders, the file format is picked by its magic bytes
+* returns the time in seconds or a negative value if the file cannot be mapped
+*/
+static double bench_time_load(CMSdb* db, const char* filename)
+{
+	MappedFile map;
+	LoadStats stats;
+	double start = bench_now();
+
+	if (!map_file(filename, &map)) {
+		return -1;
+	}
+	db_clear_records(db);
+	if (is_binary_cms(map.data, map.size)) {
+		load_binary_records(db, map.data, map.size, &stats);
+	}
+	else {
+		load_records(db, map.data, map.size, &stats);
+	}
+	unmap_file(&map);
+	return bench_now() - start;
+}
+
+/*
+* Text vs binary file format: save and load time for the same records
+*/
+static int bench_binary(long max_records)
+{
+	const char* text_filename = "cms_bench_format.txt";
+	const char* binary_filename = "cms_bench_format" CMS_BINARY_EXTENSION;
+	CMSdb db;
+	initialize_db(&db);
+
+	printf("%-10s %-14s %-14s %-14s %-14s %-8s\n", "Records", "Text save", "Binary save", "Text load", "Binary load", "Load x");
+	for (long n = 10000; n <= max_records; n *= 10) {
+		bench_fill(&db, n);
+
+		double start = bench_now();
+		int saved = save_text_records(&db, text_filename);
+		double text_save = bench_now() - start;
+		start = bench_now();
+		saved = save_binary_records(&db, binary_filename) && saved;
+		double binary_save = bench_now() - start;
+		if (!saved) {
+			printf("Cannot write the benchmark files\n");
+			break;
+		}
+
+		//the text file has no header line, so both loads see exactly n records
+		double text_load = bench_time_load(&db, text_filename);
+		int text_count = db.record_count;
+		double binary_load = bench_time_load(&db, binary_filename);
+
+		printf("%-10ld %-14.4f %-14.4f %-14.4f %-14.4f %-8.1f (records %d/%d)\n", n,
+			text_save, binary_save, text_load, binary_load,
+			binary_load > 0 ? text_load / binary_load : 0.0, text_count, db.record_count);
+	}
+
+	remove(text_filename);
+	remove(binary_filename);
+	free_db(&db);
+	return 0;
+}
+
+/*
+* Delimiter scanning over a generated file of size_mb megabytes
+* the old way (fgets, strcspn and a byte loop per line) against each scan_delimiters implementation
+*/
+static int bench_delimiters(long size_mb)
+{
+	static const char* scanner_names[] = { "scalar", "sse2", "avx2" };
+	const char* filename = "cms_bench_delim.txt";
+	const size_t block_size = 1 << 20;
+
+	//generate the file
+	FILE* file = fopen(filename, "w");
+	if (file == NULL) {
+		printf("Cannot create \"%s\"\n", filename);
+		return 1;
+	}
+	StudentRecord record;
+	long long written = 0;
+	bench_seed = 12345u;
+	for (int i = 0; written < (long long)size_mb << 20; i++) {
+		bench_make_record(&record, i % 9000000);
+		written += fprintf(file, "%d\t%s\t%s\t%.1f\n", record.id, record.name, record.programme, record.mark);
+	}
+	fclose(file);
+	printf("File: %lld bytes\n\n", written);
+	printf("%-22s %-12s %-12s %-14s\n", "Method", "Time (s)", "MB/s", "Delimiters");
+
+	//old path
+	double start = bench_now();
+	long long delimiters = 0;
+	char line[MAX_LINE_LENGTH];
+	file = fopen(filename, "r");
+	if (file == NULL) {
+		return 1;
+	}
+	while (fgets(line, sizeof(line), file) != NULL) {
+		size_t length = strcspn(line, "\n");
+		if (line[length] == '\n') delimiters++;
+		for (size_t i = 0; i < length; i++) {
+			if (line[i] == '\t') delimiters++;
+		}
+	}
+	fclose(file);
+	double elapsed = bench_now() - start;
+	printf("%-22s %-12.3f %-12.0f %-14lld\n", "fgets+strcspn+loop", elapsed, elapsed > 0 ? written / elapsed / 1048576.0 : 0.0, delimiters);
+
+	MappedFile map;
+	if (!map_file(filename, &map)) {
+		printf("Cannot map \"%s\"\n", filename);
+		remove(filename);
+		return 1;
+	}
+	unsigned int* offsets = (unsigned int*)malloc(block_size * sizeof(unsigned int));
+	if (offsets == NULL) {
+		unmap_file(&map);
+		remove(filename);
+		return 1;
+	}
+
+	for (int scanner = DELIM_SCANNER_SCALAR; scanner <= DELIM_SCANNER_AVX2; scanner++) {
+		if (!delimiter_scanner_available(scanner)) {
+			printf("%-22s not supported on this CPU\n", scanner_names[scanner]);
+			continue;
+		}
+		start = bench_now();
+		delimiters = 0;
+		for (size_t position = 0; position < map.size; position += block_size) {
+			size_t length = (map.size - position < block_size) ? map.size - position : block_size;
+			delimiters += (long long)scan_delimiters_with(scanner, map.data + position, length, offsets);
+		}
+		elapsed = bench_now() - start;
+		printf("%-22s %-12.3f %-12.0f %-14lld\n", scanner_names[scanner], elapsed, elapsed > 0 ? map.size / elapsed / 1048576.0 : 0.0, delimiters);
+	}
+
+	free(offsets);
+	unmap_file(&map);
+	remove(filename);
+	return 0;
+}
+
+/*
+* The query loop before the folded columns: copy every record's string and lowercase it, then strstr
+* returns the number of matches
+*/
+static int bench_query_copy_fold(const CMSdb* db, int field, const char* text)
+{
+	char search_lower[MAX_NAME_LENGTH];
+	int found = 0;
+
+	strcpy_s(search_lower, sizeof(search_lower), text);
+	for (int i = 0; search_lower[i]; i++) {
+		search_lower[i] = tolower(search_lower[i]);
+	}
+	for (int i = 0; i < db->record_count; i++) {
+		const StoredRecord* record = db_record(db, i);
+		char current_lower[MAX_NAME_LENGTH];
+		strcpy_s(current_lower, sizeof(current_lower), (field == SEARCH_FIELD_NAME) ? record->name : db_programme(db, i));
+		for (int j = 0; current_lower[j]; j++) {
+			current_lower[j] = tolower(current_lower[j]);
+		}
+		if (strstr(current_lower, search_lower) != NULL) {
+			found++;
+		}
+	}
+	return found;
+}
+
+/*
+* Name and programme query latency: per-query copy and tolower vs scanning the folded columns
+*/
+static int bench_query(long max_records)
+{
+	static const struct { int field; const char* text; } queries[] = {
+		{ SEARCH_FIELD_NAME, "Tan" }, { SEARCH_FIELD_NAME, "wei liang" }, { SEARCH_FIELD_NAME, "xyz" },
+		{ SEARCH_FIELD_PROGRAMME, "Science" }, { SEARCH_FIELD_PROGRAMME, "game design" },
+	};
+	int query_count = (int)(sizeof(queries) / sizeof(queries[0]));
+	int* matches = NULL;
+	int capacity = 0;
+	CMSdb db;
+	initialize_db(&db);
+
+	printf("%-10s %-18s %-14s %-14s %-8s %-10s\n", "Records", "Query", "Old (ms)", "Folded (ms)", "Speedup", "Matches");
+	for (long n = 1000; n <= max_records; n *= 10) {
+		bench_fill(&db, n);
+		//small databases are queried repeatedly so the times are measurable
+		int repeats = (n < 1000000) ? (int)(1000000 / n) : 1;
+
+		for (int q = 0; q < query_count; q++) {
+			int old_found = 0;
+			int found = 0;
+
+			double start = bench_now();
+			for (int r = 0; r < repeats; r++) {
+				old_found = bench_query_copy_fold(&db, queries[q].field, queries[q].text);
+			}
+			double old_time = (bench_now() - start) / repeats;
+
+			start = bench_now();
+			for (int r = 0; r < repeats; r++) {
+				found = search_records_scan(&db, queries[q].field, queries[q].text, &matches, &capacity);
+			}
+			double folded_time = (bench_now() - start) / repeats;
+
+			printf("%-10ld %-18s %-14.3f %-14.3f %-8.1f %d%s\n", n, queries[q].text,
+				old_time * 1000, folded_time * 1000,
+				folded_time > 0 ? old_time / folded_time : 0.0,
+				found, (found == old_found) ? "" : " (MISMATCH)");
+		}
+	}
+
+	free(matches);
+	free_db(&db);
+	return 0;
+}
+
+/*
+* Memory held by one trigram table and its posting lists
+*/
+static size_t bench_trigram_bytes(const TrigramIndex* index)
+{
+	size_t bytes = (size_t)index->capacity * (sizeof(unsigned int) + sizeof(PostingList));
+	for (int i = 0; i < index->capacity; i++) {
+		if (index->keys[i] != 0) {
+			bytes += (size_t)index->lists[i].capacity * sizeof(int);
+		}
+	}
+	return bytes;
+}
+
+/*
+* Trigram index: build time, memory, and query latency against the folded column scan
+* one record in 100000 gets a rare name so selective queries have something to find
+*/
+static int bench_trigram(long max_records)
+{
+	static const struct { int field; const char* text; } queries[] = {
+		{ SEARCH_FIELD_NAME, "okafor" }, { SEARCH_FIELD_NAME, "chen" }, { SEARCH_FIELD_NAME, "qianhui goh" },
+		{ SEARCH_FIELD_NAME, "xyz" }, { SEARCH_FIELD_PROGRAMME, "science" },
+	};
+	int query_count = (int)(sizeof(queries) / sizeof(queries[0]));
+	int* matches = NULL;
+	int capacity = 0;
+	CMSdb db;
+	initialize_db(&db);
+
+	static const long sizes[] = { 10000, 100000, 1000000, 5000000, 10000000 };
+	for (int size = 0; size < (int)(sizeof(sizes) / sizeof(sizes[0])) && sizes[size] <= max_records; size++) {
+		long n = sizes[size];
+		StudentRecord record;
+		db_clear_records(&db);
+		bench_seed = 12345u;
+		for (long i = 0; i < n; i++) {
+			bench_make_record(&record, (int)i);
+			if (i % 100000 == 7) {
+				strcpy_s(record.name, sizeof(record.name), "Zephyrine Okafor");
+			}
+			if (db_append_record(&db, &record) != 1) {
+				printf("Out of memory at %ld records\n", i);
+				free(matches);
+				free_db(&db);
+				return 1;
+			}
+		}
+
+		double start = bench_now();
+		if (!search_index_build(&db)) {
+			printf("Out of memory building the index at %ld records\n", n);
+			break;
+		}
+		double build_time = bench_now() - start;
+		size_t index_bytes = bench_trigram_bytes(&db.search.name);
+		search_records(&db, SEARCH_FIELD_NAME, "okafor", &matches, &capacity); //fills the position map
+
+		//keeping the index current: rename records back and forth
+		int updates = 1000;
+		start = bench_now();
+		for (int i = 0; i < updates; i++) {
+			int slot = db.order[(i * 7919L) % n];
+			db_get_record(&db, slot, &record);
+			record.name[0] = (record.name[0] == 'Q') ? 'J' : 'Q';
+			db_update_record(&db, slot, &record);
+		}
+		double update_time = (bench_now() - start) / updates;
+
+		printf("\n%ld records: index built in %.3f s, %.1f MB, %.1f us per update\n",
+			n, build_time, index_bytes / 1048576.0, update_time * 1e6);
+		printf("%-14s %-14s %-14s %-10s %-10s\n", "Query", "Scan (ms)", "Trigram (ms)", "Speedup", "Matches");
+		for (int q = 0; q < query_count; q++) {
+			int repeats = 20;
+			int scan_found = 0;
+			int found = 0;
+
+			start = bench_now();
+			for (int r = 0; r < repeats; r++) {
+				scan_found = search_records_scan(&db, queries[q].field, queries[q].text, &matches, &capacity);
+			}
+			double scan_time = (bench_now() - start) / repeats;
+
+			start = bench_now();
+			for (int r = 0; r < repeats; r++) {
+				found = search_records(&db, queries[q].field, queries[q].text, &matches, &capacity);
+			}
+			double trigram_time = (bench_now() - start) / repeats;
+
+			printf("%-14s %-14.3f %-14.4f %-10.1f %d%s\n", queries[q].text, scan_time * 1000, trigram_time * 1000,
+				trigram_time > 0 ? scan_time / trigram_time : 0.0,
+				found, (found == scan_found) ? "" : " (MISMATCH)");
+		}
+	}
+
+	free(matches);
+	free_db(&db);
+	return 0;
+}
+
+/*
+* Programme dictionary: memory per record and programme scans, full strings per record vs 16 bit codes
+* "before" is rebuilt from the same records: a StudentRecord array plus a folded programme column
+*/
+static int bench_dictionary(long max_records)
+{
+	const char* target = "Computer Science";
+	CMSdb db;
+	initialize_db(&db);
+
+	//arena bytes per slot: the record plus its side columns
+	size_t before_bytes = sizeof(StudentRecord) + MAX_NAME_LENGTH + MAX_PROGRAMME_LENGTH;
+	size_t after_bytes = sizeof(StoredRecord) + sizeof(unsigned short) + MAX_NAME_LENGTH;
+	printf("Bytes per record: %zu before (StudentRecord %zu + folded name + folded programme), %zu after (StoredRecord %zu + code + folded name)\n\n",
+		before_bytes, sizeof(StudentRecord), after_bytes, sizeof(StoredRecord));
+
+	printf("%-10s %-12s %-12s %-16s %-16s %-16s %-16s %-10s\n", "Records", "Before (MB)", "After (MB)",
+		"strcmp (Mrec/s)", "Code (Mrec/s)", "Fold scan (ms)", "Dictionary (ms)", "Matches");
+	for (long n = 10000; n <= max_records; n *= 10) {
+		StudentRecord record;
+		db_clear_records(&db);
+		bench_seed = 12345u;
+		StudentRecord* plain = (StudentRecord*)malloc((size_t)n * sizeof(StudentRecord));
+		char* folded = (char*)malloc((size_t)n * MAX_PROGRAMME_LENGTH);
+		if (plain == NULL || folded == NULL) {
+			free(plain);
+			free(folded);
+			printf("Out of memory at %ld records\n", n);
+			break;
+		}
+		for (long i = 0; i < n; i++) {
+			bench_make_record(&record, (int)i);
+			db_append_record(&db, &record);
+			plain[i] = record;
+			fold_text(folded + (size_t)i * MAX_PROGRAMME_LENGTH, record.programme, MAX_PROGRAMME_LENGTH);
+		}
+		int repeats = (n < 1000000) ? (int)(1000000 / n) : 1;
+
+		//exact programme filter
+		long old_found = 0;
+		double start = bench_now();
+		for (int r = 0; r < repeats; r++) {
+			for (long i = 0; i < n; i++) {
+				old_found += strcmp(plain[i].programme, target) == 0;
+			}
+		}
+		double strcmp_time = (bench_now() - start) / repeats;
+
+		long found = 0;
+		int code = programme_find(&db.programmes, target);
+		start = bench_now();
+		for (int r = 0; r < repeats; r++) {
+			for (int chunk = 0; chunk < db.arena.chunk_count; chunk++) {
+				const unsigned short* codes = db.arena.programme_codes[chunk];
+				int slots = db.arena.slot_count - chunk * RECORD_CHUNK_SIZE;
+				if (slots > RECORD_CHUNK_SIZE) slots = RECORD_CHUNK_SIZE;
+				for (int i = 0; i < slots; i++) {
+					found += codes[i] == code;
+				}
+			}
+		}
+		double code_time = (bench_now() - start) / repeats;
+
+		//case-insensitive substring query, as query_by_programme does
+		long fold_found = 0;
+		start = bench_now();
+		for (int r = 0; r < repeats; r++) {
+			fold_found = 0;
+			for (long i = 0; i < n; i++) {
+				fold_found += strstr(folded + (size_t)i * MAX_PROGRAMME_LENGTH, "science") != NULL;
+			}
+		}
+		double fold_time = (bench_now() - start) / repeats;
+
+		int* matches = NULL;
+		int capacity = 0;
+		int query_found = 0;
+		start = bench_now();
+		for (int r = 0; r < repeats; r++) {
+			query_found = search_records_scan(&db, SEARCH_FIELD_PROGRAMME, "science", &matches, &capacity);
+		}
+		double dictionary_time = (bench_now() - start) / repeats;
+		free(matches);
+
+		printf("%-10ld %-12.1f %-12.1f %-16.1f %-16.1f %-16.3f %-16.3f %d%s\n", n,
+			n * (double)before_bytes / 1048576.0, n * (double)after_bytes / 1048576.0,
+			strcmp_time > 0 ? n / strcmp_time / 1e6 : 0.0, code_time > 0 ? n / code_time / 1e6 : 0.0,
+			fold_time * 1000, dictionary_time * 1000, query_found,
+			(found == old_found && query_found == fold_found) ? "" : " (MISMATCH)");
+		free(plain);
+		free(folded);
+	}
+	printf("\nDistinct programmes: %d\n", db.programmes.count);
+	free_db(&db);
+	return 0;
+}
+
+/*
+* Mark queries: exact mark and a 50.0-59.9 range, float compare of every record vs the tenths buckets
+* "before" is a plain float column, the way marks were stored before
+*/
+static int bench_marks(long max_records)
+{
+	CMSdb db;
+	initialize_db(&db);
+
+	printf("%-10s %-12s %-14s %-14s %-14s %-14s %-10s %-10s\n", "Records", "Build (ms)", "Exact scan", "Exact index",
+		"Range scan", "Range index", "Exact", "Range");
+	printf("%-10s %-12s %-14s %-14s %-14s %-14s\n", "", "", "(ms)", "(ms)", "(ms)", "(ms)");
+	for (long n = 10000; n <= max_records; n *= 10) {
+		StudentRecord record;
+		db_clear_records(&db);
+		bench_seed = 12345u;
+		float* marks = (float*)malloc((size_t)n * sizeof(float));
+		if (marks == NULL) {
+			printf("Out of memory at %ld records\n", n);
+			break;
+		}
+		for (long i = 0; i < n; i++) {
+			bench_make_record(&record, (int)i);
+			db_append_record(&db, &record);
+			marks[i] = record.mark;
+		}
+		int repeats = (n < 1000000) ? (int)(1000000 / n) : 1;
+		int* matches = NULL;
+		int capacity = 0;
+
+		double start = bench_now();
+		mark_index_build(&db);
+		search_positions(&db); //display positions, built once by the first query
+		double build_time = bench_now() - start;
+
+		//exact mark 75.0
+		long old_exact = 0;
+		start = bench_now();
+		for (int r = 0; r < repeats; r++) {
+			old_exact = 0;
+			for (long i = 0; i < n; i++) {
+				if (marks[i] == 75.0f) {
+					if (!grow_int_array(&matches, &capacity, (int)old_exact + 1)) break;
+					matches[old_exact++] = (int)i;
+				}
+			}
+		}
+		double exact_scan = (bench_now() - start) / repeats;
+
+		int exact = 0;
+		start = bench_now();
+		for (int r = 0; r < repeats; r++) {
+			exact = mark_range_query(&db, 750, 750, &matches, &capacity);
+		}
+		double exact_index = (bench_now() - start) / repeats;
+
+		//range 50.0-59.9
+		long old_range = 0;
+		start = bench_now();
+		for (int r = 0; r < repeats; r++) {
+			old_range = 0;
+			for (long i = 0; i < n; i++) {
+				if (marks[i] >= 50.0f && marks[i] < 59.95f) {
+					if (!grow_int_array(&matches, &capacity, (int)old_range + 1)) break;
+					matches[old_range++] = (int)i;
+				}
+			}
+		}
+		double range_scan = (bench_now() - start) / repeats;
+
+		int range = 0;
+		start = bench_now();
+		for (int r = 0; r < repeats; r++) {
+			range = mark_range_query(&db, 500, 599, &matches, &capacity);
+		}
+		double range_index = (bench_now() - start) / repeats;
+		free(matches);
+
+		printf("%-10ld %-12.3f %-14.3f %-14.3f %-14.3f %-14.3f %-10d %d%s\n", n, build_time * 1000,
+			exact_scan * 1000, exact_index * 1000, range_scan * 1000, range_index * 1000, exact, range,
+			(exact == old_exact && range == old_range) ? "" : " (MISMATCH)");
+		free(marks);
+	}
+	free_db(&db);
+	return 0;
+}
+
+/*
+* Sort: qsort with comparators vs the radix/counting sort, for ID and mark, both directions
+* every run starts from the same shuffled order
+*/
+static int bench_sort(long max_records)
+{
+	static const char* names[] = { "ID asc", "ID desc", "Mark asc", "Mark desc" };
+	CMSdb db;
+	initialize_db(&db);
+
+	printf("%-10s %-10s %-12s %-12s %-8s\n", "Records", "Key", "qsort (ms)", "Radix (ms)", "Speedup");
+	for (long n = 100000; n <= max_records; n *= 10) {
+		bench_fill(&db, n);
+		int* shuffled = (int*)malloc((size_t)n * sizeof(int));
+		if (shuffled == NULL) {
+			printf("Out of memory at %ld records\n", n);
+			break;
+		}
+		for (long i = n - 1; i > 0; i--) {
+			long j = (long)(((unsigned long long)bench_rand() << 24 | bench_rand()) % (unsigned long long)(i + 1));
+			int swap = db.order[i];
+			db.order[i] = db.order[j];
+			db.order[j] = swap;
+		}
+		memcpy(shuffled, db.order, (size_t)n * sizeof(int));
+
+		for (int run = 0; run < 4; run++) {
+			int key = (run < 2) ? SORT_KEY_ID : SORT_KEY_MARK;
+			int descending = run & 1;
+
+			memcpy(db.order, shuffled, (size_t)n * sizeof(int));
+			double start = bench_now();
+			sort_slots_qsort(&db.arena, db.order, db.record_count, key, descending);
+			double qsort_time = bench_now() - start;
+
+			memcpy(db.order, shuffled, (size_t)n * sizeof(int));
+			start = bench_now();
+			int sorted = sort_slots_radix(&db.arena, db.order, db.record_count, key, descending, 1);
+			double radix_time = bench_now() - start;
+
+			//check the order: no key is on the wrong side of the one before it
+			for (long i = 1; i < n && sorted; i++) {
+				const StoredRecord* previous = db_record(&db, (int)i - 1);
+				const StoredRecord* current = db_record(&db, (int)i);
+				int a = (key == SORT_KEY_ID) ? previous->id : previous->mark_tenths;
+				int b = (key == SORT_KEY_ID) ? current->id : current->mark_tenths;
+				sorted = descending ? a >= b : a <= b;
+			}
+			printf("%-10ld %-10s %-12.1f %-12.1f %-8.1f%s\n", n, names[run], qsort_time * 1000, radix_time * 1000,
+				radix_time > 0 ? qsort_time / radix_time : 0.0, sorted ? "" : " (NOT SORTED)");
+		}
+		free(shuffled);
+	}
+	free_db(&db);
+	return 0;
+}
+
+/*
+* Sort views: first sort (builds the view), switching back to a cached view, and what keeping
+* every view up to date adds to inserts and deletes
+*/
+static int bench_views(long max_records)
+{
+	static const char* names[] = { "Insertion", "ID asc", "ID desc", "Mark asc", "Mark desc" };
+	const int changes = 1000;
+	CMSdb db;
+	initialize_db(&db);
+
+	printf("%-10s %-10s %-12s %-12s\n", "Records", "View", "Build (ms)", "Switch (ms)");
+	for (long n = 100000; n <= max_records; n *= 10) {
+		StudentRecord record;
+		db_clear_records(&db);
+		bench_seed = 12345u;
+		for (long i = 0; i < n; i++) {
+			bench_make_record(&record, (int)(bench_rand() % 8000000)); //IDs out of order
+			db_append_record(&db, &record);
+		}
+
+		//inserts and deletes with only insertion order kept
+		double start = bench_now();
+		for (int i = 0; i < changes; i++) {
+			bench_make_record(&record, 8000000 + i);
+			db_insert_record_at(&db, db.record_count / 2, &record);
+		}
+		for (int i = 0; i < changes; i++) {
+			db_remove_record_at(&db, db_index_of_slot(&db, db_find_slot(&db, MIN_VALID_ID + 8000000 + i)));
+		}
+		double plain_time = bench_now() - start;
+
+		for (int view = SORT_VIEW_COUNT - 1; view > SORT_VIEW_INSERTION; view--) { //insertion order is shown from the start
+			start = bench_now();
+			sort_view_show(&db, view);
+			double build_time = bench_now() - start;
+			printf("%-10ld %-10s %-12.3f", n, names[view], build_time * 1000);
+			sort_view_show(&db, (view + 1) % SORT_VIEW_COUNT);
+			start = bench_now();
+			sort_view_show(&db, view);
+			printf(" %-12.6f\n", (bench_now() - start) * 1000);
+		}
+
+		//the same changes with all five views kept up to date
+		sort_view_show(&db, SORT_VIEW_MARK_ASC);
+		start = bench_now();
+		for (int i = 0; i < changes; i++) {
+			bench_make_record(&record, 8000000 + i);
+			db_insert_record_at(&db, db.record_count / 2, &record);
+		}
+		for (int i = 0; i < changes; i++) {
+			db_remove_record_at(&db, db_index_of_slot(&db, db_find_slot(&db, MIN_VALID_ID + 8000000 + i)));
+		}
+		double views_time = bench_now() - start;
+		printf("%-10ld %d inserts + deletes: %.1f ms in insertion order only, %.1f ms with all views (%.1f us per change)\n\n",
+			n, changes, plain_time * 1000, views_time * 1000, views_time * 1e6 / (2.0 * changes));
+	}
+	free_db(&db);
+	return 0;
+}
+
+/*
+* Multi-key sort "programme asc, mark desc, name asc": qsort with a comparator that folds and compares
+* the strings on every call vs the precomputed sort keys
+*/
+static const CMSdb* bench_sort_db;
+
+static int bench_compare_folding(const void* a, const void* b)
+{
+	int slotA = *(const int*)a, slotB = *(const int*)b;
+	const StoredRecord* recordA = arena_record(&bench_sort_db->arena, slotA);
+	const StoredRecord* recordB = arena_record(&bench_sort_db->arena, slotB);
+	char textA[MAX_NAME_LENGTH], textB[MAX_NAME_LENGTH];
+
+	fold_text(textA, slot_programme(bench_sort_db, slotA), sizeof(textA));
+	fold_text(textB, slot_programme(bench_sort_db, slotB), sizeof(textB));
+	int result = strcmp(textA, textB);
+	if (result != 0) return result;
+	if (recordA->mark_tenths != recordB->mark_tenths) return recordB->mark_tenths - recordA->mark_tenths;
+	fold_text(textA, recordA->name, sizeof(textA));
+	fold_text(textB, recordB->name, sizeof(textB));
+	return strcmp(textA, textB);
+}
+
+static int bench_multisort(long max_records)
+{
+	SortSpec spec;
+	CMSdb db;
+	initialize_db(&db);
+	sort_spec_parse("programme asc, mark desc, name asc", &spec);
+
+	printf("%-10s %-14s %-14s %-8s\n", "Records", "qsort (ms)", "Keys (ms)", "Speedup");
+	for (long n = 100000; n <= max_records; n *= 10) {
+		bench_fill(&db, n);
+		int* slots = (int*)malloc((size_t)n * sizeof(int));
+		if (slots == NULL) {
+			printf("Out of memory at %ld records\n", n);
+			break;
+		}
+
+		memcpy(slots, db.order, (size_t)n * sizeof(int));
+		bench_sort_db = &db;
+		double start = bench_now();
+		qsort(slots, (size_t)n, sizeof(int), bench_compare_folding);
+		double qsort_time = bench_now() - start;
+
+		memcpy(slots, db.order, (size_t)n * sizeof(int));
+		start = bench_now();
+		sort_slots_by_spec(&db, &spec, slots, (int)n, 1);
+		double key_time = bench_now() - start;
+
+		//same order apart from ties, which qsort leaves in any order
+		int same = 1;
+		for (long i = 1; i < n && same; i++) {
+			same = bench_compare_folding(&slots[i - 1], &slots[i]) <= 0;
+		}
+		printf("%-10ld %-14.1f %-14.1f %-8.1f%s\n", n, qsort_time * 1000, key_time * 1000,
+			key_time > 0 ? qsort_time / key_time : 0.0, same ? "" : " (NOT SORTED)");
+		free(slots);
+	}
+	free_db(&db);
+	return 0;
+}
+
+/*
+* Parallel sort scaling: ID and mark radix sorts and the multi-key merge sort on 1 to 16 threads,
+* every result is compared with the one thread result
+*/
+static int bench_parallel_sort(long max_records)
+{
+	static const int thread_counts[] = { 1, 2, 4, 8, 16 };
+	SortSpec spec;
+	CMSdb db;
+	StudentRecord record;
+	initialize_db(&db);
+	sort_spec_parse("programme asc, mark desc, name asc", &spec);
+
+	bench_seed = 12345u;
+	for (long i = 0; i < max_records; i++) {
+		bench_make_record(&record, (int)(bench_rand() % 8000000)); //IDs out of order
+		db_append_record(&db, &record);
+	}
+	int n = db.record_count;
+	int* slots = (int*)malloc((size_t)n * sizeof(int));
+	int* expected = (int*)malloc((size_t)n * 3 * sizeof(int));
+	if (slots == NULL || expected == NULL) {
+		free(slots);
+		free(expected);
+		free_db(&db);
+		printf("Out of memory at %d records\n", n);
+		return 1;
+	}
+	printf("%d records, %d CPUs\n", n, cpu_count());
+	printf("%-8s %-14s %-14s %-14s\n", "Threads", "ID (ms)", "Mark (ms)", "Multi-key (ms)");
+
+	for (int t = 0; t < (int)(sizeof(thread_counts) / sizeof(thread_counts[0])); t++) {
+		int threads = thread_counts[t];
+		double times[3];
+		int same = 1;
+		for (int sort = 0; sort < 3; sort++) {
+			memcpy(slots, db.order, (size_t)n * sizeof(int));
+			double start = bench_now();
+			if (sort < 2) {
+				sort_slots_radix(&db.arena, slots, n, (sort == 0) ? SORT_KEY_ID : SORT_KEY_MARK, 0, threads);
+			}
+			else {
+				sort_slots_by_spec(&db, &spec, slots, n, threads);
+			}
+			times[sort] = bench_now() - start;
+			if (threads == 1) {
+				memcpy(expected + (size_t)sort * n, slots, (size_t)n * sizeof(int));
+			}
+			else {
+				same = same && memcmp(expected + (size_t)sort * n, slots, (size_t)n * sizeof(int)) == 0;
+			}
+		}
+		printf("%-8d %-14.1f %-14.1f %-14.1f%s\n", threads, times[0] * 1000, times[1] * 1000, times[2] * 1000,
+			same ? "" : " (DIFFERENT ORDER)");
+	}
+	free(slots);
+	free(expected);
+	free_db(&db);
+	return 0;
+}
+
+/*
+* Top 10 and median mark: sorting every record by mark vs the mark histogram
+*/
+static int bench_topk(long max_records)
+{
+	CMSdb db;
+	initialize_db(&db);
+
+	printf("%-10s %-14s %-14s %-14s %-14s\n", "Records", "Sort (ms)", "Top 10 (ms)", "Median (ms)", "Same result");
+	for (long n = 10000; n <= max_records; n *= 10) {
+		bench_fill(&db, n);
+		int* sorted = (int*)malloc((size_t)n * sizeof(int));
+		if (sorted == NULL) {
+			printf("Out of memory at %ld records\n", n);
+			break;
+		}
+		int repeats = (n < 1000000) ? (int)(1000000 / n) : 1;
+		int* top = NULL;
+		int capacity = 0;
+		mark_index_build(&db);
+
+		//what the menu did before: sort everything by mark, read the first 10 and the middle one
+		double start = bench_now();
+		for (int r = 0; r < repeats; r++) {
+			memcpy(sorted, db.order, (size_t)n * sizeof(int));
+			sort_slots_qsort(&db.arena, sorted, (int)n, SORT_KEY_MARK, 1);
+		}
+		double sort_time = (bench_now() - start) / repeats;
+
+		int found = 0;
+		start = bench_now();
+		for (int r = 0; r < repeats * 10; r++) {
+			found = mark_top_k(&db, 10, &top, &capacity);
+		}
+		double top_time = (bench_now() - start) / (repeats * 10);
+
+		int median = 0;
+		start = bench_now();
+		for (int r = 0; r < repeats * 10; r++) {
+			median = mark_percentile(&db, 500);
+		}
+		double median_time = (bench_now() - start) / (repeats * 10);
+
+		//nearest-rank median is the record at position ceil(n / 2) in ascending order
+		int same = found == 10 && memcmp(top, sorted, 10 * sizeof(int)) == 0 &&
+			arena_record(&db.arena, sorted[n - (n + 1) / 2])->mark_tenths == median;
+		printf("%-10ld %-14.3f %-14.4f %-14.4f %-14s\n", n, sort_time * 1000, top_time * 1000, median_time * 1000,
+			same ? "yes" : "NO");
+		free(top);
+		free(sorted);
+	}
+	free_db(&db);
+	return 0;
+}
+
+/*
+* Statistics by programme: scanning every record vs the running totals, and what the totals cost per change
+*/
+static int bench_groups(long max_records)
+{
+	CMSdb db;
+	initialize_db(&db);
+
+	printf("%-10s %-14s %-14s %-16s %-10s %-10s\n", "Records", "Scan (ms)", "Totals (ms)", "Update (us)", "Same", "Extremes");
+	for (long n = 10000; n <= max_records; n *= 10) {
+		StudentRecord record;
+		bench_fill(&db, n);
+		int repeats = (n < 1000000) ? (int)(1000000 / n) : 1;
+		int groups = db.programmes.count;
+		long long* scan_sums = (long long*)calloc((size_t)groups * 2, sizeof(long long));
+		int* codes = (int*)malloc((size_t)groups * sizeof(int));
+		if (scan_sums == NULL || codes == NULL) {
+			free(scan_sums);
+			free(codes);
+			printf("Out of memory at %ld records\n", n);
+			break;
+		}
+
+		//a report without running totals: one pass over every record
+		double start = bench_now();
+		for (int r = 0; r < repeats; r++) {
+			memset(scan_sums, 0, (size_t)groups * 2 * sizeof(long long));
+			for (int i = 0; i < db.record_count; i++) {
+				int code = *arena_programme_code(&db.arena, db.order[i]);
+				scan_sums[code * 2]++;
+				scan_sums[code * 2 + 1] += db_record(&db, i)->mark_tenths;
+			}
+		}
+		double scan_time = (bench_now() - start) / repeats;
+
+		int count = 0;
+		start = bench_now();
+		for (int r = 0; r < repeats * 100; r++) {
+			group_stats_refresh(&db);
+			count = group_stats_codes(&db, codes);
+		}
+		double totals_time = (bench_now() - start) / (repeats * 100);
+
+		int same = count == groups;
+		for (int code = 0; code < groups && same; code++) {
+			same = db.stats.groups[code].count == scan_sums[code * 2] && db.stats.groups[code].sum_tenths == scan_sums[code * 2 + 1];
+		}
+
+		//mark updates: the totals move from the old mark to the new one
+		int updates = 100000;
+		start = bench_now();
+		for (int u = 0; u < updates; u++) {
+			int slot = db.order[bench_rand() % (unsigned int)db.record_count];
+			db_get_record(&db, slot, &record);
+			record.mark = (float)(bench_rand() % 1001) / 10.0f;
+			db_update_record(&db, slot, &record);
+		}
+		double update_time = (bench_now() - start) / updates;
+
+		//delete every record with its programme's lowest or highest mark, the histograms give the new extremes,
+		//which have to match a table recounted from the records
+		unsigned char* marked = (unsigned char*)calloc((size_t)db.arena.slot_count / 8 + 1, 1);
+		ProgrammeStats* kept = (ProgrammeStats*)malloc((size_t)groups * sizeof(ProgrammeStats));
+		int extremes = marked != NULL && kept != NULL;
+		if (extremes) {
+			for (int i = 0; i < db.record_count; i++) {
+				int slot = db.order[i];
+				const ProgrammeStats* group = &db.stats.groups[*arena_programme_code(&db.arena, slot)];
+				int tenths = arena_record(&db.arena, slot)->mark_tenths;
+				if (tenths == group->min_tenths || tenths == group->max_tenths) {
+					marked[slot >> 3] |= (unsigned char)(1u << (slot & 7));
+				}
+			}
+			db_remove_marked(&db, marked);
+			memcpy(kept, db.stats.groups, (size_t)groups * sizeof(ProgrammeStats));
+			db.stats.stale = GROUP_STATS_LOST;
+			extremes = group_stats_refresh(&db);
+			for (int code = 0; code < groups && extremes; code++) {
+				const ProgrammeStats* fresh = &db.stats.groups[code];
+				extremes = kept[code].count == fresh->count && (fresh->count == 0 ||
+					(kept[code].min_tenths == fresh->min_tenths && kept[code].max_tenths == fresh->max_tenths &&
+					kept[code].sum_tenths == fresh->sum_tenths && kept[code].sum_squares == fresh->sum_squares));
+			}
+		}
+
+		printf("%-10ld %-14.3f %-14.5f %-16.3f %-10s %-10s\n", n, scan_time * 1000, totals_time * 1000, update_time * 1000000,
+			same ? "yes" : "NO", extremes ? "yes" : "NO");
+		free(marked);
+		free(kept);
+		free(scan_sums);
+		free(codes);
+	}
+	free_db(&db);
+	return 0;
+}
+
+/*
+* Batch mode: inserts, mark updates and deletes with the indexes updated per change vs once per batch
+* (the mark-descending view is shown and the trigram and mark indexes are built, as after a few queries),
+* a batch takes its deleted records out in one pass at the end as batch_apply does,
+* the per-batch time includes the next name and mark query rebuilding their indexes
+*/
+static int bench_batch(long max_records)
+{
+	static const int batch_sizes[] = { 1000, 10000, 100000 };
+	CMSdb db;
+	initialize_db(&db);
+
+	printf("%-10s %-10s %-16s %-16s %-10s\n", "Records", "Changes", "Per change (ms)", "Per batch (ms)", "Same");
+	for (long n = 100000; n <= max_records; n *= 10) {
+		for (int b = 0; b < (int)(sizeof(batch_sizes) / sizeof(batch_sizes[0])); b++) {
+			int changes = batch_sizes[b];
+			double times[2];
+			int* orders[2] = { NULL, NULL };
+			int* matches = NULL;
+			int capacity = 0;
+			for (int batched = 0; batched < 2; batched++) {
+				StudentRecord record;
+				bench_fill(&db, n);
+				search_records(&db, SEARCH_FIELD_NAME, "chen", &matches, &capacity);
+				mark_range_query(&db, 500, 600, &matches, &capacity);
+				sort_view_show(&db, SORT_VIEW_MARK_DESC);
+
+				unsigned char* deleted = (unsigned char*)calloc((size_t)(db.arena.slot_count + changes) / 8 + 1, 1);
+				if (deleted == NULL) {
+					printf("Out of memory at %ld records\n", n);
+					free(orders[0]);
+					free(matches);
+					free_db(&db);
+					return 1;
+				}
+				double start = bench_now();
+				if (batched) {
+					db_begin_changes(&db, changes);
+				}
+				for (int c = 0; c < changes; c++) {
+					if (c % 4 == 0) {
+						bench_make_record(&record, (int)n + c); //new ID
+						db_append_record(&db, &record);
+						continue;
+					}
+					//an ID deleted earlier is not found any more, the change is skipped as batch mode rejects it
+					int slot = db_find_slot(&db, MIN_VALID_ID + (int)(bench_rand() % (unsigned int)n));
+					if (slot < 0) {
+						continue;
+					}
+					if (c % 4 == 3) {
+						if (batched) {
+							db_mark_removed(&db, deleted, slot);
+						}
+						else {
+							db_remove_record_at(&db, db_index_of_slot(&db, slot));
+						}
+					}
+					else {
+						db_get_record(&db, slot, &record);
+						record.mark = (float)(bench_rand() % 1001) / 10.0f;
+						db_update_record(&db, slot, &record);
+					}
+				}
+				if (batched) {
+					db_remove_marked(&db, deleted);
+					db_end_changes(&db);
+				}
+				search_records(&db, SEARCH_FIELD_NAME, "chen", &matches, &capacity);
+				mark_range_query(&db, 500, 600, &matches, &capacity);
+				times[batched] = bench_now() - start;
+				free(deleted);
+
+				//keep the shown order to compare, as IDs since slot numbers can differ
+				orders[batched] = (int*)malloc((size_t)db.record_count * sizeof(int));
+				for (int i = 0; orders[batched] != NULL && i < db.record_count; i++) {
+					orders[batched][i] = db_record(&db, i)->id;
+				}
+			}
+			int same = orders[0] != NULL && orders[1] != NULL &&
+				memcmp(orders[0], orders[1], (size_t)db.record_count * sizeof(int)) == 0;
+			printf("%-10ld %-10d %-16.1f %-16.1f %-10s\n", n, changes, times[0] * 1000, times[1] * 1000, same ? "yes" : "NO");
+			free(orders[0]);
+			free(orders[1]);
+			free(matches);
+		}
+	}
+	free_db(&db);
+	return 0;
+}
+
+/*
+* Merge: a file of n rows (half the IDs already in the database with new marks, half new) merged into n records
+* with each policy, against the same rows applied one change at a time (every index updated per row)
+* the name and mark indexes are built and the mark-descending view is shown, as after a few queries
+*/
+static void bench_merge_base(CMSdb* db, long n)
+{
+	int* matches = NULL;
+	int capacity = 0;
+
+	bench_fill(db, n);
+	search_records(db, SEARCH_FIELD_NAME, "chen", &matches, &capacity);
+	mark_range_query(db, 500, 600, &matches, &capacity);
+	sort_view_show(db, SORT_VIEW_MARK_DESC);
+	free(matches);
+}
+
+static int bench_merge(long max_records)
+{
+	static const int policies[] = { MERGE_INSERT_ONLY, MERGE_UPSERT, MERGE_REPLACE };
+	const char* filename = "cms_bench_merge.txt";
+	CMSdb db, file;
+	initialize_db(&db);
+	initialize_db(&file);
+
+	printf("%-10s %-14s %-12s %-14s %-10s %-10s %-10s\n", "Records", "Policy", "Time (s)", "Rows/s", "Inserted", "Updated", "Deleted");
+	for (long n = 100000; n <= max_records; n *= 10) {
+		StudentRecord record;
+		db_clear_records(&file);
+		bench_seed = 54321u;
+		for (long i = n / 2; i < n + n / 2; i++) {
+			bench_make_record(&record, (int)i);
+			db_append_record(&file, &record);
+		}
+		if (!save_text_records(&file, filename)) {
+			printf("Cannot write the benchmark file\n");
+			break;
+		}
+
+		for (int p = 0; p < (int)(sizeof(policies) / sizeof(policies[0])); p++) {
+			MergeReport report;
+			bench_merge_base(&db, n);
+			merge_file_path(&db, filename, policies[p], &report);
+			printf("%-10ld %-14s %-12.4f %-14.0f %-10d %-10d %-10d (records %d)\n", n, merge_policy_name(policies[p]),
+				report.seconds, report.seconds > 0 ? report.rows / report.seconds : 0.0,
+				report.inserted, report.updated, report.deleted, db.record_count);
+		}
+
+		//the same upsert one row at a time, as the Insert and Update menu options would do it
+		//(every insert moves the shown view, so this takes minutes beyond 100k records)
+		if (n > 100000) {
+			continue;
+		}
+		bench_merge_base(&db, n);
+		double start = bench_now();
+		for (int i = 0; i < file.record_count; i++) {
+			db_get_record(&file, file.order[i], &record);
+			int slot = db_find_slot(&db, record.id);
+			if (slot < 0) {
+				db_append_record(&db, &record);
+			}
+			else {
+				db_update_record(&db, slot, &record);
+			}
+		}
+		double elapsed = bench_now() - start;
+		printf("%-10ld %-14s %-12.4f %-14.0f (records %d)\n", n, "row by row", elapsed,
+			elapsed > 0 ? file.record_count / elapsed : 0.0, db.record_count);
+	}
+
+	remove(filename);
+	free_db(&file);
+	free_db(&db);
+	return 0;
+}
+
+/*
+* ID lookup: a file of n/10 random IDs (a quarter of them not in the database) looked up one at a time in file order,
+* as repeated Query by ID would, vs lookup_ids_path sorting them first, with both ID index modes
+* both write the records found to a file
+*/
+static int bench_lookup(long max_records)
+{
+	static const char* mode_names[] = { "hash", "direct" };
+	const char* id_filename = "cms_bench_ids.txt";
+	const char* output_filename = "cms_bench_lookup.txt";
+
+	printf("%-8s %-10s %-10s %-16s %-16s %-8s\n", "Mode", "Records", "IDs", "One by one (s)", "Sorted (s)", "Found (IDs/listed)");
+	for (long n = 10000; n <= max_records; n *= 10) {
+		int requested = (int)(n / 10);
+		int* ids = (int*)malloc((size_t)requested * sizeof(int));
+		FILE* file = fopen(id_filename, "w");
+		if (ids == NULL || file == NULL) {
+			printf("Cannot write the benchmark file\n");
+			free(ids);
+			if (file != NULL) fclose(file);
+			break;
+		}
+		bench_seed = 777u;
+		for (int i = 0; i < requested; i++) {
+			ids[i] = MIN_VALID_ID + (int)(bench_rand() % (unsigned int)(n + n / 3)); //IDs past n are missing
+			fprintf(file, "%d\n", ids[i]);
+		}
+		fclose(file);
+
+		for (int mode = ID_INDEX_HASH; mode <= ID_INDEX_DIRECT; mode++) {
+			CMSOptions options;
+			CMSdb db;
+			default_options(&options);
+			options.id_index_mode = mode;
+			initialize_db_with_options(&db, &options);
+			bench_fill(&db, n);
+
+			double start = bench_now();
+			FILE* output = fopen(output_filename, "w");
+			int found = 0;
+			for (int i = 0; output != NULL && i < requested; i++) {
+				int slot = db_find_slot(&db, ids[i]);
+				if (slot >= 0) {
+					const StoredRecord* stored = arena_record(&db.arena, slot);
+					fprintf(output, "%d\t%s\t%s\t%.1f\n", stored->id, stored->name, slot_programme(&db, slot), tenths_to_mark(stored->mark_tenths));
+					found++;
+				}
+				else {
+					fprintf(output, "%d not found\n", ids[i]);
+				}
+			}
+			if (output != NULL) fclose(output);
+			double one_by_one = bench_now() - start;
+
+			LookupReport report;
+			start = bench_now();
+			lookup_ids_path(&db, id_filename, output_filename, &report);
+			double sorted = bench_now() - start;
+
+			printf("%-8s %-10ld %-10d %-16.4f %-16.4f %d/%d\n", mode_names[mode], n, requested, one_by_one, sorted, report.found, found);
+			free_db(&db);
+		}
+		free(ids);
+	}
+
+	remove(id_filename);
+	remove(output_filename);
+	return 0;
+}
+
+/*
+* Table output: Show All Records written to a file with one fprintf per row vs the buffered renderer,
+* with padded columns and with tabs
+*/
+static int bench_render(long max_records)
+{
+	const char* filename = "cms_bench_render.txt";
+	CMSdb db;
+	initialize_db(&db);
+
+	printf("%-10s %-14s %-16s %-16s %-14s\n", "Records", "fprintf (s)", "Buffered (s)", "Tabs (s)", "Rows/s (tabs)");
+	for (long n = 10000; n <= max_records; n *= 10) {
+		bench_fill(&db, n);
+
+		double start = bench_now();
+		FILE* file = fopen(filename, "w");
+		if (file == NULL) {
+			printf("Cannot write the benchmark file\n");
+			break;
+		}
+		fprintf(file, "%-*s %-*s %-*s %s\n", DISPLAY_ID_WIDTH, "ID", DISPLAY_NAME_WIDTH, "Name", DISPLAY_PROGRAMME_WIDTH, "Programme", "Mark");
+		for (int i = 0; i < db.record_count; i++) {
+			const StoredRecord* current = db_record(&db, i);
+			fprintf(file, "%-*d %-*s %-*s %.1f\n",
+				DISPLAY_ID_WIDTH, current->id,
+				DISPLAY_NAME_WIDTH, current->name,
+				DISPLAY_PROGRAMME_WIDTH, db_programme(&db, i),
+				tenths_to_mark(current->mark_tenths));
+		}
+		fclose(file);
+		double printf_time = bench_now() - start;
+
+		double times[2];
+		for (int aligned = 1; aligned >= 0; aligned--) {
+			start = bench_now();
+			int fd = file_create(filename);
+			TableWriter table;
+			table_begin_fd(&table, fd, aligned, 0);
+			for (int i = 0; i < db.record_count; i++) {
+				table_slot(&table, &db, db.order[i]);
+			}
+			table_end(&table);
+			file_close(fd, 0);
+			times[aligned] = bench_now() - start;
+		}
+
+		printf("%-10ld %-14.4f %-16.4f %-16.4f %-14.0f\n", n, printf_time, times[1], times[0],
+			times[0] > 0 ? n / times[0] : 0.0);
+	}
+
+	remove(filename);
+	free_db(&db);
+	return 0;
+}
+
+/*
+* Paging: time to print one page of 50 rows at the start, middle and end of a sorted listing,
+* against printing every row, all written to a file
+*/
+static int bench_page(long max_records)
+{
+	const char* filename = "cms_bench_page.txt";
+	const int repeats = 1000;
+	CMSdb db;
+	initialize_db(&db);
+
+	printf("%-10s %-16s %-16s %-16s %-16s\n", "Records", "First page (us)", "Middle page (us)", "Last page (us)", "Everything (ms)");
+	for (long n = 10000; n <= max_records; n *= 10) {
+		bench_fill(&db, n);
+		sort_view_show(&db, SORT_VIEW_MARK_DESC);
+
+		int fd = file_create(filename);
+		if (fd < 0) {
+			printf("Cannot write the benchmark file\n");
+			break;
+		}
+		RecordCursor cursor;
+		TableWriter table;
+		double page_times[3];
+		for (int where = 0; where < 3; where++) {
+			cursor_open(&cursor, NULL, db.record_count, DEFAULT_PAGE_SIZE);
+			if (where == 1) cursor_seek(&cursor, db.record_count / 2);
+			if (where == 2) cursor_last(&cursor);
+			double start = bench_now();
+			for (int r = 0; r < repeats; r++) {
+				table_begin_fd(&table, fd, 1, 0);
+				cursor_print(&db, &cursor, &table);
+				table_end(&table);
+			}
+			page_times[where] = (bench_now() - start) / repeats;
+		}
+
+		cursor_open(&cursor, NULL, db.record_count, 0);
+		double start = bench_now();
+		table_begin_fd(&table, fd, 1, 0);
+		cursor_print(&db, &cursor, &table);
+		table_end(&table);
+		double all_time = bench_now() - start;
+		file_close(fd, 0);
+
+		printf("%-10ld %-16.1f %-16.1f %-16.1f %-16.1f\n", n, page_times[0] * 1e6, page_times[1] * 1e6, page_times[2] * 1e6, all_time * 1000);
+	}
+
+	remove(filename);
+	free_db(&db);
+	return 0;
+}
+
+/*
+* Benchmark table
+*/
+typedef struct {
+	const char* name;
+	int (*run)(long limit);
+	long default_limit; //used when no limit is given on the command line
+	const char* description;
+} Benchmark;
+
+static const Benchmark benchmarks[] = {
+	{ "store", bench_store, 10000000, "record store load and scan, 1k to 10M records" },
+	{ "index", bench_index, 4000000, "ID index, hash table vs direct mapped bitmap" },
+	{ "load", bench_load, 1000000, "file loading, memory mapped tokenizer vs fgets/sscanf_s" },
+	{ "pload", bench_parallel_load, 2000000, "parallel file loading with 1 to 16 threads" },
+	{ "binary", bench_binary, 1000000, "text vs binary file format, save and load" },
+	{ "delim", bench_delimiters, 1024, "tab/newline scanning of a generated file (limit in MB)" },
+	{ "query", bench_query, 1000000, "name/programme substring queries, copy+tolower vs folded columns" },
+	{ "trigram", bench_trigram, 5000000, "trigram index build, memory, updates and query latency vs scan" },
+	{ "dict", bench_dictionary, 1000000, "programme dictionary, memory and programme scans vs strings per record" },
+	{ "marks", bench_marks, 1000000, "mark index, exact and range mark queries vs a float scan" },
+	{ "sort", bench_sort, 10000000, "ID and mark sorts, qsort with comparators vs radix/counting sort" },
+	{ "views", bench_views, 1000000, "cached sort views, build, switch and upkeep on insert/delete" },
+	{ "msort", bench_multisort, 1000000, "multi-key sort, folding comparator vs precomputed sort keys" },
+	{ "psort", bench_parallel_sort, 4000000, "parallel sort scaling, 1 to 16 threads" },
+	{ "topk", bench_topk, 1000000, "top 10 and median mark, full sort vs mark histogram" },
+	{ "groups", bench_groups, 1000000, "statistics by programme, record scan vs running totals" },
+	{ "batch", bench_batch, 1000000, "batch mode, indexes updated per change vs once per batch" },
+	{ "merge", bench_merge, 1000000, "merging a second file with each policy vs one change at a time" },
+	{ "lookup", bench_lookup, 1000000, "looking up a file of IDs, one at a time vs sorted first" },
+	{ "render", bench_render, 1000000, "record table output, fprintf per row vs buffered renderer" },
+	{ "page", bench_page, 1000000, "one page of a listing at the start, middle and end vs every row" },
+};
+
+int run_benchmarks(int argc, char* argv[])
+{
+	int count = (int)(sizeof(benchmarks) / sizeof(benchmarks[0]));
+
+	if (argc > 0) {
+		for (int i = 0; i < count; i++) {
+			if (strcmp(argv[0], benchmarks[i].name) == 0) {
+				long limit = (argc > 1) ? atol(argv[1]) : benchmarks[i].default_limit;
+				printf("=== Benchmark: %s ===\n", benchmarks[i].description);
+				return benchmarks[i].run(limit);
+			}
+		}
+		printf("Unknown benchmark \"%s\"\n", argv[0]);
+	}
+
+	printf("Usage: p7_7_CMS --bench <name> [limit]\n");
+	for (int i = 0; i < count; i++) {
+		printf("  %-10s %s\n", benchmarks[i].name, benchmarks[i].description);
+	}
+	return 1;
+}
@@ -0,0 +1,305 @@
+/*
+* Course Management System (CMS)
+* Binary file format (.cmsb) - columns stored the way they sit in memory
+* loading is a single memory map plus copies, nothing is parsed; saving is a handful of large writes
+*
+* layout (native byte order, every section starts on a 4 byte boundary):
+*   BinaryHeader
+*   int32   id[record_count]
+*   float   mark[record_count]
+*   uint32  name_offset[record_count + 1]       offsets into the name blob, name i = [offset[i], offset[i+1])
+*   uint32  programme_offset[record_count + 1]  same for the programme blob
+*   char    name_blob[name_blob_size]            names back to back, no terminators
+*   char    programme_blob[programme_blob_size]
+*/
+
+#include "cms.h"
+#include <stdint.h>
+
+#define CMS_BINARY_BYTE_ORDER 0x01020304u //reads back differently on a machine with the other byte order
+
+typedef struct {
+	char magic[4]; //CMS_BINARY_MAGIC
+	uint32_t version; //CMS_BINARY_VERSION
+	uint32_t byte_order; //CMS_BINARY_BYTE_ORDER
+	uint32_t record_count;
+	uint32_t name_blob_size;
+	uint32_t programme_blob_size;
+	uint32_t reserved[2]; //0, room for later versions
+} BinaryHeader;
+
+/*
+* Check for the magic bytes at the start of a file
+*/
+int is_binary_cms(const char* data, size_t size)
+{
+	return size >= 4 && memcmp(data, CMS_BINARY_MAGIC, 4) == 0;
+}
+
+/*
+* Check whether a filename ends with CMS_BINARY_EXTENSION (any case)
+*/
+int has_binary_extension(const char* filename)
+{
+	size_t length = strlen(filename);
+	size_t extension_length = strlen(CMS_BINARY_EXTENSION);
+
+	if (length < extension_length) {
+		return 0;
+	}
+	const char* extension = filename + length - extension_length;
+	for (size_t i = 0; i < extension_length; i++) {
+		if (tolower((unsigned char)extension[i]) != CMS_BINARY_EXTENSION[i]) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/*
+* Copy string i out of a blob, fails if the offsets are broken or the text does not fit
+*/
+static int copy_blob_string(const uint32_t* offsets, int i, const char* blob, uint32_t blob_size, char* out, size_t out_size)
+{
+	uint32_t start = offsets[i];
+	uint32_t end = offsets[i + 1];
+
+	if (start > end || end > blob_size || end - start >= out_size) {
+		out[0] = '\0';
+		return 0;
+	}
+	memcpy(out, blob + start, end - start);
+	out[end - start] = '\0';
+	return 1;
+}
+
+/*
+* Load every record of a binary CMS file into db
+* stats.line_number counts the records read, records that fail validation or repeat an ID are skipped with a message
+* returns 0 if the file is not a readable binary CMS file (nothing is loaded)
+*/
+int load_binary_records(CMSdb* db, const char* data, size_t size, LoadStats* stats)
+{
+	BinaryHeader header;
+
+	memset(stats, 0, sizeof(*stats));
+
+	if (size < sizeof(header)) {
+		printf("CMS: Error - Binary file is too short\n");
+		return 0;
+	}
+	memcpy(&header, data, sizeof(header));
+	if (!is_binary_cms(data, size) || header.version != CMS_BINARY_VERSION) {
+		printf("CMS: Error - Unsupported binary file version %u\n", (unsigned int)header.version);
+		return 0;
+	}
+	if (header.byte_order != CMS_BINARY_BYTE_ORDER) {
+		printf("CMS: Error - Binary file was written on a machine with a different byte order\n");
+		return 0;
+	}
+
+	size_t n = header.record_count;
+	size_t expected = sizeof(header) + n * (sizeof(int32_t) + sizeof(float)) + (n + 1) * 2 * sizeof(uint32_t)
+		+ (size_t)header.name_blob_size + (size_t)header.programme_blob_size;
+	if (expected != size) {
+		printf("CMS: Error - Binary file is damaged (expected %zu bytes, found %zu)\n", expected, size);
+		return 0;
+	}
+
+	//the mapping is page aligned and every column is a multiple of 4 bytes, so the columns are used in place
+	const int32_t* ids = (const int32_t*)(data + sizeof(header));
+	const float* marks = (const float*)(ids + n);
+	const uint32_t* name_offsets = (const uint32_t*)(marks + n);
+	const uint32_t* programme_offsets = name_offsets + n + 1;
+	const char* name_blob = (const char*)(programme_offsets + n + 1);
+	const char* programme_blob = name_blob + header.name_blob_size;
+
+	for (int i = 0; i < (int)n; i++) {
+		StudentRecord record;
+		stats->line_number = i + 1;
+
+		record.id = ids[i];
+		record.mark = marks[i];
+		int copied = copy_blob_string(name_offsets, i, name_blob, header.name_blob_size, record.name, sizeof(record.name)) &&
+			copy_blob_string(programme_offsets, i, programme_blob, header.programme_blob_size, record.programme, sizeof(record.programme));
+
+		if (!copied || !valid_student_record(&record)) {
+			printf("CMS: Invalid Data in record %d (ID %d)\n", i + 1, record.id);
+			stats->data_lines_found++;
+			continue;
+		}
+		//the first record with an ID wins, as in text files
+		int added = db_append_record(db, &record);
+		if (added < 0) {
+			printf("CMS: Warning - Duplicate ID %d in record %d, skipping\n", record.id, i + 1);
+			continue;
+		}
+		if (added == 0) {
+			printf("CMS: Error - Out of memory at record %d, stopped loading\n", i + 1);
+			break;
+		}
+		tracker_set_source(db, db->order[db->record_count - 1], i, 0);
+		stats->data_lines_loaded++;
+		stats->data_lines_found++;
+	}
+	return 1;
+}
+
+/*
+* Write all records in display order to a binary CMS file
+* the columns are built in one buffer first, then the header and the buffer are written with one fwrite each
+* returns 1 on success, 0 if the file cannot be written or memory runs out
+*/
+int save_binary_records(const CMSdb* db, const char* filename)
+{
+	BinaryHeader header;
+	size_t n = (size_t)db->record_count;
+	size_t name_size = 0;
+	size_t programme_size = 0;
+
+	for (int i = 0; i < db->record_count; i++) {
+		name_size += strlen(db_record(db, i)->name);
+		programme_size += strlen(db_programme(db, i));
+	}
+	if (name_size > UINT32_MAX || programme_size > UINT32_MAX) {
+		return 0;
+	}
+
+	//one allocation for every column, in file order
+	size_t columns_size = n * (sizeof(int32_t) + sizeof(float)) + (n + 1) * 2 * sizeof(uint32_t) + name_size + programme_size;
+	char* columns = (char*)malloc(columns_size);
+	if (columns == NULL) {
+		return 0;
+	}
+	int32_t* ids = (int32_t*)columns;
+	float* marks = (float*)(ids + n);
+	uint32_t* name_offsets = (uint32_t*)(marks + n);
+	uint32_t* programme_offsets = name_offsets + n + 1;
+	char* name_blob = (char*)(programme_offsets + n + 1);
+	char* programme_blob = name_blob + name_size;
+
+	uint32_t name_end = 0;
+	uint32_t programme_end = 0;
+	for (size_t i = 0; i < n; i++) {
+		const StoredRecord* record = db_record(db, (int)i);
+		const char* programme = db_programme(db, (int)i);
+		size_t name_length = strlen(record->name);
+		size_t programme_length = strlen(programme);
+
+		ids[i] = record->id;
+		marks[i] = tenths_to_mark(record->mark_tenths);
+		name_offsets[i] = name_end;
+		programme_offsets[i] = programme_end;
+		memcpy(name_blob + name_end, record->name, name_length);
+		memcpy(programme_blob + programme_end, programme, programme_length);
+		name_end += (uint32_t)name_length;
+		programme_end += (uint32_t)programme_length;
+	}
+	name_offsets[n] = name_end;
+	programme_offsets[n] = programme_end;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CMS_BINARY_MAGIC, 4);
+	header.version = CMS_BINARY_VERSION;
+	header.byte_order = CMS_BINARY_BYTE_ORDER;
+	header.record_count = (uint32_t)n;
+	header.name_blob_size = (uint32_t)name_size;
+	header.programme_blob_size = (uint32_t)programme_size;
+
+	FILE* file = fopen(filename, "wb");
+	if (file == NULL) {
+		free(columns);
+		return 0;
+	}
+	int written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+		fwrite(columns, 1, columns_size, file) == columns_size;
+	written = flush_to_disk(file) && written;
+	written = (fclose(file) == 0) && written;
+	free(columns);
+	return written;
+}
+
+/*
+* Write the records edited since the last save straight into the binary file, nothing else is touched
+* only possible while no record was added, removed or reordered and every edited string keeps its length
+* (the string columns would have to move otherwise)
+* the live file is overwritten, so save_file only calls this while the synced change log can repair a patch
+* that stops half way
+* returns 1 if the file was patched, 0 if it has to be rewritten instead
+*/
+int patch_binary_records(CMSdb* db, const char* filename, SaveReport* report)
+{
+	const SaveTracker* tracker = &db->save_tracker;
+	BinaryHeader header;
+
+	memset(report, 0, sizeof(*report));
+	if (!tracker->tracking || tracker->format != FILE_FORMAT_BINARY || tracker->layout_changed) {
+		return 0;
+	}
+
+	int fd = file_open_update(filename);
+	if (fd < 0) {
+		return 0;
+	}
+	if (!file_read_at(fd, &header, sizeof(header), 0) || memcmp(header.magic, CMS_BINARY_MAGIC, 4) != 0 ||
+		header.version != CMS_BINARY_VERSION || header.record_count != (uint32_t)db->record_count) {
+		file_close(fd, 0);
+		return 0;
+	}
+
+	long long n = header.record_count;
+	long long marks_at = (long long)sizeof(header) + n * (long long)sizeof(int32_t);
+	long long name_offsets_at = marks_at + n * (long long)sizeof(float);
+	long long programme_offsets_at = name_offsets_at + (n + 1) * (long long)sizeof(uint32_t);
+	long long name_blob_at = programme_offsets_at + (n + 1) * (long long)sizeof(uint32_t);
+	long long programme_blob_at = name_blob_at + header.name_blob_size;
+
+	//check every edited record first, so the file is either fully patched or not touched
+	uint32_t* starts = (uint32_t*)malloc((size_t)(tracker->changed_count > 0 ? tracker->changed_count : 1) * 2 * sizeof(uint32_t));
+	if (starts == NULL) {
+		file_close(fd, 0);
+		return 0;
+	}
+	int fits = 1;
+	for (int k = 0; k < tracker->changed_count && fits; k++) {
+		int slot = tracker->changed_slots[k];
+		long long i = tracker->sources[slot].offset;
+		const StoredRecord* record = arena_record(&db->arena, slot);
+		uint32_t name_span[2];
+		uint32_t programme_span[2];
+
+		fits = file_read_at(fd, name_span, sizeof(name_span), name_offsets_at + i * (long long)sizeof(uint32_t)) &&
+			file_read_at(fd, programme_span, sizeof(programme_span), programme_offsets_at + i * (long long)sizeof(uint32_t)) &&
+			name_span[1] - name_span[0] == strlen(record->name) &&
+			programme_span[1] - programme_span[0] == strlen(slot_programme(db, slot));
+		starts[2 * k] = name_span[0];
+		starts[2 * k + 1] = programme_span[0];
+	}
+
+	for (int k = 0; k < tracker->changed_count && fits; k++) {
+		int slot = tracker->changed_slots[k];
+		long long i = tracker->sources[slot].offset;
+		const StoredRecord* record = arena_record(&db->arena, slot);
+		const char* programme = slot_programme(db, slot);
+		size_t name_length = strlen(record->name);
+		size_t programme_length = strlen(programme);
+		float mark = tenths_to_mark(record->mark_tenths);
+
+		//the ID never changes in place, only mark and strings are written
+		fits = file_write_at(fd, &mark, sizeof(float), marks_at + i * (long long)sizeof(float)) &&
+			file_write_at(fd, record->name, name_length, name_blob_at + starts[2 * k]) &&
+			file_write_at(fd, programme, programme_length, programme_blob_at + starts[2 * k + 1]);
+		report->bytes_written += (long long)(sizeof(float) + name_length + programme_length);
+		report->records_written++;
+	}
+	free(starts);
+
+	fits = file_close(fd, 1) && fits;
+	if (!fits) {
+		return 0;
+	}
+	report->file_bytes = programme_blob_at + header.programme_blob_size;
+	report->incremental = 1;
+	tracker_start(db, FILE_FORMAT_BINARY);
+	return 1;
+}
@@ -0,0 +1,220 @@
+/*
+* Course Management System (CMS)
+* Record cursor - pages through Show All Records and the query results instead of printing every row at once
+* a cursor is a window (offset, page size) over a list of display positions, or over the display order itself,
+* which already follows the shown sort view; a page reads only its own rows through db->order,
+* so any page costs the same whatever the size of the database and wherever the page is
+* on a terminal long listings stop after every page; redirected output, batch mode and --page-size=0
+* print the whole list (batch mode takes LIMIT and OFFSET instead)
+* a ranked listing (the top-k query) holds arena slots and a rank per row, shown in a Rank column
+*/
+
+#include "cms.h"
+
+/*
+* Start at the first row of a list of count rows
+* positions are display positions (NULL = every record in display order), page_size 0 = one page with every row
+*/
+void cursor_open(RecordCursor* cursor, const int* positions, int count, int page_size)
+{
+	cursor->positions = positions;
+	cursor->ranks = NULL;
+	cursor->count = count;
+	cursor->offset = 0;
+	cursor->page_size = (page_size > 0) ? page_size : ((count > 0) ? count : 1);
+}
+
+/*
+* Start at the first row of a ranked list: count arena slots, ranks[row] is printed in front of each
+*/
+void cursor_open_ranked(RecordCursor* cursor, const int* slots, const int* ranks, int count, int page_size)
+{
+	cursor_open(cursor, slots, count, page_size);
+	cursor->ranks = ranks;
+}
+
+/*
+* Start the page at row offset (0-based), kept within 0..count
+*/
+void cursor_seek(RecordCursor* cursor, int offset)
+{
+	if (offset > cursor->count) offset = cursor->count;
+	if (offset < 0) offset = 0;
+	cursor->offset = offset;
+}
+
+/*
+* Move one page forward or back, return 0 if already on the last or first page
+*/
+int cursor_next(RecordCursor* cursor)
+{
+	if (cursor->offset + cursor->page_size >= cursor->count) {
+		return 0;
+	}
+	cursor->offset += cursor->page_size;
+	return 1;
+}
+
+int cursor_prev(RecordCursor* cursor)
+{
+	if (cursor->offset == 0) {
+		return 0;
+	}
+	cursor->offset = (cursor->offset > cursor->page_size) ? cursor->offset - cursor->page_size : 0;
+	return 1;
+}
+
+/*
+* Move to the last full page boundary
+*/
+void cursor_last(RecordCursor* cursor)
+{
+	cursor->offset = (cursor->count > 0) ? (cursor->count - 1) / cursor->page_size * cursor->page_size : 0;
+}
+
+/*
+* One past the last row of the current page
+*/
+int cursor_page_end(const RecordCursor* cursor)
+{
+	int end = cursor->offset + cursor->page_size;
+	return (end < cursor->count) ? end : cursor->count;
+}
+
+/*
+* Add the rows of the current page to a table
+*/
+void cursor_print(const CMSdb* db, const RecordCursor* cursor, TableWriter* table)
+{
+	int end = cursor_page_end(cursor);
+
+	for (int row = cursor->offset; row < end; row++) {
+		if (cursor->ranks != NULL) {
+			int slot = cursor->positions[row];
+			const StoredRecord* record = arena_record(&db->arena, slot);
+			table_row(table, cursor->ranks[row], record->id, record->name, slot_programme(db, slot), record->mark_tenths);
+			continue;
+		}
+		int position = (cursor->positions != NULL) ? cursor->positions[row] : row;
+		table_slot(table, db, db->order[position]);
+	}
+}
+
+/*
+* Print limit rows from row offset of a list (LIMIT / OFFSET), limit < 0 = every row after offset
+*/
+void print_record_window(const CMSdb* db, const int* positions, int count, int offset, int limit)
+{
+	RecordCursor cursor;
+	TableWriter table;
+
+	cursor_open(&cursor, positions, count, (limit >= 0) ? limit : count);
+	cursor_seek(&cursor, offset);
+	table_begin(&table, db->options.table_layout, 0);
+	if (limit != 0) {
+		cursor_print(db, &cursor, &table);
+	}
+	table_end(&table);
+}
+
+/*
+* Whether a list of count rows is shown page by page: someone is reading it on a terminal and it is long
+*/
+static int cursor_paging(const CMSdb* db, int count)
+{
+	return db->options.page_size > 0 && count > db->options.page_size && db->options.batch_file == NULL &&
+		stdin_is_terminal() && stdout_is_terminal();
+}
+
+/*
+* Show an opened cursor's list, page by page unless its one page holds every row
+*/
+static void browse_cursor(const CMSdb* db, RecordCursor* cursor)
+{
+	TableWriter table;
+	int count = cursor->count;
+
+	if (cursor_page_end(cursor) == count) {
+		table_begin(&table, db->options.table_layout, cursor->ranks != NULL);
+		cursor_print(db, cursor, &table);
+		table_end(&table);
+		return;
+	}
+
+	int pages = (count + cursor->page_size - 1) / cursor->page_size;
+	int show = 1;
+	while (1) {
+		if (show) {
+			table_begin(&table, db->options.table_layout, cursor->ranks != NULL);
+			cursor_print(db, cursor, &table);
+			table_end(&table);
+			printf("\nRows %d-%d of %d (page %d of %d)\n", cursor->offset + 1, cursor_page_end(cursor), count,
+				cursor->offset / cursor->page_size + 1, pages);
+		}
+		show = 1;
+
+		char command[16] = "";
+		get_string_input(command, sizeof(command), "Enter: next page, P: previous, F: first, L: last, G <row>: go to row, Q: quit: ");
+		if (feof(stdin)) {
+			return;
+		}
+		switch (toupper((unsigned char)command[0])) {
+		case '\0':
+		case 'N':
+			if (!cursor_next(cursor)) {
+				printf("CMS: This is the last page.\n");
+				show = 0;
+			}
+			break;
+		case 'P':
+			if (!cursor_prev(cursor)) {
+				printf("CMS: This is the first page.\n");
+				show = 0;
+			}
+			break;
+		case 'F':
+			cursor_seek(cursor, 0);
+			break;
+		case 'L':
+			cursor_last(cursor);
+			break;
+		case 'G': {
+			int row = atoi(command + 1);
+			if (row < 1 || row > count) {
+				printf("CMS: Enter a row between 1-%d.\n", count);
+				show = 0;
+			}
+			else {
+				cursor_seek(cursor, row - 1);
+			}
+			break;
+		}
+		case 'Q':
+			return;
+		default:
+			printf("CMS: Invalid choice.\n");
+			show = 0;
+			break;
+		}
+	}
+}
+
+/*
+* Show a list of records (positions as for cursor_open), one page at a time when cursor_paging says so
+*/
+void browse_records(const CMSdb* db, const int* positions, int count)
+{
+	RecordCursor cursor;
+	cursor_open(&cursor, positions, count, cursor_paging(db, count) ? db->options.page_size : 0);
+	browse_cursor(db, &cursor);
+}
+
+/*
+* Show a ranked list (as for cursor_open_ranked) the same way
+*/
+void browse_ranked(const CMSdb* db, const int* slots, const int* ranks, int count)
+{
+	RecordCursor cursor;
+	cursor_open_ranked(&cursor, slots, ranks, count, cursor_paging(db, count) ? db->options.page_size : 0);
+	browse_cursor(db, &cursor);
+}
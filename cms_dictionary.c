@@ -0,0 +1,123 @@
+/*
+* Course Management System (CMS)
+* Programme dictionary - each distinct programme text is stored once and records keep a 16 bit code
+* codes are handed out in order of first appearance and stay valid until the database is cleared
+* (a code whose last record was deleted is simply not referenced any more)
+*/
+
+#include "cms.h"
+
+static unsigned int programme_hash(const char* programme)
+{
+	unsigned int hash = 2166136261u;
+	for (const unsigned char* p = (const unsigned char*)programme; *p != '\0'; p++) {
+		hash = (hash ^ *p) * 16777619u;
+	}
+	return hash;
+}
+
+/*
+* Hash entry holding programme, or the empty entry where it would go
+*/
+static int* dictionary_entry(const ProgrammeDictionary* dictionary, const char* programme)
+{
+	unsigned int mask = (unsigned int)dictionary->table_capacity - 1;
+	unsigned int i = programme_hash(programme) & mask;
+
+	while (dictionary->table[i] != 0 && strcmp(dictionary->names[dictionary->table[i] - 1], programme) != 0) {
+		i = (i + 1) & mask;
+	}
+	return &dictionary->table[i];
+}
+
+/*
+* Double the hash table (or allocate the first one), returns 0 if out of memory
+*/
+static int dictionary_grow_table(ProgrammeDictionary* dictionary)
+{
+	int capacity = (dictionary->table_capacity > 0) ? dictionary->table_capacity * 2 : 256;
+	int* table = (int*)calloc((size_t)capacity, sizeof(int));
+	if (table == NULL) {
+		return 0;
+	}
+	free(dictionary->table);
+	dictionary->table = table;
+	dictionary->table_capacity = capacity;
+	for (int code = 0; code < dictionary->count; code++) {
+		*dictionary_entry(dictionary, dictionary->names[code]) = code + 1;
+	}
+	return 1;
+}
+
+/*
+* Code of programme, -1 if no record has used it
+*/
+int programme_find(const ProgrammeDictionary* dictionary, const char* programme)
+{
+	if (dictionary->table_capacity == 0) {
+		return -1;
+	}
+	return *dictionary_entry(dictionary, programme) - 1;
+}
+
+/*
+* Code of programme, adding it if it is new
+* returns -1 if out of memory or all PROGRAMME_CODE_LIMIT codes are taken
+*/
+int programme_intern(ProgrammeDictionary* dictionary, const char* programme)
+{
+	int code = programme_find(dictionary, programme);
+	if (code >= 0) {
+		return code;
+	}
+	if (dictionary->count == PROGRAMME_CODE_LIMIT) {
+		return -1;
+	}
+
+	if (dictionary->count == dictionary->capacity) {
+		int capacity = (dictionary->capacity > 0) ? dictionary->capacity * 2 : 64;
+		if (capacity > PROGRAMME_CODE_LIMIT) {
+			capacity = PROGRAMME_CODE_LIMIT;
+		}
+		char (*names)[MAX_PROGRAMME_LENGTH] = (char (*)[MAX_PROGRAMME_LENGTH])realloc(dictionary->names, (size_t)capacity * MAX_PROGRAMME_LENGTH);
+		if (names == NULL) {
+			return -1;
+		}
+		dictionary->names = names;
+		char (*folded)[MAX_PROGRAMME_LENGTH] = (char (*)[MAX_PROGRAMME_LENGTH])realloc(dictionary->folded, (size_t)capacity * MAX_PROGRAMME_LENGTH);
+		if (folded == NULL) {
+			return -1;
+		}
+		dictionary->folded = folded;
+		dictionary->capacity = capacity;
+	}
+	//keep the table at most half full
+	if ((dictionary->count + 1) * 2 > dictionary->table_capacity && !dictionary_grow_table(dictionary)) {
+		return -1;
+	}
+
+	code = dictionary->count++;
+	strcpy_s(dictionary->names[code], MAX_PROGRAMME_LENGTH, programme);
+	fold_text(dictionary->folded[code], dictionary->names[code], MAX_PROGRAMME_LENGTH);
+	*dictionary_entry(dictionary, dictionary->names[code]) = code + 1;
+	return code;
+}
+
+/*
+* Forget every programme but keep the memory, used when all records are dropped
+*/
+void programme_dictionary_clear(ProgrammeDictionary* dictionary)
+{
+	dictionary->count = 0;
+	if (dictionary->table != NULL) {
+		memset(dictionary->table, 0, (size_t)dictionary->table_capacity * sizeof(int));
+	}
+}
+
+void programme_dictionary_free(ProgrammeDictionary* dictionary)
+{
+	free(dictionary->names);
+	free(dictionary->folded);
+	free(dictionary->table);
+	memset(dictionary, 0, sizeof(*dictionary));
+}
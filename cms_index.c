@@ -0,0 +1,289 @@
+/*
+* Course Management System (CMS)
+* ID index - student ID to arena slot
+* ID_INDEX_HASH: open addressing hash table, memory grows with the number of records
+* ID_INDEX_DIRECT: existence bitmap over the whole 7 digit ID range plus a paged slot table
+*/
+
+#include "cms.h"
+
+#define ID_INDEX_MIN_BITS 10 //smallest table holds 2^10 entries
+#define ID_INDEX_EMPTY 0 //valid student IDs are never 0
+
+#define ID_RANGE (MAX_VALID_ID - MIN_VALID_ID + 1)
+#define ID_BITMAP_WORDS ((ID_RANGE + 63) / 64)
+#define ID_PAGE_SHIFT 16 //each slot page covers 2^16 consecutive IDs
+#define ID_PAGE_SIZE (1 << ID_PAGE_SHIFT)
+#define ID_PAGE_COUNT ((ID_RANGE + ID_PAGE_SIZE - 1) / ID_PAGE_SIZE)
+
+/*
+* Start an empty index, nothing is allocated until the first insert
+*/
+void id_index_init(IdIndex* index, int mode)
+{
+	memset(index, 0, sizeof(*index));
+	index->mode = mode;
+}
+
+/*
+* Fibonacci hashing, spreads consecutive IDs across the table
+*/
+static unsigned int id_hash(const IdIndex* index, int id)
+{
+	return ((unsigned int)id * 2654435769u) >> (32 - index->bits);
+}
+
+/*
+* Allocate an empty table with 2^bits entries
+*/
+static int id_index_alloc(IdIndex* index, int bits)
+{
+	IdIndexEntry* entries = (IdIndexEntry*)calloc((size_t)1 << bits, sizeof(IdIndexEntry));
+	if (entries == NULL) {
+		return 0;
+	}
+	index->entries = entries;
+	index->bits = bits;
+	index->capacity = 1 << bits;
+	index->count = 0;
+	return 1;
+}
+
+/*
+* Place an entry without checking for duplicates or load factor
+*/
+static void id_index_place(IdIndex* index, int id, int slot)
+{
+	unsigned int mask = (unsigned int)index->capacity - 1;
+	unsigned int pos = id_hash(index, id);
+
+	while (index->entries[pos].id != ID_INDEX_EMPTY) {
+		pos = (pos + 1) & mask;
+	}
+	index->entries[pos].id = id;
+	index->entries[pos].slot = slot;
+	index->count++;
+}
+
+/*
+* Double the table and re-insert every entry
+*/
+static int id_index_grow(IdIndex* index)
+{
+	IdIndex old = *index;
+	int bits = (old.entries != NULL) ? old.bits + 1 : ID_INDEX_MIN_BITS;
+
+	if (!id_index_alloc(index, bits)) {
+		*index = old;
+		return 0;
+	}
+	for (int i = 0; i < old.capacity; i++) {
+		if (old.entries[i].id != ID_INDEX_EMPTY) {
+			id_index_place(index, old.entries[i].id, old.entries[i].slot);
+		}
+	}
+	free(old.entries);
+	return 1;
+}
+
+/*
+* Direct mode helpers
+* offset = id - MIN_VALID_ID, bit "offset" of the bitmap is set while the ID exists
+*/
+static int direct_has(const IdIndex* index, int id)
+{
+	if (index->bitmap == NULL || id < MIN_VALID_ID || id > MAX_VALID_ID) {
+		return 0;
+	}
+	unsigned int offset = (unsigned int)(id - MIN_VALID_ID);
+	return (int)((index->bitmap[offset >> 6] >> (offset & 63)) & 1);
+}
+
+static int direct_insert(IdIndex* index, int id, int slot)
+{
+	if (id < MIN_VALID_ID || id > MAX_VALID_ID) {
+		return 0;
+	}
+	if (index->bitmap == NULL) {
+		index->bitmap = (unsigned long long*)calloc(ID_BITMAP_WORDS, sizeof(unsigned long long));
+		index->slot_pages = (int**)calloc(ID_PAGE_COUNT, sizeof(int*));
+		if (index->bitmap == NULL || index->slot_pages == NULL) {
+			free(index->bitmap);
+			free(index->slot_pages);
+			index->bitmap = NULL;
+			index->slot_pages = NULL;
+			return 0;
+		}
+	}
+
+	unsigned int offset = (unsigned int)(id - MIN_VALID_ID);
+	int** page = &index->slot_pages[offset >> ID_PAGE_SHIFT];
+	if (*page == NULL) {
+		//pages are only allocated for ID ranges that are used, a cohort usually touches a few
+		*page = (int*)malloc(ID_PAGE_SIZE * sizeof(int));
+		if (*page == NULL) {
+			return 0;
+		}
+	}
+	unsigned long long bit = 1ULL << (offset & 63);
+	if (index->bitmap[offset >> 6] & bit) {
+		return -1; //already in the index
+	}
+	(*page)[offset & (ID_PAGE_SIZE - 1)] = slot;
+	index->bitmap[offset >> 6] |= bit;
+	index->count++;
+	return 1;
+}
+
+/*
+* Check whether a student ID is in the index
+* in direct mode this is one bitmap read, no hashing or probing
+*/
+int id_index_contains(const IdIndex* index, int id)
+{
+	if (index->mode == ID_INDEX_DIRECT) {
+		return direct_has(index, id);
+	}
+	return id_index_find(index, id) >= 0;
+}
+
+/*
+* Look up the arena slot of a student ID
+* returns the slot or -1 if the ID is not in the index
+*/
+int id_index_find(const IdIndex* index, int id)
+{
+	if (index->mode == ID_INDEX_DIRECT) {
+		if (!direct_has(index, id)) {
+			return -1;
+		}
+		unsigned int offset = (unsigned int)(id - MIN_VALID_ID);
+		return index->slot_pages[offset >> ID_PAGE_SHIFT][offset & (ID_PAGE_SIZE - 1)];
+	}
+
+	if (index->count == 0) {
+		return -1;
+	}
+
+	unsigned int mask = (unsigned int)index->capacity - 1;
+	unsigned int pos = id_hash(index, id);
+
+	while (index->entries[pos].id != ID_INDEX_EMPTY) {
+		if (index->entries[pos].id == id) {
+			return index->entries[pos].slot;
+		}
+		pos = (pos + 1) & mask;
+	}
+	return -1;
+}
+
+/*
+* Add a student ID with its slot
+* returns 1 if added, -1 if the ID is already in the index (nothing changes), 0 if out of memory
+* so callers get the duplicate check and the insert from a single probe
+*/
+int id_index_insert(IdIndex* index, int id, int slot)
+{
+	if (index->mode == ID_INDEX_DIRECT) {
+		return direct_insert(index, id, slot);
+	}
+
+	//keep the table at most 70% full so probe chains stay short
+	if (index->entries == NULL || (long long)(index->count + 1) * 10 > (long long)index->capacity * 7) {
+		if (!id_index_grow(index)) {
+			return 0;
+		}
+	}
+
+	unsigned int mask = (unsigned int)index->capacity - 1;
+	unsigned int pos = id_hash(index, id);
+
+	while (index->entries[pos].id != ID_INDEX_EMPTY) {
+		if (index->entries[pos].id == id) {
+			return -1;
+		}
+		pos = (pos + 1) & mask;
+	}
+	index->entries[pos].id = id;
+	index->entries[pos].slot = slot;
+	index->count++;
+	return 1;
+}
+
+/*
+* Remove a student ID from the index
+* later entries of the probe chain are shifted back so no tombstones are needed
+*/
+void id_index_remove(IdIndex* index, int id)
+{
+	if (index->mode == ID_INDEX_DIRECT) {
+		if (direct_has(index, id)) {
+			unsigned int offset = (unsigned int)(id - MIN_VALID_ID);
+			index->bitmap[offset >> 6] &= ~(1ULL << (offset & 63));
+			index->count--;
+		}
+		return;
+	}
+
+	if (index->count == 0) {
+		return;
+	}
+
+	unsigned int mask = (unsigned int)index->capacity - 1;
+	unsigned int pos = id_hash(index, id);
+
+	while (index->entries[pos].id != id) {
+		if (index->entries[pos].id == ID_INDEX_EMPTY) {
+			return; //not in the index
+		}
+		pos = (pos + 1) & mask;
+	}
+
+	unsigned int hole = pos;
+	unsigned int next = (hole + 1) & mask;
+	while (index->entries[next].id != ID_INDEX_EMPTY) {
+		unsigned int home = id_hash(index, index->entries[next].id);
+		//move the entry into the hole unless its home lies cyclically between the hole and its position
+		int stays = (hole <= next) ? (home > hole && home <= next) : (home > hole || home <= next);
+		if (!stays) {
+			index->entries[hole] = index->entries[next];
+			hole = next;
+		}
+		next = (next + 1) & mask;
+	}
+	index->entries[hole].id = ID_INDEX_EMPTY;
+	index->count--;
+}
+
+/*
+* Empty the index but keep the table allocated
+*/
+void id_index_clear(IdIndex* index)
+{
+	if (index->entries != NULL) {
+		memset(index->entries, 0, (size_t)index->capacity * sizeof(IdIndexEntry));
+	}
+	if (index->bitmap != NULL) {
+		//stale slot pages are harmless, the bitmap decides whether an entry exists
+		memset(index->bitmap, 0, ID_BITMAP_WORDS * sizeof(unsigned long long));
+	}
+	index->count = 0;
+}
+
+/*
+* Release all memory, the index keeps its mode
+*/
+void id_index_free(IdIndex* index)
+{
+	int mode = index->mode;
+
+	free(index->entries);
+	if (index->slot_pages != NULL) {
+		for (int i = 0; i < ID_PAGE_COUNT; i++) {
+			free(index->slot_pages[i]);
+		}
+	}
+	free(index->slot_pages);
+	free(index->bitmap);
+	id_index_init(index, mode);
+}
@@ -0,0 +1,731 @@
+/*
+* Course Management System (CMS)
+* Loader - parses CMS text files straight out of a memory mapped buffer
+* tab and newline positions come from scan_delimiters one block at a time,
+* fields are then tokenized by hand, no fgets or sscanf
+*/
+
+#include "cms.h"
+
+#define LOAD_BLOCK_SIZE (256 * 1024) //bytes scanned for delimiters in one go
+#define SPAN_STACK_TABS 256 //parse_record_span scans lines up to this length without allocating
+#define PARALLEL_LOAD_MIN_BYTES (1024 * 1024) //smaller files load faster on one thread
+#define PARALLEL_LOAD_CHUNKS_PER_THREAD 4
+
+/*
+* State passed to load_line through for_each_line
+*/
+typedef struct {
+	CMSdb* db;
+	LoadStats* stats;
+	const char* data; //whole buffer, line offsets are kept for the incremental save
+	const char* end;
+	int stopped; //load_line asked to stop, the message is already printed
+} LineLoader;
+
+/*
+* Same characters as isspace() in the C locale, without the locale lookup
+*/
+static int is_blank(char c)
+{
+	return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static const char* skip_blanks(const char* p, const char* end)
+{
+	while (p < end && is_blank(*p)) {
+		p++;
+	}
+	return p;
+}
+
+/*
+* Integer field, like %d: optional sign then at least one digit
+*/
+static int parse_int_field(const char** cursor, const char* end, int* value)
+{
+	const char* p = skip_blanks(*cursor, end);
+	int negative = 0;
+
+	if (p < end && (*p == '+' || *p == '-')) {
+		negative = (*p == '-');
+		p++;
+	}
+	if (p >= end || *p < '0' || *p > '9') {
+		return 0;
+	}
+
+	long long result = 0;
+	while (p < end && *p >= '0' && *p <= '9') {
+		if (result <= 2147483647LL) {
+			result = result * 10 + (*p - '0'); //stops growing once it no longer fits an int
+		}
+		p++;
+	}
+	if (result > 2147483647LL) {
+		result = 2147483647LL;
+	}
+
+	*value = (int)(negative ? -result : result);
+	*cursor = p;
+	return 1;
+}
+
+/*
+* Text field, like %[^\t]: everything up to the next tab, surrounding spaces trimmed
+* tabs holds the tab positions of the line (relative to line), *next_tab is the first one not used yet
+* fails if the text does not fit in out_size (including the terminator), as sscanf_s does
+*/
+static int parse_text_field(const char** cursor, const char* line, const char* end,
+	const unsigned int* tabs, int tab_count, int* next_tab, char* out, size_t out_size)
+{
+	const char* start = skip_blanks(*cursor, end);
+
+	//the field ends at the first tab at or after start, blanks skipped above may have passed some tabs
+	while (*next_tab < tab_count && line + tabs[*next_tab] < start) {
+		(*next_tab)++;
+	}
+	const char* stop = (*next_tab < tab_count) ? line + tabs[*next_tab] : end;
+	if (stop == start) {
+		return 0;
+	}
+	*cursor = stop;
+
+	const char* last = stop;
+	while (last > start && is_blank(last[-1])) {
+		last--;
+	}
+	size_t length = (size_t)(last - start);
+	if (length >= out_size) {
+		out[0] = '\0';
+		return 0;
+	}
+	memcpy(out, start, length);
+	out[length] = '\0';
+	return 1;
+}
+
+/*
+* Floating point field, like %f: [sign] digits [. digits] [e [sign] digits]
+*/
+static int parse_float_field(const char** cursor, const char* end, float* value)
+{
+	static const double powers_of_ten[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+		1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+	const char* p = skip_blanks(*cursor, end);
+	int negative = 0;
+	long long mantissa = 0;
+	int digits = 0;
+	int scale = 0;
+
+	if (p < end && (*p == '+' || *p == '-')) {
+		negative = (*p == '-');
+		p++;
+	}
+	while (p < end && *p >= '0' && *p <= '9') {
+		if (mantissa < 100000000000000000LL) {
+			mantissa = mantissa * 10 + (*p - '0');
+		}
+		else {
+			scale++; //extra digits only change the magnitude
+		}
+		digits++;
+		p++;
+	}
+	if (p < end && *p == '.') {
+		p++;
+		while (p < end && *p >= '0' && *p <= '9') {
+			if (mantissa < 100000000000000000LL) {
+				mantissa = mantissa * 10 + (*p - '0');
+				scale--;
+			}
+			digits++;
+			p++;
+		}
+	}
+	if (digits == 0) {
+		return 0;
+	}
+
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		const char* q = p + 1;
+		int exponent_negative = 0;
+		int exponent = 0;
+		if (q < end && (*q == '+' || *q == '-')) {
+			exponent_negative = (*q == '-');
+			q++;
+		}
+		if (q < end && *q >= '0' && *q <= '9') {
+			while (q < end && *q >= '0' && *q <= '9') {
+				if (exponent < 1000) {
+					exponent = exponent * 10 + (*q - '0');
+				}
+				q++;
+			}
+			scale += exponent_negative ? -exponent : exponent;
+			p = q;
+		}
+	}
+
+	double result = (double)mantissa;
+	while (scale > 22) {
+		result *= 1e22;
+		scale -= 22;
+	}
+	while (scale < -22) {
+		result /= 1e22;
+		scale += 22;
+	}
+	//dividing by an exact power of ten keeps inputs like 70.5 exact
+	result = (scale >= 0) ? result * powers_of_ten[scale] : result / powers_of_ten[-scale];
+
+	*value = (float)(negative ? -result : result);
+	*cursor = p;
+	return 1;
+}
+
+/*
+* Parse "ID<tab>Name<tab>Programme<tab>Mark" from a line that is not NUL terminated
+* tabs are the positions of the tabs in the line (from scan_delimiters), relative to line
+* returns the number of fields read (0-4) the same way sscanf counts them
+*/
+int parse_record_fields(const char* line, size_t length, const unsigned int* tabs, int tab_count, StudentRecord* record)
+{
+	const char* cursor = line;
+	const char* end = line + length;
+	int next_tab = 0;
+
+	if (!parse_int_field(&cursor, end, &record->id)) return 0;
+	if (!parse_text_field(&cursor, line, end, tabs, tab_count, &next_tab, record->name, sizeof(record->name))) return 1;
+	if (!parse_text_field(&cursor, line, end, tabs, tab_count, &next_tab, record->programme, sizeof(record->programme))) return 2;
+	if (!parse_float_field(&cursor, end, &record->mark)) return 3;
+	return 4;
+}
+
+/*
+* Parse a single line that has not been scanned yet
+*/
+int parse_record_span(const char* line, size_t length, StudentRecord* record)
+{
+	unsigned int stack_tabs[SPAN_STACK_TABS];
+	unsigned int* tabs = stack_tabs;
+
+	if (length > SPAN_STACK_TABS) {
+		tabs = (unsigned int*)malloc(length * sizeof(unsigned int));
+		if (tabs == NULL) {
+			return 0;
+		}
+	}
+
+	//the line has no newline in it, so every offset found is a tab
+	int tab_count = (int)scan_delimiters(line, length, tabs);
+	int parsed = parse_record_fields(line, length, tabs, tab_count, record);
+
+	if (tabs != stack_tabs) {
+		free(tabs);
+	}
+	return parsed;
+}
+
+/*
+* Header detection on a line that is not NUL terminated, same rules as is_header_line
+*/
+static int span_contains(const char* line, size_t length, const char* word, size_t word_length)
+{
+	const char* end = line + length;
+	const char* p = line;
+
+	//memchr finds the candidate first letters much faster than a byte loop
+	while ((size_t)(end - p) >= word_length && (p = (const char*)memchr(p, word[0], (size_t)(end - p) - word_length + 1)) != NULL) {
+		if (memcmp(p, word, word_length) == 0) {
+			return 1;
+		}
+		p++;
+	}
+	return 0;
+}
+
+int is_header_span(const char* line, size_t length)
+{
+	// Lines starting with non-digits are likely headers
+	if (length == 0 || !isdigit((unsigned char)line[0])) {
+		return 1;
+	}
+
+	// Common header patterns
+	return span_contains(line, length, "ID", 2) &&
+		(span_contains(line, length, "Name", 4) || span_contains(line, length, "NAME", 4));
+}
+
+/*
+* What a line of a CMS file turned out to be
+*/
+#define LINE_EMPTY 0
+#define LINE_HEADER 1
+#define LINE_UNPARSED 2 //fewer than 4 fields
+#define LINE_INVALID 3 //4 fields that fail validation
+#define LINE_RECORD 4
+
+/*
+* Classify one line, tabs are relative to line
+* *length loses the carriage return of CRLF files, *parsed gets the number of fields read
+* validation messages are only printed when print_errors is set
+*/
+static int classify_line(const char* line, int* length, const unsigned int* tabs, int tab_count,
+	StudentRecord* record, int* parsed, int print_errors)
+{
+	if (*length > 0 && line[*length - 1] == '\r') {
+		(*length)--;
+	}
+
+	// Skip empty lines
+	if (*length == 0) {
+		return LINE_EMPTY;
+	}
+	//Detect and Skip header lines
+	if (is_header_span(line, (size_t)*length)) {
+		return LINE_HEADER;
+	}
+
+	*parsed = parse_record_fields(line, (size_t)*length, tabs, tab_count, record);
+	if (*parsed != 4) {
+		return LINE_UNPARSED;
+	}
+	//validate parsed data
+	return check_student_record(record, print_errors) ? LINE_RECORD : LINE_INVALID;
+}
+
+/*
+* Add a record that passed validation, the first record with an ID wins
+* offset / source_length give its line in the file (newline included) for the incremental save,
+* source_length 0 = the line cannot be copied as it is (last line without a newline)
+* returns 0 if loading has to stop (out of memory)
+*/
+static int load_valid_record(CMSdb* db, const StudentRecord* record, long long offset, int source_length, LoadStats* stats)
+{
+	//append doubles as the duplicate check
+	int added = db_append_record(db, record);
+	if (added < 0) {
+		printf("CMS: Warning - Duplicate ID %d on line %d, skipping\n", record->id, stats->line_number);
+		return 1; // Skip this duplicate record
+	}
+	if (added == 0) {
+		printf("CMS: Error - Out of memory on line %d, stopped loading\n", stats->line_number);
+		return 0;
+	}
+	if (source_length > 0) {
+		tracker_set_source(db, db->order[db->record_count - 1], offset, source_length);
+	}
+	stats->data_lines_loaded++;
+	stats->data_lines_found++;
+	return 1;
+}
+
+/*
+* Handle one line of a CMS file, tabs are relative to line
+* returns 0 if loading has to stop (out of memory)
+*/
+static int load_line(void* context, const char* line, int length, const unsigned int* tabs, int tab_count)
+{
+	LineLoader* loader = (LineLoader*)context;
+	CMSdb* db = loader->db;
+	LoadStats* stats = loader->stats;
+	StudentRecord record;
+	int parsed = 0;
+	int source_length = (line + length < loader->end) ? length + 1 : 0;
+
+	stats->line_number++;
+
+	switch (classify_line(line, &length, tabs, tab_count, &record, &parsed, 1)) {
+	case LINE_HEADER:
+		printf("CMS: Skipping Header Lines %d: %.*s\n", stats->line_number, length, line);
+		stats->header_lines_skipped++;
+		break;
+	case LINE_RECORD:
+		if (!load_valid_record(db, &record, line - loader->data, source_length, stats)) {
+			loader->stopped = 1;
+			return 0;
+		}
+		break;
+	case LINE_INVALID:
+		printf("CMS: Invalid Data on Line %d: %.*s\n", stats->line_number, length, line);
+		stats->data_lines_found++;
+		break;
+	case LINE_UNPARSED:
+		printf("CMS: Could not parse line %d (Needs 4 fields of data, found %d): %.*s\n", stats->line_number, parsed, length, line);
+		stats->data_lines_found++;
+		break;
+	}
+	return 1;
+}
+/*
+* Length of the next block to scan: about LOAD_BLOCK_SIZE bytes, ending just after a newline
+* so no line is split between two blocks (the last block simply ends with the buffer)
+*/
+static size_t next_block_length(const char* data, size_t position, size_t size)
+{
+	size_t length = size - position;
+	if (length <= LOAD_BLOCK_SIZE) {
+		return length;
+	}
+
+	const char* block = data + position;
+	for (size_t i = LOAD_BLOCK_SIZE; i > 0; i--) {
+		if (block[i - 1] == '\n') {
+			return i;
+		}
+	}
+
+	//a line longer than the block, take it whole
+	const char* newline = (const char*)memchr(block + LOAD_BLOCK_SIZE, '\n', length - LOAD_BLOCK_SIZE);
+	return newline ? (size_t)(newline - block) + 1 : length;
+}
+
+/*
+* Call visit(context, line, length, tabs, tab_count) for every line of the buffer, tabs relative to the line
+* stops early when visit returns 0 (or scratch memory runs out), returns 0 in that case
+* *offsets / *capacity are the scratch buffer for scan_delimiters, kept between calls
+*/
+static int for_each_line(const char* data, size_t size, unsigned int** offsets, size_t* capacity,
+	int (*visit)(void* context, const char* line, int length, const unsigned int* tabs, int tab_count), void* context)
+{
+	size_t position = 0;
+
+	while (position < size)
+	{
+		size_t block_length = next_block_length(data, position, size);
+		const char* block = data + position;
+
+		if (block_length > *capacity) {
+			unsigned int* grown = (unsigned int*)realloc(*offsets, block_length * sizeof(unsigned int));
+			if (grown == NULL) {
+				return 0;
+			}
+			*offsets = grown;
+			*capacity = block_length;
+		}
+		unsigned int* found = *offsets;
+		size_t count = scan_delimiters(block, block_length, found);
+
+		//walk the offsets line by line, tabs before each newline belong to that line
+		size_t line_start = 0;
+		size_t first_tab = 0;
+		for (size_t k = 0; k < count; k++) {
+			if (block[found[k]] != '\n') {
+				found[k] -= (unsigned int)line_start; //make the tab relative to its line
+				continue;
+			}
+			if (!visit(context, block + line_start, (int)(found[k] - line_start),
+				found + first_tab, (int)(k - first_tab))) {
+				return 0;
+			}
+			line_start = found[k] + 1;
+			first_tab = k + 1;
+		}
+		//last line of the buffer without a newline
+		if (line_start < block_length &&
+			!visit(context, block + line_start, (int)(block_length - line_start),
+				found + first_tab, (int)(count - first_tab))) {
+			return 0;
+		}
+		position += block_length;
+	}
+	return 1;
+}
+
+/*
+* Load every record from a CMS text buffer into db, printing the same per-line diagnostics as before
+* the first record with an ID wins, later duplicates are skipped with a warning
+*/
+void load_records(CMSdb* db, const char* data, size_t size, LoadStats* stats)
+{
+	unsigned int* offsets = NULL;
+	size_t offsets_capacity = 0;
+	LineLoader loader = { db, stats, data, data + size, 0 };
+
+	memset(stats, 0, sizeof(*stats));
+
+	if (!for_each_line(data, size, &offsets, &offsets_capacity, load_line, &loader) && !loader.stopped) {
+		printf("CMS: Error - Out of memory on line %d, stopped loading\n", stats->line_number + 1);
+	}
+	free(offsets);
+}
+
+/*
+* State passed to scan_line through for_each_line
+*/
+typedef struct {
+	int (*visit)(void* context, const StudentRecord* record, int line_number);
+	void* context;
+	LoadStats* stats;
+} RecordScanner;
+
+/*
+* Same as load_line, but a valid record goes to the scanner's visit instead of the database
+*/
+static int scan_line(void* context, const char* line, int length, const unsigned int* tabs, int tab_count)
+{
+	RecordScanner* scanner = (RecordScanner*)context;
+	LoadStats* stats = scanner->stats;
+	StudentRecord record;
+	int parsed = 0;
+
+	stats->line_number++;
+
+	switch (classify_line(line, &length, tabs, tab_count, &record, &parsed, 1)) {
+	case LINE_HEADER:
+		stats->header_lines_skipped++;
+		break;
+	case LINE_RECORD:
+		stats->data_lines_found++;
+		if (!scanner->visit(scanner->context, &record, stats->line_number)) {
+			return 0;
+		}
+		stats->data_lines_loaded++;
+		break;
+	case LINE_INVALID:
+		printf("CMS: Invalid Data on Line %d: %.*s\n", stats->line_number, length, line);
+		stats->data_lines_found++;
+		break;
+	case LINE_UNPARSED:
+		printf("CMS: Could not parse line %d (Needs 4 fields of data, found %d): %.*s\n", stats->line_number, parsed, length, line);
+		stats->data_lines_found++;
+		break;
+	}
+	return 1;
+}
+
+/*
+* Call visit(context, record, line number) for every valid record of a CMS text buffer, in file order,
+* without adding anything to a database (merging a second file, cms_merge.c)
+* invalid lines get the same messages as load_records, header lines are only counted
+* returns 0 if visit stopped the scan (or scratch memory ran out)
+*/
+int scan_records(const char* data, size_t size, int (*visit)(void* context, const StudentRecord* record, int line_number),
+	void* context, LoadStats* stats)
+{
+	unsigned int* offsets = NULL;
+	size_t offsets_capacity = 0;
+	RecordScanner scanner = { visit, context, stats };
+
+	memset(stats, 0, sizeof(*stats));
+	int finished = for_each_line(data, size, &offsets, &offsets_capacity, scan_line, &scanner);
+	free(offsets);
+	return finished;
+}
+
+/*
+* Parallel loading
+* the buffer is cut into newline aligned chunks, worker threads scan, parse and validate them
+* without printing, then the calling thread merges the chunks in file order: it inserts the
+* records and prints the diagnostics, so output, line numbers and duplicate handling match load_records
+*/
+
+/*
+* A line of a chunk that needs a message during the merge
+*/
+typedef struct {
+	int line; //line number within the chunk, from 1
+	int kind; //LINE_HEADER, LINE_UNPARSED or LINE_INVALID
+	int parsed; //fields read, for LINE_UNPARSED
+	int length;
+	const char* text;
+} LoadEvent;
+
+/*
+* Where a valid record of a chunk came from
+*/
+typedef struct {
+	int line; //line number within the chunk, from 1
+	int source_length; //bytes of the line with its newline, 0 if it has none
+	const char* text;
+} RecordLine;
+
+typedef struct {
+	const char* data;
+	size_t size;
+	int line_count;
+	int failed; //ran out of memory, lines after line_count were not looked at
+
+	StudentRecord* records; //valid records in file order
+	RecordLine* record_lines; //where each record came from
+	int record_count;
+	int record_capacity;
+
+	LoadEvent* events; //in file order
+	int event_count;
+	int event_capacity;
+} LoadChunk;
+
+/*
+* Worker side of for_each_line, runs on a worker thread and only touches its own chunk
+*/
+static int collect_line(void* context, const char* line, int length, const unsigned int* tabs, int tab_count)
+{
+	LoadChunk* chunk = (LoadChunk*)context;
+	StudentRecord record;
+	int parsed = 0;
+
+	int line_number = chunk->line_count + 1; //line_count only moves on once the line is stored
+	int source_length = (line + length < chunk->data + chunk->size) ? length + 1 : 0;
+	int kind = classify_line(line, &length, tabs, tab_count, &record, &parsed, 0);
+
+	if (kind == LINE_RECORD) {
+		if (chunk->record_count == chunk->record_capacity) {
+			int grown_capacity = (chunk->record_capacity > 0) ? chunk->record_capacity * 2 : 1024;
+			StudentRecord* records = (StudentRecord*)realloc(chunk->records, (size_t)grown_capacity * sizeof(StudentRecord));
+			if (records == NULL) {
+				return 0;
+			}
+			chunk->records = records;
+			RecordLine* lines = (RecordLine*)realloc(chunk->record_lines, (size_t)grown_capacity * sizeof(RecordLine));
+			if (lines == NULL) {
+				return 0;
+			}
+			chunk->record_lines = lines;
+			chunk->record_capacity = grown_capacity;
+		}
+		chunk->records[chunk->record_count] = record;
+		chunk->record_lines[chunk->record_count].line = line_number;
+		chunk->record_lines[chunk->record_count].source_length = source_length;
+		chunk->record_lines[chunk->record_count].text = line;
+		chunk->record_count++;
+	}
+	else if (kind != LINE_EMPTY) {
+		if (chunk->event_count == chunk->event_capacity) {
+			int grown_capacity = (chunk->event_capacity > 0) ? chunk->event_capacity * 2 : 64;
+			LoadEvent* events = (LoadEvent*)realloc(chunk->events, (size_t)grown_capacity * sizeof(LoadEvent));
+			if (events == NULL) {
+				return 0;
+			}
+			chunk->events = events;
+			chunk->event_capacity = grown_capacity;
+		}
+		LoadEvent* event = &chunk->events[chunk->event_count++];
+		event->line = line_number;
+		event->kind = kind;
+		event->parsed = parsed;
+		event->length = length;
+		event->text = line;
+	}
+	chunk->line_count = line_number;
+	return 1;
+}
+
+static void collect_chunk(void* context, int index)
+{
+	LoadChunk* chunk = &((LoadChunk*)context)[index];
+	unsigned int* offsets = NULL;
+	size_t offsets_capacity = 0;
+
+	if (!for_each_line(chunk->data, chunk->size, &offsets, &offsets_capacity, collect_line, chunk)) {
+		chunk->failed = 1;
+	}
+	free(offsets);
+}
+
+/*
+* Merge one chunk into db in line order, base is the number of lines before the chunk, data the whole buffer
+* returns 0 if loading has to stop
+*/
+static int merge_chunk(CMSdb* db, const char* data, const LoadChunk* chunk, int base, LoadStats* stats)
+{
+	int r = 0;
+	int e = 0;
+
+	while (r < chunk->record_count || e < chunk->event_count)
+	{
+		int take_record = (e >= chunk->event_count) ||
+			(r < chunk->record_count && chunk->record_lines[r].line < chunk->events[e].line);
+
+		if (take_record) {
+			const RecordLine* source = &chunk->record_lines[r];
+			stats->line_number = base + source->line;
+			if (!load_valid_record(db, &chunk->records[r], source->text - data, source->source_length, stats)) {
+				return 0;
+			}
+			r++;
+			continue;
+		}
+
+		const LoadEvent* event = &chunk->events[e++];
+		stats->line_number = base + event->line;
+		if (event->kind == LINE_HEADER) {
+			printf("CMS: Skipping Header Lines %d: %.*s\n", stats->line_number, event->length, event->text);
+			stats->header_lines_skipped++;
+		}
+		else if (event->kind == LINE_INVALID) {
+			//parse again to print the validation messages, invalid lines are rare
+			StudentRecord record;
+			parse_record_span(event->text, (size_t)event->length, &record);
+			valid_student_record(&record);
+			printf("CMS: Invalid Data on Line %d: %.*s\n", stats->line_number, event->length, event->text);
+			stats->data_lines_found++;
+		}
+		else {
+			printf("CMS: Could not parse line %d (Needs 4 fields of data, found %d): %.*s\n",
+				stats->line_number, event->parsed, event->length, event->text);
+			stats->data_lines_found++;
+		}
+	}
+	stats->line_number = base + chunk->line_count;
+	if (chunk->failed) {
+		printf("CMS: Error - Out of memory on line %d, stopped loading\n", stats->line_number + 1);
+		return 0;
+	}
+	return 1;
+}
+
+/*
+* Same result and output as load_records, with parsing spread over thread_count threads
+* small buffers (or a single thread) go straight to load_records
+*/
+void load_records_parallel(CMSdb* db, const char* data, size_t size, int thread_count, LoadStats* stats)
+{
+	if (thread_count <= 1 || size < PARALLEL_LOAD_MIN_BYTES) {
+		load_records(db, data, size, stats);
+		return;
+	}
+
+	//a few chunks per thread so a slow chunk does not leave the others idle
+	int chunk_count = thread_count * PARALLEL_LOAD_CHUNKS_PER_THREAD;
+	if ((size_t)chunk_count > size / LOAD_BLOCK_SIZE) {
+		chunk_count = (int)(size / LOAD_BLOCK_SIZE);
+	}
+	LoadChunk* chunks = (LoadChunk*)calloc((size_t)chunk_count, sizeof(LoadChunk));
+	if (chunks == NULL) {
+		load_records(db, data, size, stats);
+		return;
+	}
+
+	//cut just after a newline so each chunk holds whole lines
+	size_t start = 0;
+	for (int i = 0; i < chunk_count; i++) {
+		size_t end = (i == chunk_count - 1) ? size : size / (size_t)chunk_count * (size_t)(i + 1);
+		if (end < start) {
+			end = start;
+		}
+		const char* newline = (end < size) ? (const char*)memchr(data + end, '\n', size - end) : NULL;
+		end = (newline != NULL) ? (size_t)(newline - data) + 1 : size;
+		chunks[i].data = data + start;
+		chunks[i].size = end - start;
+		start = end;
+	}
+
+	scan_delimiters(data, 0, NULL); //picks the scanner once, before the threads share it
+	parallel_for(chunk_count, thread_count, collect_chunk, chunks);
+
+	memset(stats, 0, sizeof(*stats));
+	int base = 0;
+	int keep_going = 1;
+	for (int i = 0; i < chunk_count; i++) {
+		if (keep_going) {
+			keep_going = merge_chunk(db, data, &chunks[i], base, stats);
+			base += chunks[i].line_count;
+		}
+		free(chunks[i].records);
+		free(chunks[i].record_lines);
+		free(chunks[i].events);
+	}
+	free(chunks);
+}
@@ -0,0 +1,225 @@
+/*
+* Course Management System (CMS)
+* ID lookup - finds the records of a whole file of student IDs at once ("-" reads standard input)
+* the first field of every line is the ID, so a plain list of IDs and a CMS file both work
+* ("-" is only offered by batch mode, the menu still needs standard input after the lookup)
+* the IDs are radix sorted and repeated ones dropped, then the ID index is probed once per ID in ascending order
+* (consecutive IDs share bitmap words and slot pages in the direct mapped index); the matching records are written
+* to the output file as CMS text in ID order, followed by the IDs that are not in the database
+*/
+
+#include "cms.h"
+#include <time.h>
+
+#define LOOKUP_RADIX_BITS 12 //valid IDs fit in 24 bits, two passes of 4096 buckets
+#define LOOKUP_RADIX_SIZE (1 << LOOKUP_RADIX_BITS)
+#define LOOKUP_READ_BLOCK (64 * 1024)
+#define LOOKUP_BUFFER_SIZE (64 * 1024) //output buffer
+
+/*
+* Read all of standard input into a malloc'd buffer
+* returns 0 if out of memory
+*/
+static int lookup_read_stdin(char** data, size_t* size)
+{
+	size_t capacity = LOOKUP_READ_BLOCK;
+	size_t used = 0;
+	char* buffer = (char*)malloc(capacity);
+
+	while (buffer != NULL) {
+		used += fread(buffer + used, 1, capacity - used, stdin);
+		if (used < capacity) {
+			*data = buffer;
+			*size = used;
+			return 1;
+		}
+		capacity *= 2;
+		char* grown = (char*)realloc(buffer, capacity);
+		if (grown == NULL) {
+			free(buffer);
+		}
+		buffer = grown;
+	}
+	return 0;
+}
+
+/*
+* The ID at the start of every line of data, lines that do not start with a valid ID are counted in report->invalid
+* (blank lines are skipped), stores the IDs in *ids (grown as needed) and returns how many there are, -1 if out of memory
+*/
+static int lookup_parse_ids(const char* data, size_t size, int** ids, int* capacity, LookupReport* report)
+{
+	int count = 0;
+	size_t pos = 0;
+
+	while (pos < size) {
+		const char* line = data + pos;
+		const char* end = (const char*)memchr(line, '\n', size - pos);
+		size_t length = (end != NULL) ? (size_t)(end - line) : size - pos;
+		pos += length + 1;
+
+		size_t i = 0;
+		while (i < length && (line[i] == ' ' || line[i] == '\t')) i++;
+		if (i == length || line[i] == '\r') {
+			continue; //blank line
+		}
+		long id = 0;
+		size_t digits = 0;
+		while (i < length && isdigit((unsigned char)line[i]) && digits < 8) {
+			id = id * 10 + (line[i++] - '0');
+			digits++;
+		}
+		int field_ends = (i == length || line[i] == '\t' || line[i] == ' ' || line[i] == ',' || line[i] == '\r');
+		if (digits == 0 || !field_ends || id < MIN_VALID_ID || id > MAX_VALID_ID) {
+			report->invalid++; //header line or not a student ID
+			continue;
+		}
+		if (!grow_int_array(ids, capacity, count + 1)) {
+			return -1;
+		}
+		(*ids)[count++] = (int)id;
+	}
+	return count;
+}
+
+/*
+* Sort ids ascending (LSD radix sort, two passes) and drop repeated IDs
+* returns how many IDs are left, -1 if out of memory
+*/
+static int lookup_sort_unique(int* ids, int count)
+{
+	int* buffer = (int*)malloc((size_t)count * sizeof(int) + 1);
+	int* histogram = (int*)malloc(LOOKUP_RADIX_SIZE * sizeof(int));
+	if (buffer == NULL || histogram == NULL) {
+		free(buffer);
+		free(histogram);
+		return -1;
+	}
+
+	int* from = ids;
+	int* to = buffer;
+	for (int shift = 0; shift < 2 * LOOKUP_RADIX_BITS; shift += LOOKUP_RADIX_BITS) {
+		memset(histogram, 0, LOOKUP_RADIX_SIZE * sizeof(int));
+		for (int i = 0; i < count; i++) {
+			histogram[(from[i] >> shift) & (LOOKUP_RADIX_SIZE - 1)]++;
+		}
+		int offset = 0;
+		for (int b = 0; b < LOOKUP_RADIX_SIZE; b++) {
+			int bucket = histogram[b];
+			histogram[b] = offset;
+			offset += bucket;
+		}
+		for (int i = 0; i < count; i++) {
+			to[histogram[(from[i] >> shift) & (LOOKUP_RADIX_SIZE - 1)]++] = from[i];
+		}
+		int* swap = from;
+		from = to;
+		to = swap;
+	}
+	//an even number of passes leaves the result back in ids
+
+	int unique = 0;
+	for (int i = 0; i < count; i++) {
+		if (unique == 0 || ids[unique - 1] != ids[i]) {
+			ids[unique++] = ids[i];
+		}
+	}
+	free(buffer);
+	free(histogram);
+	return unique;
+}
+
+static double lookup_clock(void)
+{
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/*
+* Look up every ID listed in the file input ("-" = standard input) and write the records found to output
+* fills *report, returns 1 on success, 0 if a file cannot be read or written or memory ran out
+*/
+int lookup_ids_path(const CMSdb* db, const char* input, const char* output, LookupReport* report)
+{
+	int* ids = NULL;
+	int capacity = 0;
+	int count;
+
+	memset(report, 0, sizeof(*report));
+	double start = lookup_clock();
+	if (strcmp(input, "-") == 0) {
+		char* data;
+		size_t size;
+		if (!lookup_read_stdin(&data, &size)) {
+			printf("CMS: Error - Not enough memory to read the IDs.\n");
+			return 0;
+		}
+		count = lookup_parse_ids(data, size, &ids, &capacity, report);
+		free(data);
+	}
+	else {
+		MappedFile map;
+		if (!map_file(input, &map)) {
+			printf("CMS: Failed to open file \"%s\"\n", input);
+			return 0;
+		}
+		count = lookup_parse_ids(map.data, map.size, &ids, &capacity, report);
+		unmap_file(&map);
+	}
+	report->requested = (count > 0) ? count : 0;
+
+	int unique = (count > 0) ? lookup_sort_unique(ids, count) : count;
+	if (unique < 0) {
+		free(ids);
+		printf("CMS: Error - Not enough memory to look up the IDs.\n");
+		return 0;
+	}
+	report->duplicates = count - unique;
+
+	FILE* file = fopen(output, "w");
+	if (file == NULL) {
+		free(ids);
+		printf("CMS: Error - Cannot write file \"%s\"\n", output);
+		return 0;
+	}
+	setvbuf(file, NULL, _IOFBF, LOOKUP_BUFFER_SIZE);
+
+	//records in ID order, the IDs that are not found move to the front of ids (never past the one being read)
+	fprintf(file, "ID\tName\tProgramme\tMark\n");
+	for (int i = 0; i < unique; i++) {
+		int slot = db_find_slot(db, ids[i]);
+		if (slot < 0) {
+			ids[report->missing++] = ids[i];
+			continue;
+		}
+		const StoredRecord* record = arena_record(&db->arena, slot);
+		fprintf(file, "%d\t%s\t%s\t%.1f\n", record->id, record->name, slot_programme(db, slot), tenths_to_mark(record->mark_tenths));
+		report->found++;
+	}
+	fprintf(file, "\nMissing IDs: %d\n", report->missing);
+	for (int i = 0; i < report->missing; i++) {
+		fprintf(file, "%d\n", ids[i]);
+	}
+	free(ids);
+
+	int written = !ferror(file);
+	written = (fclose(file) == 0) && written;
+	report->seconds = lookup_clock() - start;
+	if (!written) {
+		printf("CMS: Error - Cannot write file \"%s\"\n", output);
+	}
+	return written;
+}
+
+/*
+* Print what a lookup found
+*/
+void print_lookup_report(const LookupReport* report, const char* output)
+{
+	printf("CMS: Lookup complete: %d ID(s) read, %d repeated, %d invalid line(s), %d found, %d missing, written to \"%s\"\n",
+		report->requested, report->duplicates, report->invalid, report->found, report->missing, output);
+	if (report->seconds > 0) {
+		printf("CMS: %.1f ms, %.0f IDs/s\n", report->seconds * 1000, report->requested / report->seconds);
+	}
+}
@@ -0,0 +1,229 @@
+/*
+* Course Management System (CMS)
+* Mark index - marks are whole tenths (0..1000), so every possible mark gets its own bucket of slots
+* an exact mark is one bucket and a range is a run of buckets: a query touches only the matching records
+* instead of comparing the mark of every record
+* the buckets are built on the first mark query and then kept up to date by cms_store.c,
+* running out of memory drops them and queries scan instead
+* the histogram (records per mark) is kept up to date from the start: counts, percentiles and ranks
+* walk its 1001 entries whatever the size of the database, and top-k uses it to find the lowest mark
+* that makes the cut before touching any record
+*/
+
+#include "cms.h"
+
+/*
+* Release every bucket, the next mark query builds them again, the histogram stays valid
+*/
+void mark_index_drop_buckets(MarkIndex* marks)
+{
+	for (int i = 0; i <= MARK_TENTHS_MAX; i++) {
+		free(marks->buckets[i].slots);
+	}
+	memset(marks->buckets, 0, sizeof(marks->buckets));
+	marks->built = 0;
+}
+
+/*
+* Forget every record (the database is cleared)
+*/
+void mark_index_free(MarkIndex* marks)
+{
+	mark_index_drop_buckets(marks);
+	memset(marks->histogram, 0, sizeof(marks->histogram));
+}
+
+/*
+* Put every record in its bucket, slots are visited in ascending order so every bucket is built by appending
+* returns 1 if the index is ready, 0 if memory ran out
+*/
+int mark_index_build(CMSdb* db)
+{
+	const RecordArena* arena = &db->arena;
+
+	if (db->marks.built) {
+		return 1;
+	}
+	unsigned char* live = (unsigned char*)calloc((size_t)arena->slot_count / 8 + 1, 1);
+	if (live == NULL) {
+		return 0;
+	}
+	for (int i = 0; i < db->record_count; i++) {
+		live[db->order[i] >> 3] |= (unsigned char)(1u << (db->order[i] & 7));
+	}
+	int ok = 1;
+	for (int slot = 0; slot < arena->slot_count && ok; slot++) {
+		if (live[slot >> 3] & (1u << (slot & 7))) {
+			ok = posting_insert(&db->marks.buckets[arena_record(arena, slot)->mark_tenths], slot);
+		}
+	}
+	free(live);
+	if (!ok) {
+		mark_index_drop_buckets(&db->marks);
+		return 0;
+	}
+	db->marks.built = 1;
+	return 1;
+}
+
+/*
+* A record was stored in slot (or got a new mark), does nothing before the index is built
+*/
+void mark_index_add(CMSdb* db, int slot)
+{
+	int tenths = arena_record(&db->arena, slot)->mark_tenths;
+	db->marks.histogram[tenths]++;
+	if (!db->marks.built) {
+		return;
+	}
+	if (!posting_insert(&db->marks.buckets[tenths], slot)) {
+		mark_index_drop_buckets(&db->marks); //an incomplete index would miss records, rebuild it later
+	}
+}
+
+/*
+* The record in slot is removed, or its mark is about to change
+*/
+void mark_index_remove(CMSdb* db, int slot)
+{
+	int tenths = arena_record(&db->arena, slot)->mark_tenths;
+	db->marks.histogram[tenths]--;
+	if (!db->marks.built) {
+		return;
+	}
+	posting_remove(&db->marks.buckets[tenths], slot);
+}
+
+/*
+* Every record with low_tenths <= mark <= high_tenths (both in tenths), in display order
+* stores the display indices in *matches (grown as needed) and returns how many there are, -1 if out of memory
+*/
+int mark_range_query(CMSdb* db, int low_tenths, int high_tenths, int** matches, int* capacity)
+{
+	int* slots = NULL;
+	int slot_capacity = 0;
+	int count = 0;
+
+	if (low_tenths < 0) low_tenths = 0;
+	if (high_tenths > MARK_TENTHS_MAX) high_tenths = MARK_TENTHS_MAX;
+	if (low_tenths > high_tenths || db->record_count == 0) {
+		return 0;
+	}
+
+	if (mark_index_build(db)) {
+		int total = 0;
+		for (int tenths = low_tenths; tenths <= high_tenths; tenths++) {
+			total += db->marks.buckets[tenths].count;
+		}
+		if (total > 0 && !grow_int_array(&slots, &slot_capacity, total)) {
+			return -1;
+		}
+		for (int tenths = low_tenths; tenths <= high_tenths; tenths++) {
+			const PostingList* bucket = &db->marks.buckets[tenths];
+			if (bucket->count > 0) {
+				memcpy(slots + count, bucket->slots, (size_t)bucket->count * sizeof(int));
+				count += bucket->count;
+			}
+		}
+		count = search_display_order(db, slots, count, matches, capacity);
+		free(slots);
+		return count;
+	}
+
+	//no memory for the buckets: compare every record, already in display order
+	for (int i = 0; i < db->record_count; i++) {
+		int tenths = db_record(db, i)->mark_tenths;
+		if (tenths >= low_tenths && tenths <= high_tenths) {
+			if (!grow_int_array(matches, capacity, count + 1)) {
+				return -1;
+			}
+			(*matches)[count++] = i;
+		}
+	}
+	return count;
+}
+
+/*
+* Number of records with low_tenths <= mark <= high_tenths, from the histogram
+*/
+int mark_count_range(const CMSdb* db, int low_tenths, int high_tenths)
+{
+	int count = 0;
+
+	if (low_tenths < 0) low_tenths = 0;
+	if (high_tenths > MARK_TENTHS_MAX) high_tenths = MARK_TENTHS_MAX;
+	for (int tenths = low_tenths; tenths <= high_tenths; tenths++) {
+		count += db->marks.histogram[tenths];
+	}
+	return count;
+}
+
+/*
+* The mark (in tenths) at a percentile given in tenths of a percent (0..1000), nearest-rank method:
+* the lowest mark with at least percent of the records at or below it, so 0 is the lowest mark and 1000 the highest
+* returns -1 if there are no records
+*/
+int mark_percentile(const CMSdb* db, int percent_tenths)
+{
+	if (db->record_count == 0) {
+		return -1;
+	}
+	//rank = ceil(percent * count / 100), at least the first record
+	long long rank = ((long long)percent_tenths * db->record_count + 999) / 1000;
+	if (rank < 1) rank = 1;
+
+	long long seen = 0;
+	for (int tenths = 0; tenths <= MARK_TENTHS_MAX; tenths++) {
+		seen += db->marks.histogram[tenths];
+		if (seen >= rank) {
+			return tenths;
+		}
+	}
+	return MARK_TENTHS_MAX;
+}
+
+/*
+* The k records with the highest marks, highest first and equal marks by ascending ID
+* the histogram gives the lowest mark that makes the cut, so only records at or above it are collected
+* (from the buckets, or one pass over the records without them) and sorted, the rest of the database is never ordered
+* stores the arena slots in *slots (grown as needed) and returns how many there are (k or fewer), -1 if out of memory
+*/
+int mark_top_k(CMSdb* db, int k, int** slots, int* capacity)
+{
+	if (k > db->record_count) k = db->record_count;
+	if (k <= 0) {
+		return 0;
+	}
+
+	int cutoff = MARK_TENTHS_MAX;
+	int candidates = db->marks.histogram[cutoff];
+	while (candidates < k && cutoff > 0) {
+		candidates += db->marks.histogram[--cutoff];
+	}
+	if (!grow_int_array(slots, capacity, candidates)) {
+		return -1;
+	}
+
+	int count = 0;
+	if (mark_index_build(db)) {
+		for (int tenths = MARK_TENTHS_MAX; tenths >= cutoff; tenths--) {
+			const PostingList* bucket = &db->marks.buckets[tenths];
+			if (bucket->count > 0) {
+				memcpy(*slots + count, bucket->slots, (size_t)bucket->count * sizeof(int));
+				count += bucket->count;
+			}
+		}
+	}
+	else {
+		//no memory for the buckets: one pass over the records
+		for (int i = 0; i < db->record_count; i++) {
+			if (arena_record(&db->arena, db->order[i])->mark_tenths >= cutoff) {
+				(*slots)[count++] = db->order[i];
+			}
+		}
+	}
+
+	//candidates holds k records plus the ones tied with the last of them
+	sort_slots_qsort(&db->arena, *slots, count, SORT_KEY_MARK, 1);
+	return k;
+}
@@ -0,0 +1,218 @@
+/*
+* Course Management System (CMS)
+* Merge - adds the records of a second CMS file to the open database
+* the file is streamed line by line (scan_records) and joined on student ID through the ID index,
+* so every row costs one hash lookup and one insert or update, whatever the size of the database
+* (binary files are loaded into a temporary database first and joined from there)
+*
+* policies: MERGE_INSERT_ONLY adds new IDs and keeps existing records as they are,
+* MERGE_UPSERT also gives existing records the file's values,
+* MERGE_REPLACE also deletes the records whose ID is not in the file (the database ends up as the file),
+* but only when every row of the file is valid: a wrong path to a header-only file or a file of rejected rows
+* would otherwise delete the whole database; MERGE_REPLACE_FORCED deletes anyway
+* every change goes to the change log and the save tracker like a menu change, a merge cannot be undone
+*/
+
+#include "cms.h"
+#include <time.h>
+
+#define MERGE_MIN_LINE_BYTES 16 //"1234567\ta\tb\t1\n", used to guess the number of rows before reading them
+
+typedef struct {
+	CMSdb* db;
+	int policy; //MERGE_*
+	MergeReport* report;
+	unsigned char* seen; //MERGE_REPLACE: slots (of the records there before the merge) found in the file
+	int slot_limit; //slots covered by seen
+} MergeRun;
+
+static void merge_mark_seen(MergeRun* merge, int slot)
+{
+	if (merge->seen != NULL && slot < merge->slot_limit) {
+		merge->seen[slot >> 3] |= (unsigned char)(1u << (slot & 7));
+	}
+}
+
+/*
+* Join one row of the file with the database
+* returns 0 if merging has to stop (out of memory)
+*/
+static int merge_record(void* context, const StudentRecord* record, int line_number)
+{
+	MergeRun* merge = (MergeRun*)context;
+	CMSdb* db = merge->db;
+	int slot = db_find_slot(db, record->id);
+
+	if (slot < 0) {
+		if (db_append_record(db, record) != 1) {
+			printf("CMS: Error - Out of memory on line %d, stopped merging\n", line_number);
+			return 0;
+		}
+		//appended at the end, unless a sorted view is shown and placed it by its key (the log replays that position)
+		slot = db_find_slot(db, record->id);
+		wal_log_insert(db, sort_view_is_keyed(db->views.shown) ? sort_view_index_of_slot(db, slot) : db->record_count - 1, record);
+		merge_mark_seen(merge, slot); //a reused slot of a deleted record
+		merge->report->inserted++;
+		return 1;
+	}
+
+	merge_mark_seen(merge, slot);
+	if (merge->policy == MERGE_INSERT_ONLY) {
+		merge->report->skipped++;
+		return 1;
+	}
+	//rows that match the database are not written again (nothing for the change log or the next save)
+	const StoredRecord* stored = arena_record(&db->arena, slot);
+	if (stored->mark_tenths == mark_to_tenths(record->mark) && strcmp(stored->name, record->name) == 0 &&
+		strcmp(slot_programme(db, slot), record->programme) == 0) {
+		merge->report->unchanged++;
+		return 1;
+	}
+	if (!db_update_record(db, slot, record)) {
+		printf("CMS: Error - Out of memory on line %d, stopped merging\n", line_number);
+		return 0;
+	}
+	wal_log_update(db, record);
+	merge->report->updated++;
+	return 1;
+}
+
+/*
+* MERGE_REPLACE: delete every record that was in the database before and is not in the file
+*/
+static void merge_delete_unseen(MergeRun* merge)
+{
+	CMSdb* db = merge->db;
+	unsigned char* marked = (unsigned char*)calloc((size_t)db->arena.slot_count / 8 + 1, 1);
+	if (marked == NULL) {
+		printf("CMS: Error - Not enough memory to delete the records missing from the file.\n");
+		return;
+	}
+	for (int i = 0; i < db->record_count; i++) {
+		int slot = db->order[i];
+		if (slot < merge->slot_limit && !(merge->seen[slot >> 3] & (1u << (slot & 7)))) {
+			marked[slot >> 3] |= (unsigned char)(1u << (slot & 7));
+			wal_log_delete(db, arena_record(&db->arena, slot)->id);
+			merge->report->deleted++;
+		}
+	}
+	if (merge->report->deleted > 0) {
+		db_remove_marked(db, marked);
+	}
+	free(marked);
+}
+
+static double merge_clock(void)
+{
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/*
+* Merge the CMS file filename (text or binary) into the open database with policy (MERGE_*)
+* fills *report, returns 1 if the whole file was merged, 0 if it cannot be read or memory ran out
+* (the rows before that point stay merged), or if MERGE_REPLACE refused to delete (the rows stay merged)
+*/
+int merge_file_path(CMSdb* db, const char* filename, int policy, MergeReport* report)
+{
+	MappedFile map;
+	LoadStats stats;
+	MergeRun merge = { db, policy, report, NULL, 0 };
+	int finished = 1;
+
+	memset(report, 0, sizeof(*report));
+	memset(&stats, 0, sizeof(stats));
+	if (!map_file(filename, &map)) {
+		printf("CMS: Failed to open file \"%s\"\n", filename);
+		return 0;
+	}
+	if (policy >= MERGE_REPLACE) {
+		merge.slot_limit = db->arena.slot_count;
+		merge.seen = (unsigned char*)calloc((size_t)merge.slot_limit / 8 + 1, 1);
+		if (merge.seen == NULL) {
+			unmap_file(&map);
+			printf("CMS: Error - Not enough memory to merge.\n");
+			return 0;
+		}
+	}
+
+	double start = merge_clock();
+	int binary = is_binary_cms(map.data, map.size);
+	db_begin_changes(db, binary ? (int)(map.size / sizeof(StoredRecord)) : (int)(map.size / MERGE_MIN_LINE_BYTES));
+	if (binary) {
+		CMSdb source;
+		initialize_db_with_options(&source, &db->options);
+		finished = load_binary_records(&source, map.data, map.size, &stats);
+		for (int i = 0; i < source.record_count && finished; i++) {
+			StudentRecord record;
+			db_get_record(&source, source.order[i], &record);
+			finished = merge_record(&merge, &record, i + 1);
+		}
+		free_db(&source);
+	}
+	else {
+		finished = scan_records(map.data, map.size, merge_record, &merge, &stats);
+	}
+	unmap_file(&map);
+
+	//a file that stopped part way does not say which records are missing, nothing is deleted then
+	int loaded = stats.data_lines_loaded;
+	int rejected = stats.data_lines_found - loaded;
+	if (policy == MERGE_REPLACE && finished && (loaded == 0 || rejected > 0)) {
+		report->refused = 1;
+		finished = 0;
+		if (loaded == 0) {
+			printf("CMS: \"%s\" has no valid rows, no record is deleted.\n", filename);
+		}
+		else {
+			printf("CMS: %d row(s) of \"%s\" were rejected, no record is deleted.\n", rejected, filename);
+		}
+	}
+	else if (policy >= MERGE_REPLACE && finished) {
+		merge_delete_unseen(&merge);
+	}
+	db_end_changes(db);
+	free(merge.seen);
+
+	report->rows = stats.data_lines_found;
+	report->rejected = stats.data_lines_found - stats.data_lines_loaded;
+	report->seconds = merge_clock() - start;
+
+	//undo entries find their record by ID, after a merge they could undo the merge's changes half way
+	undo_journal_clear(&db->undo);
+	return finished;
+}
+
+/*
+* Name of a merge policy, for messages
+*/
+const char* merge_policy_name(int policy)
+{
+	switch (policy) {
+	case MERGE_INSERT_ONLY: return "insert only";
+	case MERGE_UPSERT: return "upsert";
+	case MERGE_REPLACE: return "replace";
+	default: return "forced replace";
+	}
+}
+
+/*
+* Print what a merge did
+*/
+void print_merge_report(const MergeReport* report, int policy)
+{
+	printf("CMS: Merge (%s) complete: %d row(s) read, %d inserted, %d updated, %d unchanged, %d skipped, %d rejected",
+		merge_policy_name(policy), report->rows, report->inserted, report->updated, report->unchanged,
+		report->skipped, report->rejected);
+	if (report->refused) {
+		printf(", nothing deleted");
+	}
+	else if (policy >= MERGE_REPLACE) {
+		printf(", %d deleted", report->deleted);
+	}
+	printf("\n");
+	if (report->seconds > 0) {
+		printf("CMS: %.1f ms, %.0f rows/s\n", report->seconds * 1000, report->rows / report->seconds);
+	}
+}
@@ -5,6 +5,7 @@
 */
 
 #include "cms.h"
+#include <math.h>
 
 /*
 * clear input buffer
@@ -78,45 +79,102 @@ int get_valid_student_id(void)
 	return id;
 }
 
+/*
+* Default settings used when nothing is given on the command line
+*/
+void default_options(CMSOptions* options) {
+	options->id_index_mode = ID_INDEX_HASH;
+	options->thread_count = 0; //one per CPU
+	options->wal_enabled = 0; //changes are only written by save_file
+	options->wal_sync_every = WAL_DEFAULT_SYNC_EVERY;
+	options->undo_limit = UNDO_DEFAULT_LIMIT;
+	options->search_mode = SEARCH_MODE_TRIGRAM;
+	options->batch_file = NULL; //interactive menu
+	options->table_layout = TABLE_LAYOUT_AUTO; //aligned on a terminal, tabs when redirected
+	options->page_size = DEFAULT_PAGE_SIZE; //long listings stop after every page on a terminal
+}
+
+/*
+* Number of threads to use for parallel work
+*/
+int worker_thread_count(const CMSOptions* options) {
+	return (options->thread_count > 0) ? options->thread_count : cpu_count();
+}
+
 /*
 * Initialize database with default values
 */
 void initialize_db(CMSdb* db) {
+	CMSOptions options;
+	default_options(&options);
+	initialize_db_with_options(db, &options);
+}
+
+/*
+* Initialize database with the given settings
+*/
+void initialize_db_with_options(CMSdb* db, const CMSOptions* options) {
 	//null pointer check
-	if (db == NULL) {
+	if (db == NULL || options == NULL) {
 		return;
 	}
 
+	db->options = *options;
+	memset(&db->arena, 0, sizeof(db->arena)); //no chunks allocated until the first record
+	id_index_init(&db->id_index, options->id_index_mode); //index memory allocated on first insert
+	db->order = NULL;
+	db->order_capacity = 0;
 	db->record_count = 0;			//start with no records
 	db->is_open = 0;				//database is not opened yet flag
 	strcpy_s(db->current_filename, sizeof(db->current_filename),""); //No current file
+	db->file_format = FILE_FORMAT_TEXT;
+	db->wal.file = NULL; //log opened together with a file
+	db->wal.pending = 0;
+	db->wal.deferred = 0;
+	memset(&db->save_tracker, 0, sizeof(db->save_tracker)); //nothing to track until a file is opened
+	memset(&db->programmes, 0, sizeof(db->programmes)); //grows with the first record
+	search_index_init(&db->search); //built by the first query that can use it
+	memset(&db->marks, 0, sizeof(db->marks)); //built by the first mark query
+	memset(&db->stats, 0, sizeof(db->stats)); //grows with the programme dictionary
+	memset(&db->views, 0, sizeof(db->views)); //insertion order shown, sorted views built by the sort menu
+
+	undo_journal_init(&db->undo, options->undo_limit); //journal memory allocated on the first change
 }
 
-//check for header lines
-int is_header_line(const char* line) 
-{
-	// Common header patterns
-	if (strstr(line, "ID") != NULL &&
-		(strstr(line, "Name") != NULL || strstr(line, "NAME") != NULL)) {
-		return 1;
+/*
+* Release all memory held by the database
+*/
+void free_db(CMSdb* db) {
+	if (db == NULL) {
+		return;
 	}
 
-	// Lines starting with non-digits are likely headers
-	if (!isdigit(line[0])) {
-		return 1;
-	}
+	wal_close(db); //unsaved changes stay in the log for the next open
+	arena_free(&db->arena);
+	id_index_free(&db->id_index);
+	free(db->order);
+	undo_journal_free(&db->undo);
+	tracker_free(db);
+	programme_dictionary_free(&db->programmes);
+	search_index_free(&db->search);
+	mark_index_free(&db->marks);
+	group_stats_free(&db->stats);
+	sort_views_free(&db->views);
+	CMSOptions options = db->options;
+	initialize_db_with_options(db, &options);
+}
 
-	return 0;
+//check for header lines
+int is_header_line(const char* line) 
+{
+	// Lines starting with non-digits or containing "ID" and "Name" are headers
+	return is_header_span(line, strlen(line));
 }
 /*
 * Parse student record from line
 */
 int parse_student_record(const char* line, StudentRecord* record) {
-	int parsed = sscanf_s(line, "%d %49[^\t] %49[^\t] %f",
-		&record->id,
-		record->name, (rsize_t)sizeof(record->name),
-		record->programme, (rsize_t)sizeof(record->programme),
-		&record->mark);
+	int parsed = parse_record_span(line, strcspn(line, "\r\n"), record);
 
 	if (parsed != 4) {
 		// Tab-separated failed - this format is required
@@ -129,64 +187,87 @@ int parse_student_record(const char* line, StudentRecord* record) {
 * Valid Student Record
 */
 int valid_student_record(const StudentRecord* record) {
+	return check_student_record(record, 1);
+}
+
+/*
+* Check a record, print_errors = 0 checks silently (used by the loader worker threads)
+*/
+int check_student_record(const StudentRecord* record, int print_errors) {
 	int valid = 1;
 
 	// Validate ID 
 	if (record->id < MIN_VALID_ID || record->id > MAX_VALID_ID) 
 	{
-		printf("  - Invalid ID: %d (must be 7 digits between %d-%d)\n",
+		if (print_errors) printf("  - Invalid ID: %d (must be 7 digits between %d-%d)\n",
 			record->id, MIN_VALID_ID, MAX_VALID_ID);
 		valid = 0;
 	}
 
 	// Validate Name
 	if (strlen(record->name) == 0) {
-		printf("  - Name cannot be empty\n");
+		if (print_errors) printf("  - Name cannot be empty\n");
 		valid = 0;
 	}
 	else if (strlen(record->name) > MAX_NAME_LENGTH) {
-		printf("  - Name too long: '%s' (%zu characters, max %d)\n",
+		if (print_errors) printf("  - Name too long: '%s' (%zu characters, max %d)\n",
 			record->name, strlen(record->name), MAX_NAME_LENGTH);
 		valid = 0;
 	}
 
 	// Validate programme
 	if (strlen(record->programme) == 0) {
-		printf("  - Programme cannot be empty\n");
+		if (print_errors) printf("  - Programme cannot be empty\n");
 		valid = 0;
 	}
 	else if (strlen(record->programme) > MAX_PROGRAMME_LENGTH) {
-		printf("  - Programme too long: '%s' (%zu characters, max %d)\n",
+		if (print_errors) printf("  - Programme too long: '%s' (%zu characters, max %d)\n",
 			record->programme, strlen(record->programme), MAX_PROGRAMME_LENGTH);
 		valid = 0;
 	}
 
 	// Validate mark (0-100 range)
 	if (record->mark < 0 || record->mark > 100) {
-		printf("  - Invalid mark: %.1f (must be between 0-100)\n", record->mark);
+		if (print_errors) printf("  - Invalid mark: %.1f (must be between 0-100)\n", record->mark);
 		valid = 0;
 	}
 
 	return valid;
 }
 int detect_file_format(const char* filename) {
-	FILE* test_file = fopen(filename, "r");
-	if (!test_file) return 0;
+	MappedFile map;
+	if (!map_file(filename, &map)) return 0;
+
+	//the first 5 data lines are always near the start, no need to look at the whole file
+	size_t length = (map.size < DETECT_FORMAT_SCAN_BYTES) ? map.size : DETECT_FORMAT_SCAN_BYTES;
+	unsigned int* offsets = (unsigned int*)malloc((length + 1) * sizeof(unsigned int));
+	if (offsets == NULL) {
+		unmap_file(&map);
+		return 0;
+	}
+	size_t count = scan_delimiters(map.data, length, offsets);
 
-	char line[256];
 	int tab_count = 0;
 	int data_lines = 0;
+	int line_tabs = 0;
+	size_t line_start = 0;
 
-	while (fgets(line, sizeof(line), test_file) && data_lines < 5) {
-		if (is_header_line(line)) continue;
-
+	for (size_t k = 0; k <= count && data_lines < 5; k++) {
 		// Count tabs in potential data lines
-		for (int i = 0; line[i]; i++) {
-			if (line[i] == '\t') tab_count++;
+		if (k < count && map.data[offsets[k]] == '\t') {
+			line_tabs++;
+			continue;
+		}
+		size_t line_end = (k < count) ? offsets[k] : length;
+		if (!is_header_span(map.data + line_start, line_end - line_start)) {
+			tab_count += line_tabs;
+			data_lines++;
 		}
-		data_lines++;
+		line_start = line_end + 1;
+		line_tabs = 0;
 	}
-	fclose(test_file);
+	free(offsets);
+	unmap_file(&map);
 
 	// If we found data lines with 3 tabs, format is good
 	return (data_lines > 0 && tab_count >= data_lines * 3);
@@ -214,22 +295,6 @@ void sanitize_input_fields(StudentRecord* record) {
 		str[end - start + 1] = '\0';
 	}
 }
-/*
-* Undo File
-*/
-void save_undo_state(CMSdb* db, const char* operation)
-{
-	// Copy all records to backup_record array (not a single struct)
-	for (int i = 0; i < db->record_count; i++)
-	{
-		db->undo.backup_record[i] = db->records[i];
-
-	}
-	db->undo.backup_count = db->record_count;
-	db->undo.can_undo = 1;
-	strcpy_s(db->undo.last_operation, sizeof(db->undo.last_operation), operation);
-}
-
 /*
 * Display the main menu to user
 * shows all available options
@@ -246,6 +311,8 @@ void show_menu(void) {
 	printf("8. Undo\n");
 	printf("9. Save File\n");
 	printf("10. Exit\n");
+	printf("11. Redo\n");
+	printf("12. Merge File\n");
 }
 
 /*
@@ -274,6 +341,11 @@ int handle_menu_choice(int choice, CMSdb* db) {
 	case 10: // Exit
 		printf("Exiting CMS\n");
 		return -1; // Special return value to exit program
+	//options added later are numbered after Exit, so 1-10 keep their original meaning
+	case 11: // Redo what undo reverted
+		return redo_last_operation(db);
+	case 12: // Merge a second file into the database
+		return merge_file(db);
 
 	default:
 		printf("Invalid choice. Please try again.\n");
@@ -291,99 +363,55 @@ int open_file(CMSdb* db) {
 
 	char filename[MAX_FILENAME_LENGTH];
 	get_string_input(filename, sizeof(filename), "Enter filename to open: ");
+	return open_file_path(db, filename);
+}
 
+/*
+* Load a database file without prompting
+* the file is memory mapped, binary files (CMS_BINARY_MAGIC) are copied out column by column,
+* text files are parsed in place by load_records
+*/
+int open_file_path(CMSdb* db, const char* filename) {
 	//Try to open the file
-	FILE* file = fopen(filename, "r");
-	if (file == NULL) {
-		printf("DEBUG: fopen failed! Error: ");
+	MappedFile map;
+	if (!map_file(filename, &map)) {
+		printf("DEBUG: open failed! Error: ");
 		perror("");
 		printf("CMS: Failed to open file \"%s\"\n", filename);
 		return 0;
 	}
 
 	//reset database before loading new data
-	db->record_count = 0;
-
-	char line[MAX_LINE_LENGTH];
-	int line_number = 0;
-	int data_lines_found = 0;
-	int data_lines_loaded = 0;
-	int header_lines_skipped = 0;
-	printf("CMS: Reading file \"%s\"...\n", filename);
-
-
-	// Read file line by line
-	while (fgets(line, sizeof(line), file) != NULL && db->record_count < MAX_RECORDS)
-	{
-		line_number++;
-
-
-		//remove newline char
-		line[strcspn(line, "\n")] = 0;
-
-
-		// Skip empty lines
-		if (strlen(line) == 0) {
-			continue;
-		}
-		//Detect and Skip header lines
-		if (is_header_line(line))
-		{
-			printf("CMS: Skipping Header Lines %d: %s\n", line_number, line);
-			header_lines_skipped++;
-			continue;
-		}
-
-		//Parse student records (lines that start with numbers)
-		StudentRecord* record = &db->records[db->record_count];
-
-		int parsed = sscanf_s(line, "%d %49[^\t] %49[^\t] %f",
-			&record->id,
-			record->name, (rsize_t)sizeof(record->name),
-			record->programme, (rsize_t)sizeof(record->programme),
-			&record->mark);
-
-		if (parsed == 4) { //if all fields were parsed
-			//validate parsed data
-			if (valid_student_record(record))
-			{
-				//duplicate check
-				int is_duplicate = 0;
-				for (int i = 0; i < db->record_count; i++) {
-					if (db->records[i].id == record->id) {
-						printf("CMS: Warning - Duplicate ID %d on line %d, skipping\n", record->id, line_number);
-						is_duplicate = 1;
-						break;
-					}
-				}
-				if (is_duplicate) {
-					continue; // Skip this duplicate record
-				}
-				db->record_count++;
-				data_lines_loaded++;
-			}
-
-			else
-			{
-				printf("CMS: Invalid Data on Line %d: %s\n", line_number, line);
-			}
-		}
-		else
-		{
-			printf("CMS: Could not parse line %d (Needs 4 fields of data, found %d): %s\n", line_number, parsed, line);
+	db_clear_records(db);
+
+	LoadStats stats;
+	int format = is_binary_cms(map.data, map.size) ? FILE_FORMAT_BINARY : FILE_FORMAT_TEXT;
+	if (format == FILE_FORMAT_BINARY) {
+		printf("CMS: Reading binary file \"%s\"...\n", filename);
+		if (!load_binary_records(db, map.data, map.size, &stats)) {
+			unmap_file(&map);
+			printf("CMS: Failed to open file \"%s\"\n", filename);
+			return 0;
 		}
-		data_lines_found++;
-
 	}
-	fclose(file);
+	else {
+		printf("CMS: Reading file \"%s\"...\n", filename);
+		load_records_parallel(db, map.data, map.size, worker_thread_count(&db->options), &stats);
+	}
+	unmap_file(&map);
+
 	//file parse stats
 	printf("CMS: File processing complete:\n");
-	printf("  - Lines processed: %d\n", line_number);
-	printf("  - Header lines skipped: %d\n", header_lines_skipped);
-	printf("  - Data lines found: %d\n", data_lines_found);
-	printf("  - Valid records loaded: %d\n", data_lines_loaded);
+	printf("  - Lines processed: %d\n", stats.line_number);
+	printf("  - Header lines skipped: %d\n", stats.header_lines_skipped);
+	printf("  - Data lines found: %d\n", stats.data_lines_found);
+	printf("  - Valid records loaded: %d\n", stats.data_lines_loaded);
+	//the records now match the file, changes replayed from the log count as unsaved
+	tracker_start(db, format);
+	//changes made after the last save are kept in the change log
+	wal_replay(db, filename);
 	//empty file detection
-	if (data_lines_found == 0) {
+	if (stats.data_lines_found == 0) {
 		printf("CMS: Error - No data records found in file\n");
 		printf("CMS: File may be empty or contain only headers\n");
 		return 0;
@@ -392,9 +420,18 @@ int open_file(CMSdb* db) {
 	if (db->record_count > 0) 
 	{
 		db->is_open = 1;
+		db->file_format = format;
 		strcpy_s(db->current_filename, sizeof(db->current_filename), filename);
 		printf("CMS: Successfully opened file \"%s\" is successfully opened\n", filename);
 		printf("Loaded %d student records\n", db->record_count);
+		if (db->options.wal_enabled) {
+			if (wal_open(db)) {
+				printf("CMS: Changes are logged to \"%s.wal\" as they are made, Save File compacts the log.\n", filename);
+			}
+			else {
+				printf("CMS: Warning - Cannot open the change log, changes are only kept by Save File.\n");
+			}
+		}
 		return 1;
 	}
 	else {
@@ -402,6 +439,54 @@ int open_file(CMSdb* db) {
 		return 0;
 	}
 }
+/*
+* Merge a second CMS file (text or binary) into the open database
+* records are joined on student ID, the policy decides what happens to IDs already in the database
+*/
+int merge_file(CMSdb* db) {
+	if (!db->is_open) {
+		printf("CMS: No database is currently opened.\n");
+		return 0;
+	}
+
+	char filename[MAX_FILENAME_LENGTH];
+	get_string_input(filename, sizeof(filename), "Enter filename to merge: ");
+
+	printf("1. Insert Only (records already in the database are kept)\n");
+	printf("2. Upsert (records already in the database take the file's values)\n");
+	printf("3. Replace (upsert, then delete the records that are not in the file)\n");
+	printf("4. Replace even if rows of the file are rejected or none is valid\n");
+	char choice_input[4];
+	get_string_input(choice_input, sizeof(choice_input), "Please enter your choice (1-4): ");
+	if (strlen(choice_input) != 1 || choice_input[0] < '1' || choice_input[0] > '4') {
+		printf("CMS: Invalid choice. The merge is cancelled.\n");
+		return 0;
+	}
+	int policy = MERGE_INSERT_ONLY + (choice_input[0] - '1');
+
+	if (policy >= MERGE_REPLACE) {
+		printf("Records whose ID is not in \"%s\" will be deleted. Continue? (Y/N): ", filename);
+		char confirmation;
+		scanf(" %c", &confirmation);  // Space before %c skips whitespace
+		clear_input_buffer();
+		if (confirmation != 'Y' && confirmation != 'y') {
+			printf("CMS: The merge is cancelled.\n");
+			return 0;
+		}
+	}
+
+	MergeReport report;
+	int merged = merge_file_path(db, filename, policy, &report);
+	if (report.rows > 0 || merged) {
+		print_merge_report(&report, policy);
+		printf("CMS: A merge cannot be undone, Save File writes it to \"%s\".\n", db->current_filename);
+	}
+	if (report.refused) {
+		printf("CMS: Merge again with option 4 to delete the records that are not in the file anyway.\n");
+	}
+	return merged;
+}
+
 /*
 * Show all records in the database - PLACEHOLDER
 */
@@ -417,18 +502,8 @@ int show_all_records(const CMSdb* db) {
 	//use predefined display widths to seperate columns
 	printf("P7_7L SHOW ALL\n");
 	printf("CMS: Here are all the records found in the table \"StudentRecords\".\n\n");
-	printf("%-*s %-*s %-*s %s\n", //ensure its all left justified
-		DISPLAY_ID_WIDTH, "ID",
-		DISPLAY_NAME_WIDTH, "Name",
-		DISPLAY_PROGRAMME_WIDTH, "Programme",
-		"Mark");
-	for (int i = 0; i < db->record_count; i++) {
-		printf("%-*d %-*s %-*s %.1f\n",
-			DISPLAY_ID_WIDTH, db->records[i].id,
-			DISPLAY_NAME_WIDTH, db->records[i].name,
-			DISPLAY_PROGRAMME_WIDTH, db->records[i].programme,
-			db->records[i].mark);
-	}
+	//one page at a time on a terminal (cms_cursor.c), rows are written in large blocks (cms_render.c)
+	browse_records(db, NULL, db->record_count);
 	return 1;
 }
 /*
@@ -440,17 +515,10 @@ int insert_record(CMSdb* db) {
 		printf("CMS: No database is currently opened.\n");
 		return 0;
 	}
-	save_undo_state(db, "INSERT");
-	// check whether the database has reached the maximum record limit and call MAX_RECORDS function from cms.h
-	if (db->record_count >= MAX_RECORDS) {
-		printf("CMS: Database is full. Cannot insert more records.\n");
-		db->undo.can_undo = 0;
-		return 0;
-	}
-
 	char buffer[100]; // temporarily store users' input
 	int newID;
-	StudentRecord* record = &db->records[db->record_count];
+	StudentRecord new_record; // filled in below, then copied into the record store
+	StudentRecord* record = &new_record;
 
 	// Input Student ID
 	while (1) {
@@ -487,16 +555,10 @@ int insert_record(CMSdb* db) {
 		newID = atoi(buffer);
 
 		// Check if ID already exists
-		int exists = 0;
-		for (int i = 0; i < db->record_count; i++) {
-			if (db->records[i].id == newID) {
-				printf("Error: Student ID already exists.\n");
-				exists = 1;
-				break;
-			}
+		if (db_contains_id(db, newID)) {
+			printf("Error: Student ID already exists.\n");
+			continue; // if user input ID already exists, go back and re-enter ID again
 		}
-		// if user input ID already exists, go back and re-enter ID again
-		if (exists) continue;
 
 		record->id = newID;
 		break;
@@ -622,13 +684,21 @@ int insert_record(CMSdb* db) {
 		record->mark = mark;
 		valid_mark = 1;
 	}
-	db->record_count++;
+	// store grows on demand, only fails when out of memory
+	if (db_append_record(db, record) != 1) {
+		printf("CMS: Out of memory. Cannot insert more records.\n");
+		return 0;
+	}
+	//appended at the end, unless a sorted view is shown and placed it by its key
+	int index = sort_view_is_keyed(db->views.shown) ? db_index_of_slot(db, db_find_slot(db, record->id)) : db->record_count - 1;
+	undo_record_insert(db, index, record);
+	wal_log_insert(db, index, record);
 	printf("CMS: You can see UNDO (Option 8) to revert this insertion if needed.\n");
 	return 1;
 }
 	//Query a Record
 
-	int query_record(const CMSdb* db) { 
+	int query_record(CMSdb* db) { 
 		//handle error if they try to query without opened database
 		if (!db->is_open) {
 			printf("CMS:Error, No database is currently opened.\n");
@@ -646,19 +716,27 @@ int insert_record(CMSdb* db) {
 			printf("2. Query by Name\n");
 			printf("3. Query by Programme\n");
 			printf("4. Query by Mark\n");
-			printf("5. Return to Main Menu\n");
+			printf("5. Query by Mark Range\n");
+			printf("6. Top Students by Mark\n");
+			printf("7. Mark at Percentile\n");
+			printf("8. Rank of a Student\n");
+			printf("9. Statistics by Programme\n");
+			printf("10. Look Up IDs from a File\n");
+			printf("11. Return to Main Menu\n");
 
 			char query_choice_input[4];
-			get_string_input(query_choice_input, sizeof(query_choice_input), "Enter your choice (1-5): ");
+			get_string_input(query_choice_input, sizeof(query_choice_input), "Enter your choice (1-11): ");
 
-			//ensure it only accepts 1 input and it must be a digit
-			if (strlen(query_choice_input) != 1 || !isdigit(query_choice_input[0]))
+			//ensure it only accepts 1 or 2 digits
+			size_t choice_length = strlen(query_choice_input);
+			if (choice_length < 1 || choice_length > 2 || !isdigit((unsigned char)query_choice_input[0]) ||
+				(choice_length == 2 && !isdigit((unsigned char)query_choice_input[1])))
 			{
 				printf("Invalid Input. Please enter exactly one number between %d-%d.\n", QUERY_CHOICES_MIN, QUERY_CHOICES_MAX);
 				continue;
 			}
 
-			int query_choice = query_choice_input[0] - '0'; //convert to int
+			int query_choice = atoi(query_choice_input);
 			if (query_choice < QUERY_CHOICES_MIN || query_choice > QUERY_CHOICES_MAX)
 			{
 				printf("Invalid Choice. Enter a number between %d-%d\n", QUERY_CHOICES_MIN, QUERY_CHOICES_MAX);
@@ -680,6 +758,24 @@ int insert_record(CMSdb* db) {
 					query_by_mark(db);
 					break;
 				case 5:
+					query_by_mark_range(db);
+					break;
+				case 6:
+					query_top_marks(db);
+					break;
+				case 7:
+					query_mark_percentile(db);
+					break;
+				case 8:
+					query_mark_rank(db);
+					break;
+				case 9:
+					query_programme_stats(db);
+					break;
+				case 10:
+					query_id_file(db);
+					break;
+				case 11:
 					printf("Returning to Main Menu.\n");
 					return 1;
 
@@ -695,30 +791,28 @@ int insert_record(CMSdb* db) {
 		printf("\n=== Query By ID===\n");
 		int search_id = get_valid_student_id();
 
-		// Search for student
-		int found_id = 0;
-		for (int i = 0; i < db->record_count; i++) {
-			if (db->records[i].id == search_id) {
-				printf("CMS: The record with ID=%d is found in the data table.\n", search_id);
-				printf("%-*s %-*s %-*s %s\n",
-					DISPLAY_ID_WIDTH, "ID",
-					DISPLAY_NAME_WIDTH, "Name",
-					DISPLAY_PROGRAMME_WIDTH, "Programme",
-					"Mark");
-				printf("%-*d %-*s %-*s %.1f\n",
-					DISPLAY_ID_WIDTH, db->records[i].id,
-					DISPLAY_NAME_WIDTH, db->records[i].name,
-					DISPLAY_PROGRAMME_WIDTH, db->records[i].programme,
-					db->records[i].mark);
-				found_id = 1;
-				break; //only one record to have unique ID
-			}
+		// Search for student through the ID index
+		int slot = db_find_slot(db, search_id);
+		if (slot >= 0) {
+			printf("CMS: The record with ID=%d is found in the data table.\n", search_id);
+			TableWriter table;
+			table_begin(&table, db->options.table_layout, 0);
+			table_slot(&table, db, slot);
+			table_end(&table);
 		}
-		if (!found_id) {
+		else {
 			printf("CMS: The record with ID=%d does not exist.\n", search_id);
 		}
 	}
-	void query_by_name(const CMSdb* db)
+	/*
+	* Print the records at the display positions in matches as a table, page by page on a terminal
+	*/
+	void print_query_matches(const CMSdb* db, const int* matches, int count)
+	{
+		browse_records(db, matches, count);
+	}
+
+	void query_by_name(CMSdb* db)
 	{
 		printf("\n=== Query By Name===\n");
 		char search_name[MAX_NAME_LENGTH]; //40char include null char
@@ -731,119 +825,68 @@ int insert_record(CMSdb* db) {
 			return;
 		}
 
-		//create deep copy and convert to lowercase to not affect original data
-		char search_lower[MAX_NAME_LENGTH];
-		strcpy_s(search_lower, sizeof(search_lower), search_name);
-		for (int i = 0; search_lower[i]; i++) {
-			search_lower[i] = tolower(search_lower[i]);
-		}
-
-		int found = 0;
-		for (int i = 0; i < db->record_count; i++)
+		//case-insensitive match on the lowercase name column, through the trigram index when possible (cms_search.c)
+		int* matches = NULL;
+		int capacity = 0;
+		int found = search_records(db, SEARCH_FIELD_NAME, search_name, &matches, &capacity);
+		if (found < 0)
 		{
-			char current_lower[MAX_NAME_LENGTH];
-			strcpy_s(current_lower, sizeof(current_lower), db->records[i].name);
-			//create copy of current record and convert to lowercase
-			for (int j = 0; current_lower[j]; j++)
-			{
-				current_lower[j] = tolower(current_lower[j]);
-			}
-			//match programmes
-			if (strstr(current_lower, search_lower) != NULL)
-			{
-				if (!found) 
-				{
-					printf("CMS: Records matching name \"%s\" found:\n", search_name);
-					printf("%-*s %-*s %-*s %s\n",
-						DISPLAY_ID_WIDTH, "ID",
-						DISPLAY_NAME_WIDTH, "Name",
-						DISPLAY_PROGRAMME_WIDTH, "Programme",
-						"Mark");
-					found = 1;
-				}
-				printf("%-*d %-*s %-*s %.1f\n",
-					DISPLAY_ID_WIDTH, db->records[i].id,
-					DISPLAY_NAME_WIDTH, db->records[i].name,
-					DISPLAY_PROGRAMME_WIDTH, db->records[i].programme,
-					db->records[i].mark);
-			}
+			printf("CMS: Error - Not enough memory to search.\n");
 		}
-
-		if (!found) 
+		else if (found == 0)
 		{
 			printf("CMS: No records found matching name \"%s\".\n", search_name);
 		}
 		else 
 		{
+			printf("CMS: Records matching name \"%s\" found:\n", search_name);
+			print_query_matches(db, matches, found);
 			printf("\nTotal records found: %d\n", found);
 		}
+		free(matches);
 	}
-	void query_by_programme(const CMSdb* db)
+	void query_by_programme(CMSdb* db)
 	{
-		{
-			printf("\n=== Query By Programme===\n");
-			char search_programme[MAX_PROGRAMME_LENGTH]; //40char include null char
-			get_string_input(search_programme, sizeof(search_programme), "Enter Programme to Search: ");
-
-			//check if Programme input is empty
-			if (strlen(search_programme) == 0)
-			{
-				printf("Error: Please enter a Programme.\n");
-				return;
-			}
+		printf("\n=== Query By Programme===\n");
+		char search_programme[MAX_PROGRAMME_LENGTH]; //40char include null char
+		get_string_input(search_programme, sizeof(search_programme), "Enter Programme to Search: ");
 
-			//create deep copy and convert to lowercase to not affect original data
-			char search_lower[MAX_PROGRAMME_LENGTH];
-			strcpy_s(search_lower, sizeof(search_lower), search_programme);
-			for (int i = 0; search_lower[i]; i++) {
-				search_lower[i] = tolower(search_lower[i]);
-			}
-
-			int found = 0;
-			for (int i = 0; i < db->record_count; i++)
-			{
-				char current_lower[MAX_PROGRAMME_LENGTH];
-				strcpy_s(current_lower, sizeof(current_lower), db->records[i].programme);
-				//create copy of current record and convert to lowercase
-				for (int j = 0; current_lower[j]; j++)
-				{
-					current_lower[j] = tolower(current_lower[j]);
-				}
-				//match programmes
-				if (strstr(current_lower, search_lower) != NULL)
-				{
-					if (!found)
-					{
-						printf("CMS: Records matching name \"%s\" found:\n", search_programme);
-						printf("%-*s %-*s %-*s %s\n",
-							DISPLAY_ID_WIDTH, "ID",
-							DISPLAY_NAME_WIDTH, "Name",
-							DISPLAY_PROGRAMME_WIDTH, "Programme",
-							"Mark");
-						found = 1;
-					}
-					printf("%-*d %-*s %-*s %.1f\n",
-						DISPLAY_ID_WIDTH, db->records[i].id,
-						DISPLAY_NAME_WIDTH, db->records[i].name,
-						DISPLAY_PROGRAMME_WIDTH, db->records[i].programme,
-						db->records[i].mark);
-				}
-			}
+		//check if Programme input is empty
+		if (strlen(search_programme) == 0)
+		{
+			printf("Error: Please enter a Programme.\n");
+			return;
+		}
 
-			if (!found) {
-				printf("CMS: No records found matching programme \"%s\".\n", search_programme);
-			}
-			else {
-				printf("\nTotal records found: %d\n", found);
-			}
+		//case-insensitive match on the lowercase programme column, through the trigram index when possible (cms_search.c)
+		int* matches = NULL;
+		int capacity = 0;
+		int found = search_records(db, SEARCH_FIELD_PROGRAMME, search_programme, &matches, &capacity);
+		if (found < 0)
+		{
+			printf("CMS: Error - Not enough memory to search.\n");
+		}
+		else if (found == 0)
+		{
+			printf("CMS: No records found matching programme \"%s\".\n", search_programme);
+		}
+		else
+		{
+			printf("CMS: Records matching programme \"%s\" found:\n", search_programme);
+			print_query_matches(db, matches, found);
+			printf("\nTotal records found: %d\n", found);
 		}
+		free(matches);
 	}
 
-	void query_by_mark(const CMSdb* db)
+	/*
+	* Ask for a mark (0-100, at most 1 decimal place) and return it in tenths
+	* returns 0 and prints why if the input is not a valid mark
+	*/
+	static int get_mark_input(const char* prompt, int* tenths)
 	{
-		printf("\n===Query By Mark===");
 		char mark_input[6];//handles max 100.0 and null terminator
-		get_string_input(mark_input, sizeof(mark_input), "Enter mark to search for (0-100, max 1 dp): ");
+		get_string_input(mark_input, sizeof(mark_input), prompt);
 		//valide input formatting
 		int valid_format = 1;
 		int has_decimal = 0;
@@ -896,40 +939,241 @@ int insert_record(CMSdb* db) {
 			search_mark < 0 || search_mark > 100) {
 			printf("Invalid mark. Please enter a number between 0-100 with maximum 1 decimal place.\n");
 			printf("Examples: 70, 70.0, 0.5\n");
+			return 0;
+		}
+		*tenths = mark_to_tenths(search_mark);
+		return 1;
+	}
+
+
+	void query_by_mark(CMSdb* db)
+	{
+		printf("\n===Query By Mark===");
+		int search_tenths;
+		if (!get_mark_input("Enter mark to search for (0-100, max 1 dp): ", &search_tenths)) {
 			return;
 		}
+		float search_mark = tenths_to_mark(search_tenths);
 
-		// Search for matching marks
-		int found = 0;
-		for (int i = 0; i < db->record_count; i++) 
+		// Records with exactly this mark, from the mark index (cms_marks.c)
+		int* matches = NULL;
+		int capacity = 0;
+		int found = mark_range_query(db, search_tenths, search_tenths, &matches, &capacity);
+		if (found < 0)
 		{
-			if (db->records[i].mark == search_mark) 
-			{
-				if (!found) {
-					printf("\nCMS: Records with mark %.1f:\n", search_mark);
-					printf("%-*s %-*s %-*s %s\n",
-						DISPLAY_ID_WIDTH, "ID",
-						DISPLAY_NAME_WIDTH, "Name",
-						DISPLAY_PROGRAMME_WIDTH, "Programme",
-						"Mark");
-					found = 1;
-				}
-				printf("%-*d %-*s %-*s %.1f\n",
-					DISPLAY_ID_WIDTH, db->records[i].id,
-					DISPLAY_NAME_WIDTH, db->records[i].name,
-					DISPLAY_PROGRAMME_WIDTH, db->records[i].programme,
-					db->records[i].mark);
-			}
+			printf("CMS: Error - Not enough memory to search.\n");
 		}
-
-		if (!found) 
+		else if (found == 0) 
 		{
 			printf("CMS: No records found with mark %.1f.\n", search_mark);
 		}
 		else 
 		{
+			printf("\nCMS: Records with mark %.1f:\n", search_mark);
+			print_query_matches(db, matches, found);
 			printf("\nTotal records found: %d\n", found);
 		}
+		free(matches);
+	}
+
+	void query_by_mark_range(CMSdb* db)
+	{
+		printf("\n===Query By Mark Range===");
+		int low_tenths, high_tenths;
+		if (!get_mark_input("Enter lowest mark (0-100, max 1 dp): ", &low_tenths) ||
+			!get_mark_input("Enter highest mark (0-100, max 1 dp): ", &high_tenths)) {
+			return;
+		}
+		if (low_tenths > high_tenths) {
+			printf("Invalid range. The lowest mark cannot be above the highest mark.\n");
+			return;
+		}
+
+		int* matches = NULL;
+		int capacity = 0;
+		int found = mark_range_query(db, low_tenths, high_tenths, &matches, &capacity);
+		if (found < 0)
+		{
+			printf("CMS: Error - Not enough memory to search.\n");
+		}
+		else if (found == 0)
+		{
+			printf("CMS: No records found with marks %.1f-%.1f.\n", tenths_to_mark(low_tenths), tenths_to_mark(high_tenths));
+		}
+		else
+		{
+			printf("\nCMS: Records with marks %.1f-%.1f:\n", tenths_to_mark(low_tenths), tenths_to_mark(high_tenths));
+			print_query_matches(db, matches, found);
+			printf("\nTotal records found: %d\n", found);
+		}
+		free(matches);
+	}
+
+	/*
+	* Rank of a mark among all records: 1 + the number of records with a higher mark (equal marks share a rank)
+	*/
+	static int mark_rank(const CMSdb* db, int tenths)
+	{
+		return mark_count_range(db, tenths + 1, MARK_TENTHS_MAX) + 1;
+	}
+
+	void query_top_marks(CMSdb* db)
+	{
+		printf("\n===Top Students by Mark===\n");
+		char count_input[12];
+		get_string_input(count_input, sizeof(count_input), "How many students to show: ");
+
+		//digits only, 1 up to the number of records
+		int valid = strlen(count_input) > 0 && strlen(count_input) <= 9;
+		for (int i = 0; count_input[i] != '\0' && valid; i++) {
+			valid = isdigit((unsigned char)count_input[i]);
+		}
+		int k = valid ? atoi(count_input) : 0;
+		if (k < 1) {
+			printf("Invalid Input. Please enter a whole number of at least 1.\n");
+			return;
+		}
+		if (k > db->record_count) {
+			k = db->record_count;
+		}
+
+		// The best k records, selected through the mark histogram without sorting the database (cms_marks.c)
+		int* slots = NULL;
+		int capacity = 0;
+		int found = mark_top_k(db, k, &slots, &capacity);
+		if (found < 0)
+		{
+			printf("CMS: Error - Not enough memory to search.\n");
+			return;
+		}
+		int* ranks = (int*)malloc((size_t)found * sizeof(int));
+		if (ranks == NULL)
+		{
+			free(slots);
+			printf("CMS: Error - Not enough memory to search.\n");
+			return;
+		}
+		//rows come highest mark first and every higher mark is among them,
+		//so the rank only changes with the mark and is one more than the rows before it
+		for (int i = 0; i < found; i++)
+		{
+			int tenths = arena_record(&db->arena, slots[i])->mark_tenths;
+			ranks[i] = (i > 0 && tenths == arena_record(&db->arena, slots[i - 1])->mark_tenths) ? ranks[i - 1] : i + 1;
+		}
+		printf("CMS: Top %d student(s) by mark:\n", found);
+		browse_ranked(db, slots, ranks, found);
+		free(ranks);
+		//students left out with the same mark as the last one shown
+		int last_tenths = arena_record(&db->arena, slots[found - 1])->mark_tenths;
+		int tied = mark_count_range(db, last_tenths, MARK_TENTHS_MAX) - found;
+		if (tied > 0) {
+			printf("\nCMS: %d more student(s) also have mark %.1f.\n", tied, tenths_to_mark(last_tenths));
+		}
+		free(slots);
+	}
+
+	void query_mark_percentile(CMSdb* db)
+	{
+		printf("\n===Mark at Percentile===\n");
+		//answered from the mark histogram (cms_marks.c), no record is read
+		printf("CMS: %d records, lowest %.1f, 25th %.1f, median %.1f, 75th %.1f, highest %.1f\n",
+			db->record_count,
+			tenths_to_mark(mark_percentile(db, 0)),
+			tenths_to_mark(mark_percentile(db, 250)),
+			tenths_to_mark(mark_percentile(db, 500)),
+			tenths_to_mark(mark_percentile(db, 750)),
+			tenths_to_mark(mark_percentile(db, 1000)));
+
+		int percent_tenths;
+		if (!get_mark_input("Enter percentile (0-100, max 1 dp): ", &percent_tenths)) {
+			return;
+		}
+		int tenths = mark_percentile(db, percent_tenths);
+		printf("CMS: Percentile %.1f is mark %.1f (%d of %d records have this mark or lower).\n",
+			tenths_to_mark(percent_tenths), tenths_to_mark(tenths),
+			mark_count_range(db, 0, tenths), db->record_count);
+	}
+
+	void query_mark_rank(CMSdb* db)
+	{
+		printf("\n===Rank of a Student===\n");
+		int search_id = get_valid_student_id();
+		int slot = db_find_slot(db, search_id);
+		if (slot < 0) {
+			printf("CMS: The record with ID=%d does not exist.\n", search_id);
+			return;
+		}
+
+		const StoredRecord* record = arena_record(&db->arena, slot);
+		int tenths = record->mark_tenths;
+		int below = mark_count_range(db, 0, tenths - 1);
+		int same = db->marks.histogram[tenths] - 1;
+		printf("CMS: %s (ID=%d) has mark %.1f, rank %d of %d.\n",
+			record->name, record->id, tenths_to_mark(tenths), mark_rank(db, tenths), db->record_count);
+		printf("CMS: %.1f%% of the students have a lower mark", 100.0 * below / db->record_count);
+		if (same > 0) {
+			printf(", %d other student(s) have the same mark", same);
+		}
+		printf(".\n");
+	}
+
+	void query_programme_stats(CMSdb* db)
+	{
+		printf("\n===Statistics by Programme===\n");
+		//running totals kept by every change (cms_stats.c), recounted only after running out of memory
+		int* codes = (int*)malloc((size_t)db->programmes.count * sizeof(int));
+		if (codes == NULL || !group_stats_refresh(db))
+		{
+			free(codes);
+			printf("CMS: Error - Not enough memory for the statistics.\n");
+			return;
+		}
+		int count = group_stats_codes(db, codes);
+
+		printf("%-*s %-8s %-8s %-8s %-8s %s\n",
+			DISPLAY_PROGRAMME_WIDTH, "Programme", "Count", "Average", "Lowest", "Highest", "Std Dev");
+		for (int i = 0; i < count; i++)
+		{
+			const ProgrammeStats* group = &db->stats.groups[codes[i]];
+			double mean = (double)group->sum_tenths / group->count;
+			double variance = (double)group->sum_squares / group->count - mean * mean;
+			printf("%-*s %-8d %-8.2f %-8.1f %-8.1f %.2f\n",
+				DISPLAY_PROGRAMME_WIDTH, db->programmes.names[codes[i]],
+				group->count,
+				mean / 10.0,
+				tenths_to_mark(group->min_tenths),
+				tenths_to_mark(group->max_tenths),
+				(variance > 0) ? sqrt(variance) / 10.0 : 0.0);
+		}
+		printf("\nTotal: %d programme(s), %d records\n", count, db->record_count);
+		free(codes);
+	}
+
+	void query_id_file(const CMSdb* db)
+	{
+		printf("\n===Look Up IDs from a File===\n");
+		//one ID per line (the first field), sorted and probed together by lookup_ids_path (cms_lookup.c)
+		char input[MAX_FILENAME_LENGTH];
+		char output[MAX_FILENAME_LENGTH];
+		get_string_input(input, sizeof(input), "Enter the file of student IDs: ");
+		//"-" reads standard input to the end, the menu could not read another choice afterwards
+		if (strcmp(input, "-") == 0)
+		{
+			printf("CMS: Error - IDs are read from standard input (\"-\") only in batch mode, enter a file name.\n");
+			return;
+		}
+		get_string_input(output, sizeof(output), "Enter the file to write the records to: ");
+		if (strcmp(input, output) == 0 || strcmp(output, db->current_filename) == 0)
+		{
+			printf("CMS: Error - The records cannot be written over the ID file or the database.\n");
+			return;
+		}
+
+		LookupReport report;
+		if (lookup_ids_path(db, input, output, &report))
+		{
+			print_lookup_report(&report, output);
+		}
 	}
 
 
@@ -992,20 +1236,17 @@ int insert_record(CMSdb* db) {
 			break;
 		}
 
-		int recordsindex = -1; //check whether the student ID already exist
-		for (int i = 0; i < db->record_count; i++) {
-			if (db->records[i].id == studentID) {
-				recordsindex = i;
-				break;
-			}
-		}
+		int recordslot = db_find_slot(db, studentID); //check whether the student ID already exist
 		// if no record is found with the student id provided
-		if (recordsindex == -1) {
+		if (recordslot == -1) {
 			printf("CMS: The record with ID = %d does not exist.\n", studentID);
 			return 0;
 		}
 
-		StudentRecord* record = &db->records[recordsindex];
+		//edit a full copy, the store writes it back (and files the programme in the dictionary)
+		StudentRecord current;
+		db_get_record(db, recordslot, &current);
+		StudentRecord* record = &current;
 
 		//current record
 		printf("\nCurrent record details:\n");
@@ -1042,9 +1283,8 @@ int insert_record(CMSdb* db) {
 			break;
 		}
 
-		// Save current state for undo functionality before updating
 		//Store the old values so we can revert if needed
-		save_undo_state(db, "UPDATE");
+		StudentRecord old_values = *record;
 
 		//update the choices
 		switch (choices) {
@@ -1212,12 +1452,19 @@ int insert_record(CMSdb* db) {
 		}
 		}
 
+		if (!db_update_record(db, recordslot, record)) {
+			printf("CMS: Error - Not enough memory to update the record.\n");
+			return 0;
+		}
+
 		//display updated record
 		printf("\nUpdated record:\n");
 		printf("Student ID: %d\n", record->id);
 		printf("Name: %s\n", record->name);
 		printf("Programme: %s\n", record->programme);
 		printf("Mark: %.1f\n", record->mark);
+		undo_record_update(db, &old_values, record);
+		wal_log_update(db, record);
 
 		//undo notification
 		printf("CMS: You can UNDO to restore the old values if needed.\n");
@@ -1259,28 +1506,19 @@ int insert_record(CMSdb* db) {
 		}
 
 		// Search for the record with the given ID
-		int found_index = -1;  // -1 means "not found"
-
-		// We will loop through all records to find matching ID
-		for (int i = 0; i < db->record_count; i++) {
-			if (db->records[i].id == id_to_delete) {
-				found_index = i;  // Record found at index i
-				break;  // Exit loop since we found the record
-			}
-		}
+		int found_slot = db_find_slot(db, id_to_delete);  // -1 means "not found"
 
 		//Check if record was found
-		if (found_index == -1) {
+		if (found_slot == -1) {
 			// If record not found
 			printf("CMS: The record with ID=%d does not exist.\n", id_to_delete);
-			db->undo.can_undo = 0; // Cancel undo since no deletion occurred 
 			return 0;
 
 		}
 
 		//If record found, display details and ask for confirmation
 		printf("CMS: Found student: %s (ID: %d)\n",
-			db->records[found_index].name, //display name and ID of record to be deleted
+			arena_record(&db->arena, found_slot)->name, //display name and ID of record to be deleted
 			id_to_delete);
 		printf("Are you sure you want to delete this record? (Y/N): ");
 
@@ -1293,31 +1531,24 @@ int insert_record(CMSdb* db) {
 		//Check if user confirmed deletion
 		if (confirmation == 'N' || confirmation == 'n') { //If user selects "N" / "n" then the deletion is cancelled
 			printf("CMS: The deletion is cancelled.\n");
-			db->undo.can_undo = 0; // Cancel undo since no deletion occurred
 			return 0;
 		}
 
 		//Check if user input other things that are not Y/y or N/n then print out invalid input message
 		if (confirmation != 'Y' && confirmation != 'y') {
 			printf("CMS: Invalid input. The deletion is cancelled.\n");
-			db->undo.can_undo = 0; // Cancel undo since no deletion occurred
 			return 0;
 		}
-		
-			// Save current state for undo functionality before deleting 
-			save_undo_state(db, "DELETE");
 
 		//If user confirmed deletion, proceed to delete the record
-		//How we delete the record is by shifting all records after found_index one position to the left
-		//Example: If we delete record at index 2, we copy record at index 3 to index 2, index 4 to index 3, etc.
-
-		for (int i = found_index; i < db->record_count - 1; i++) {
-			// Copy the next record to current position
-			db->records[i] = db->records[i + 1];
-		}
-
-		// Decrease the record count
-		db->record_count--;
+		//the record store keeps display order, so every record after it moves up one position
+		int deleted_index = db_index_of_slot(db, found_slot);
+		// Keep the record and its position for undo
+		StudentRecord deleted;
+		db_get_record(db, found_slot, &deleted);
+		undo_record_delete(db, deleted_index, &deleted);
+		db_remove_record_at(db, deleted_index);
+		wal_log_delete(db, id_to_delete);
 
 		// Notify user of successful deletion
 		printf("CMS: The record with ID=%d is successfully deleted.\n", id_to_delete);
@@ -1325,10 +1556,38 @@ int insert_record(CMSdb* db) {
 
 		return 1;  //The deletion was successful
 	}
+/*
+* Write all records as tab separated text (this will overwrite the existing file)
+* returns 1 on success, 0 if the file cannot be written
+*/
+int save_text_records(const CMSdb* db, const char* filename) {
+	FILE* file = fopen(filename, "w");
+
+	// Check if file open successfully
+	if (file == NULL) {
+		return 0;
+	}
+
+	//Write all student records to the file
+	for (int i = 0; i < db->record_count; i++) {
+		const StoredRecord* record = db_record(db, i);
+		// Write each record with tab-separated values
+		fprintf(file, "%d\t%s\t%s\t%.1f\n",
+			record->id,
+			record->name,
+			db_programme(db, i),
+			tenths_to_mark(record->mark_tenths));
+	}
+
+	//Close the file, synced so it can safely replace the old one
+	int written = flush_to_disk(file);
+	return (fclose(file) == 0) && written;
+}
+
 /*
 * Save file
 */
-	int save_file(const CMSdb* db) {
+	int save_file(CMSdb* db) {
 		if (!db->is_open) {
 			printf("CMS: No database is currently opened.\n");
 			return 0;
@@ -1340,44 +1599,85 @@ int insert_record(CMSdb* db) {
 			return 0;
 		}
 
-		//Open the file for writing (this will overwrite the existing file)
-		FILE* file = fopen(db->current_filename, "w");
+		SaveReport report;
+		char temp_filename[sizeof(db->current_filename) + 4];
+		snprintf(temp_filename, sizeof(temp_filename), "%s.tmp", db->current_filename);
+
+		//binary files stay binary, a .cmsb name always gets the binary format
+		int binary = (db->file_format == FILE_FORMAT_BINARY || has_binary_extension(db->current_filename));
+		int saved;
+
+		//patching in place overwrites the live file, a save that stops half way can only be repaired
+		//by replaying the change log, so it needs the log on and synced to disk first
+		int patchable = binary && db->options.wal_enabled && db->wal.file != NULL && wal_sync(db);
+		if (patchable && patch_binary_records(db, db->current_filename, &report)) {
+			saved = 1; //only edited records were written, in place (the change log still covers them until now)
+		}
+		else {
+			//write a complete new file next to the old one, then swap it in
+			//so an interrupted save leaves the old file (and its change log) untouched
+			//unchanged text lines are copied from the old file instead of being formatted again
+			if (binary) {
+				saved = save_binary_records(db, temp_filename);
+				memset(&report, 0, sizeof(report));
+				report.records_written = db->record_count;
+			}
+			else {
+				saved = save_text_incremental(db, db->current_filename, temp_filename, &report);
+			}
+			saved = saved && replace_file(temp_filename, db->current_filename);
+			if (saved && binary) {
+				tracker_start_binary(db);
+			}
+			else if (saved) {
+				tracker_start(db, FILE_FORMAT_TEXT);
+			}
+			else {
+				tracker_reset(db);
+			}
+		}
 
-		// Check if file open successfully
-		if (file == NULL) {
+		// Check if file saved successfully
+		if (!saved) {
+			remove(temp_filename);
 			printf("CMS: Error - Cannot save to file \"%s\"\n", db->current_filename);
 			printf("CMS: Please check if the file is not opened in another program.\n");
 			return 0;
 		}
-
-		//Write all student records to the file
-		for (int i = 0; i < db->record_count; i++) {
-			// Write each record with tab-separated values
-			fprintf(file, "%d\t%s\t%s\t%.1f\n",
-				db->records[i].id,
-				db->records[i].name,
-				db->records[i].programme,
-				db->records[i].mark);
-		}
-
-		//Close the file
-		fclose(file);
+		//every logged change is in the file now
+		wal_discard(db, db->current_filename);
+		db->file_format = binary ? FILE_FORMAT_BINARY : FILE_FORMAT_TEXT;
 
 		//Clear undo state (Since changes are now permanent
 		//After saving, there's nothing to undo - all changes are committed
-		((CMSdb*)db)->undo.can_undo = 0;
-		strcpy_s(((CMSdb*)db)->undo.last_operation,
-			sizeof(((CMSdb*)db)->undo.last_operation), "");
+		undo_journal_clear(&db->undo);
 
 		//Print display success message
 		printf("CMS: The database file \"%s\" is successfully saved.\n", db->current_filename);
 		printf("CMS: %d record(s) saved to file.\n", db->record_count);
+		if (report.incremental) {
+			printf("CMS: %d changed record(s) written: %lld bytes written, %lld unchanged bytes copied (full rewrite: %lld bytes)\n",
+				report.records_written, report.bytes_written, report.bytes_copied, report.file_bytes);
+		}
 		printf("CMS: All changes have been committed (cannot be undone after save).\n");
 
 		return 1;
 	}
+/*
+* Name of a journal entry's operation, for messages
+*/
+static const char* undo_operation_name(const UndoEntry* entry)
+{
+	switch (entry->type) {
+	case UNDO_INSERT: return "INSERT";
+	case UNDO_UPDATE: return "UPDATE";
+	default: return "DELETE";
+	}
+}
+
 /*
 * Undo Function
+* reverts the newest change, can be repeated for older ones (up to the undo limit)
 */
 	int undo_last_operation(CMSdb* db) {
 		if (!db->is_open) {
@@ -1385,23 +1685,52 @@ int insert_record(CMSdb* db) {
 			return 0;
 		}
 
-		if (!db->undo.can_undo) { // No undo available
+		if (db->undo.undo_count == 0) { // No undo available
 			printf("CMS: Nothing to undo. No operation has been performed yet.\n");
 			return 0;
 		}
 
-		printf("CMS: Undoing last operation: %s\n", db->undo.last_operation); // Display last operation
-
-		for (int i = 0; i < db->undo.backup_count; i++) { // Restore records from backup
-			db->records[i] = db->undo.backup_record[i]; // Copy each record back
+		UndoEntry undone;
+		if (!undo_journal_undo(db, &undone)) {
+			printf("CMS: Undo failed, the record has changed since (or out of memory).\n");
+			return 0;
 		}
 
-		db->record_count = db->undo.backup_count; // Restore record count
-		db->undo.can_undo = 0; // Disable further undo until next delete
-		strcpy_s(db->undo.last_operation, sizeof(db->undo.last_operation), ""); // Clear last operation description
-
+		printf("CMS: Undoing last operation: %s (ID=%d)\n", undo_operation_name(&undone),
+			(undone.type == UNDO_INSERT) ? undone.after.id : undone.before.id); // Display last operation
 		printf("CMS: Undo successful! Database restored to previous state.\n"); // Notify user that the undo was successful
 		printf("CMS: Current record count: %d\n", db->record_count); // Show current record count
+		if (db->undo.undo_count < db->undo.count) {
+			printf("CMS: You can REDO (Option 11) to make the change again.\n");
+		}
+
+		return 1;
+	}
+/*
+* Redo Function
+* makes the most recently undone change again, until a new change is made
+*/
+	int redo_last_operation(CMSdb* db) {
+		if (!db->is_open) {
+			printf("CMS: No database is currently opened.\n");
+			return 0;
+		}
+
+		if (db->undo.undo_count == db->undo.count) { // Nothing was undone
+			printf("CMS: Nothing to redo.\n");
+			return 0;
+		}
+
+		UndoEntry redone;
+		if (!undo_journal_redo(db, &redone)) {
+			printf("CMS: Redo failed, the record has changed since (or out of memory).\n");
+			return 0;
+		}
+
+		printf("CMS: Redoing operation: %s (ID=%d)\n", undo_operation_name(&redone),
+			(redone.type == UNDO_INSERT) ? redone.after.id : redone.before.id);
+		printf("CMS: Redo successful!\n");
+		printf("CMS: Current record count: %d\n", db->record_count);
 
 		return 1;
 	}
@@ -1429,10 +1758,12 @@ int insert_record(CMSdb* db) {
 			printf("2. Sort by ID (Descending)\n");
 			printf("3. Sort by Mark (Ascending 0.0 - 100.0)\n");
 			printf("4. Sort by Mark (Descending 100.0 - 0.0\n");
-			printf("5. Return to Main Menu\n");
+			printf("5. Insertion Order (as loaded and inserted)\n");
+			printf("6. Sort by Several Keys (e.g. programme asc, mark desc, name asc)\n");
+			printf("7. Return to Main Menu\n");
 
 			char sort_choice_input[4];
-			get_string_input(sort_choice_input, sizeof(sort_choice_input), "Enter your choice (1-5): ");
+			get_string_input(sort_choice_input, sizeof(sort_choice_input), "Enter your choice (1-7): ");
 
 			//input validation
 			if (strlen(sort_choice_input) != 1 || !isdigit(sort_choice_input[0]))
@@ -1462,6 +1793,12 @@ int insert_record(CMSdb* db) {
 					sort_by_mark_desc(db);
 					break;
 				case 5:
+					sort_by_insertion_order(db);
+					break;
+				case 6:
+					sort_by_keys(db);
+					break;
+				case 7:
 					printf("Returning to Main Menu.\n");
 					return 1;
 			}
@@ -1471,64 +1808,52 @@ int insert_record(CMSdb* db) {
 		}
 		return 1;
 	}
-	//comparison functions for qsort
-	int compare_id_asc(const void* a, const void* b)
-	{
-		//if record A id smaller than record B, return negative, A comes before B
-		//if record B is larger than A, return positive, A comes after B.
-		const StudentRecord* recordA = (const StudentRecord*)a;
-		const StudentRecord* recordB = (const StudentRecord*)b;
-		return (recordA->id - recordB->id);
-	}
-
-	int compare_id_desc(const void* a, const void* b)
-	{ 
-		//if record B is smaller than record B, return negative, A comes before B
-		//if record A is larger, return positive, A comes after B
-		const StudentRecord* recordA = (const StudentRecord*)a;
-		const StudentRecord* recordB = (const StudentRecord*)b;
-		return (recordB->id - recordA->id);
-	}
-	int compare_mark_asc(const void* a, const void* b)
-	{
-		//if A mark < B mark, A before B
-		//if A mark > B mark, A comes after B
-		const StudentRecord* recordA = (const StudentRecord*)a;
-		const StudentRecord* recordB = (const StudentRecord*)b;
-		if (recordA->mark < recordB->mark) return -1;
-		if (recordA->mark > recordB->mark) return 1;
-		return 0;
-	}
-	int compare_mark_desc(const void* a, const void* b)
-	{
-		//if mark A > mark B, A before B
-		//if mark A < mark B, A comes after B
-		const StudentRecord* recordA = (const StudentRecord*)a;
-		const StudentRecord* recordB = (const StudentRecord*)b;
-		if (recordA->mark > recordB->mark) return -1;
-		if (recordA->mark < recordB->mark) return 1;
-		return 0;
-	}
-	//implemented comparison functions
+	//each order is a cached sort view (cms_sort.c), sorting again only switches to it
 	void sort_by_id_asc(CMSdb* db)
 	{
-		qsort(db->records, db->record_count, sizeof(StudentRecord), compare_id_asc);
+		sort_view_show(db, SORT_VIEW_ID_ASC);
 		printf("Sorted by ID (Ascending)\n");
 	}
 	void sort_by_id_desc(CMSdb* db)
 	{
-		qsort(db->records, db->record_count, sizeof(StudentRecord), compare_id_desc);
+		sort_view_show(db, SORT_VIEW_ID_DESC);
 		printf("Sorted by ID (Descending)\n");
 	}
 	void sort_by_mark_asc(CMSdb* db)
 	{
-		qsort(db->records, db->record_count, sizeof(StudentRecord), compare_mark_asc);
+		sort_view_show(db, SORT_VIEW_MARK_ASC);
 		printf("Sorted by Mark (Ascending)\n");
 	}
 	void sort_by_mark_desc(CMSdb* db)
 	{
-		qsort(db->records, db->record_count, sizeof(StudentRecord), compare_mark_desc);
+		sort_view_show(db, SORT_VIEW_MARK_DESC);
 		printf("Sorted by Mark (Descending)\n");
 	}
+	void sort_by_insertion_order(CMSdb* db)
+	{
+		sort_view_show(db, SORT_VIEW_INSERTION);
+		printf("Back to Insertion Order\n");
+	}
+	//fields in order of importance, records equal in all of them keep their current order
+	void sort_by_keys(CMSdb* db)
+	{
+		char spec_input[100];
+		char spec_text[100];
+		SortSpec spec;
+
+		while (1) {
+			get_string_input(spec_input, sizeof(spec_input), "Enter sort keys (id, name, programme, mark, each asc or desc, separated by commas): ");
+			if (sort_spec_parse(spec_input, &spec)) {
+				break;
+			}
+			printf("Invalid sort keys. Example: programme asc, mark desc, name asc (each field at most once).\n");
+		}
+		if (!sort_view_show_spec(db, &spec)) {
+			printf("CMS: Error - Not enough memory to sort.\n");
+			return;
+		}
+		sort_spec_format(&spec, spec_text, sizeof(spec_text));
+		printf("Sorted by %s\n", spec_text);
+	}
 	 
 
@@ -0,0 +1,466 @@
+/*
+* Course Management System (CMS)
+* Platform layer - operating system calls that differ between Windows and POSIX
+*/
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE //copy_file_range
+#endif
+
+#include "cms.h"
+#include <errno.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define PARALLEL_MAX_THREADS 64
+#define COPY_BUFFER_SIZE (64 * 1024) //file_copy_range without a kernel copy call
+#define IO_MAX_CHUNK (1 << 30) //largest single read or write call
+
+/*
+* Map a whole file read-only into memory
+* returns 1 on success, 0 on failure with errno set
+*/
+int map_file(const char* filename, MappedFile* map)
+{
+	memset(map, 0, sizeof(*map));
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		DWORD error = GetLastError();
+		errno = (error == ERROR_FILE_NOT_FOUND || error == ERROR_PATH_NOT_FOUND) ? ENOENT :
+			(error == ERROR_ACCESS_DENIED || error == ERROR_SHARING_VIOLATION) ? EACCES : EIO;
+		return 0;
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size)) {
+		CloseHandle(file);
+		errno = EIO;
+		return 0;
+	}
+	if (size.QuadPart == 0) {
+		//an empty file cannot be mapped, hand back an empty buffer instead
+		CloseHandle(file);
+		map->data = "";
+		return 1;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file); //the mapping keeps the file open
+	if (mapping == NULL) {
+		errno = EIO;
+		return 0;
+	}
+	const char* view = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (view == NULL) {
+		CloseHandle(mapping);
+		errno = ENOMEM;
+		return 0;
+	}
+	map->data = view;
+	map->size = (size_t)size.QuadPart;
+	map->handle = mapping;
+#else
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		return 0;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return 0;
+	}
+	if (st.st_size == 0) {
+		close(fd);
+		map->data = "";
+		return 1;
+	}
+
+	void* view = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); //the mapping keeps the file open
+	if (view == MAP_FAILED) {
+		return 0;
+	}
+	madvise(view, (size_t)st.st_size, MADV_SEQUENTIAL);
+	map->data = (const char*)view;
+	map->size = (size_t)st.st_size;
+#endif
+	return 1;
+}
+
+/*
+* Release a mapping made by map_file
+*/
+void unmap_file(MappedFile* map)
+{
+	if (map->size > 0) {
+#ifdef _WIN32
+		UnmapViewOfFile(map->data);
+		CloseHandle((HANDLE)map->handle);
+#else
+		munmap((void*)map->data, map->size);
+#endif
+	}
+	memset(map, 0, sizeof(*map));
+}
+
+/*
+* Flush a stdio file and make the operating system write it to the disk
+* returns 1 on success, 0 on failure
+*/
+int flush_to_disk(FILE* file)
+{
+	if (fflush(file) != 0) {
+		return 0;
+	}
+#ifdef _WIN32
+	return _commit(_fileno(file)) == 0;
+#else
+	return fsync(fileno(file)) == 0;
+#endif
+}
+
+/*
+* Move "from" over "to" in one step, readers see either the old or the new file, never a partial one
+* returns 1 on success, 0 on failure
+*/
+int replace_file(const char* from, const char* to)
+{
+#ifdef _WIN32
+	return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+	return rename(from, to) == 0;
+#endif
+}
+
+/*
+* Plain file descriptors for the incremental save, where stdio buffering gets in the way
+* every function returns 1 on success and 0 on failure unless noted
+*/
+
+/*
+* Open an existing file for reading, returns the descriptor or -1
+*/
+int file_open_read(const char* filename)
+{
+#ifdef _WIN32
+	return _open(filename, _O_RDONLY | _O_BINARY);
+#else
+	return open(filename, O_RDONLY);
+#endif
+}
+
+/*
+* Open an existing file for reading and writing in place, returns the descriptor or -1
+*/
+int file_open_update(const char* filename)
+{
+#ifdef _WIN32
+	return _open(filename, _O_RDWR | _O_BINARY);
+#else
+	return open(filename, O_RDWR);
+#endif
+}
+
+/*
+* Create (or empty) a file for writing, returns the descriptor or -1
+*/
+int file_create(const char* filename)
+{
+#ifdef _WIN32
+	return _open(filename, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+	return open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+}
+
+/*
+* Write all of data at the current position
+*/
+int file_write(int fd, const void* data, size_t length)
+{
+	const char* p = (const char*)data;
+
+	while (length > 0) {
+		unsigned int part = (length > IO_MAX_CHUNK) ? IO_MAX_CHUNK : (unsigned int)length;
+#ifdef _WIN32
+		int done = _write(fd, p, part);
+#else
+		ssize_t done = write(fd, p, part);
+		if (done < 0 && errno == EINTR) {
+			continue;
+		}
+#endif
+		if (done <= 0) {
+			return 0;
+		}
+		p += done;
+		length -= (size_t)done;
+	}
+	return 1;
+}
+
+/*
+* Read exactly length bytes starting at offset
+*/
+int file_read_at(int fd, void* data, size_t length, long long offset)
+{
+	char* p = (char*)data;
+
+#ifdef _WIN32
+	if (_lseeki64(fd, offset, SEEK_SET) < 0) {
+		return 0;
+	}
+#endif
+	while (length > 0) {
+		unsigned int part = (length > IO_MAX_CHUNK) ? IO_MAX_CHUNK : (unsigned int)length;
+#ifdef _WIN32
+		int done = _read(fd, p, part);
+#else
+		ssize_t done = pread(fd, p, part, (off_t)offset);
+		if (done < 0 && errno == EINTR) {
+			continue;
+		}
+#endif
+		if (done <= 0) {
+			return 0;
+		}
+		p += done;
+		offset += done;
+		length -= (size_t)done;
+	}
+	return 1;
+}
+
+/*
+* Write all of data starting at offset, the file position is not used
+*/
+int file_write_at(int fd, const void* data, size_t length, long long offset)
+{
+#ifdef _WIN32
+	if (_lseeki64(fd, offset, SEEK_SET) < 0) {
+		return 0;
+	}
+	return file_write(fd, data, length);
+#else
+	const char* p = (const char*)data;
+	while (length > 0) {
+		ssize_t done = pwrite(fd, p, length, (off_t)offset);
+		if (done < 0 && errno == EINTR) {
+			continue;
+		}
+		if (done <= 0) {
+			return 0;
+		}
+		p += done;
+		offset += done;
+		length -= (size_t)done;
+	}
+	return 1;
+#endif
+}
+
+/*
+* Append length bytes of from_fd, starting at offset, to to_fd
+* on Linux copy_file_range moves the bytes inside the kernel (or shares the blocks on filesystems that can),
+* elsewhere they go through a buffer
+*/
+int file_copy_range(int from_fd, long long offset, long long length, int to_fd)
+{
+#ifdef __linux__
+	loff_t from_offset = (loff_t)offset;
+	while (length > 0) {
+		ssize_t done = copy_file_range(from_fd, &from_offset, to_fd, NULL, (size_t)length, 0);
+		if (done < 0 && errno == EINTR) {
+			continue;
+		}
+		if (done <= 0) {
+			break; //not supported here (old kernel, other filesystem), finish with the buffer
+		}
+		length -= done;
+	}
+	offset = (long long)from_offset;
+#endif
+	if (length > 0) {
+		char* buffer = (char*)malloc(COPY_BUFFER_SIZE);
+		if (buffer == NULL) {
+			return 0;
+		}
+		while (length > 0) {
+			size_t part = (length > COPY_BUFFER_SIZE) ? COPY_BUFFER_SIZE : (size_t)length;
+			if (!file_read_at(from_fd, buffer, part, offset) || !file_write(to_fd, buffer, part)) {
+				free(buffer);
+				return 0;
+			}
+			offset += (long long)part;
+			length -= (long long)part;
+		}
+		free(buffer);
+	}
+	return 1;
+}
+
+/*
+* Close a descriptor, with sync = 1 the data is on disk when this returns
+*/
+int file_close(int fd, int sync)
+{
+	int ok = 1;
+#ifdef _WIN32
+	if (sync) {
+		ok = _commit(fd) == 0;
+	}
+	return (_close(fd) == 0) && ok;
+#else
+	if (sync) {
+		ok = fsync(fd) == 0;
+	}
+	return (close(fd) == 0) && ok;
+#endif
+}
+
+/*
+* Whether standard input and standard output are terminals (not redirected to a file or a pipe)
+*/
+int stdin_is_terminal(void)
+{
+#ifdef _WIN32
+	return _isatty(_fileno(stdin));
+#else
+	return isatty(fileno(stdin));
+#endif
+}
+
+int stdout_is_terminal(void)
+{
+#ifdef _WIN32
+	return _isatty(_fileno(stdout));
+#else
+	return isatty(fileno(stdout));
+#endif
+}
+
+/*
+* Descriptor of standard output, for writing past the stdio buffer (flush stdout first)
+*/
+int stdout_descriptor(void)
+{
+#ifdef _WIN32
+	return _fileno(stdout);
+#else
+	return fileno(stdout);
+#endif
+}
+
+/*
+* Number of logical processors, at least 1
+*/
+int cpu_count(void)
+{
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (info.dwNumberOfProcessors > 0) ? (int)info.dwNumberOfProcessors : 1;
+#else
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return (count > 0) ? (int)count : 1;
+#endif
+}
+
+/*
+* Shared state of one parallel_for call, threads take the next task index until none are left
+*/
+typedef struct {
+	void (*task)(void* context, int index);
+	void* context;
+	int task_count;
+	volatile long next_task;
+} ParallelJob;
+
+static int take_task(ParallelJob* job)
+{
+#ifdef _WIN32
+	return (int)InterlockedIncrement(&job->next_task) - 1;
+#else
+	return (int)__atomic_fetch_add(&job->next_task, 1, __ATOMIC_RELAXED);
+#endif
+}
+
+static void run_tasks(ParallelJob* job)
+{
+	int index;
+	while ((index = take_task(job)) < job->task_count) {
+		job->task(job->context, index);
+	}
+}
+
+#ifdef _WIN32
+static DWORD WINAPI parallel_thread(LPVOID argument)
+{
+	run_tasks((ParallelJob*)argument);
+	return 0;
+}
+#else
+static void* parallel_thread(void* argument)
+{
+	run_tasks((ParallelJob*)argument);
+	return NULL;
+}
+#endif
+
+/*
+* Run task(context, 0 .. task_count - 1) on up to thread_count threads and wait for all of them
+* the calling thread works too, if a thread cannot be started the others simply take its share
+*/
+void parallel_for(int task_count, int thread_count, void (*task)(void* context, int index), void* context)
+{
+	ParallelJob job = { task, context, task_count, 0 };
+	int started = 0;
+
+	if (thread_count > task_count) {
+		thread_count = task_count;
+	}
+	if (thread_count > PARALLEL_MAX_THREADS) {
+		thread_count = PARALLEL_MAX_THREADS;
+	}
+
+#ifdef _WIN32
+	HANDLE threads[PARALLEL_MAX_THREADS];
+	for (int i = 1; i < thread_count; i++) {
+		threads[started] = CreateThread(NULL, 0, parallel_thread, &job, 0, NULL);
+		if (threads[started] != NULL) {
+			started++;
+		}
+	}
+	run_tasks(&job);
+	for (int i = 0; i < started; i++) {
+		WaitForSingleObject(threads[i], INFINITE);
+		CloseHandle(threads[i]);
+	}
+#else
+	pthread_t threads[PARALLEL_MAX_THREADS];
+	for (int i = 1; i < thread_count; i++) {
+		if (pthread_create(&threads[started], NULL, parallel_thread, &job) == 0) {
+			started++;
+		}
+	}
+	run_tasks(&job);
+	for (int i = 0; i < started; i++) {
+		pthread_join(threads[i], NULL);
+	}
+#endif
+}
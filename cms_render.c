@@ -0,0 +1,160 @@
+/*
+* Course Management System (CMS)
+* Table renderer - record tables (Show All Records and the query results) are formatted by hand into one
+* reusable buffer and written to standard output in large blocks, instead of one printf per row
+* IDs, ranks and marks (whole tenths) are converted with integer arithmetic, never through float
+* a terminal gets the padded columns of the menu; when standard output is a pipe or a file the rows are
+* tab separated like a CMS file, nobody reads the padding there and tools split on tabs
+* (TABLE_LAYOUT_ALIGNED / TABLE_LAYOUT_TABS choose the layout regardless of where the output goes)
+*/
+
+#include "cms.h"
+
+#define TABLE_BUFFER_SIZE (256 * 1024) //rows are written out when the buffer fills up
+#define TABLE_RANK_WIDTH 6
+#define TABLE_ROW_MAX (TABLE_RANK_WIDTH + DISPLAY_ID_WIDTH + DISPLAY_NAME_WIDTH + DISPLAY_PROGRAMME_WIDTH + 64)
+
+static char table_buffer[TABLE_BUFFER_SIZE]; //shared by every table, only one is printed at a time
+
+/*
+* Write out the rows collected so far
+*/
+static void table_flush(TableWriter* table)
+{
+	if (table->used > 0) {
+		file_write(table->fd, table->buffer, table->used);
+		table->used = 0;
+	}
+}
+
+/*
+* Append text, padded with spaces to width (no padding when width is 0 or the text is longer)
+*/
+static char* table_text(char* out, const char* text, int width)
+{
+	const char* start = out;
+	while (*text != '\0') {
+		*out++ = *text++;
+	}
+	while (out - start < width) {
+		*out++ = ' ';
+	}
+	return out;
+}
+
+/*
+* Append a non-negative integer, padded with spaces to width
+*/
+static char* table_int(char* out, int value, int width)
+{
+	char digits[12];
+	int count = 0;
+	do {
+		digits[count++] = (char)('0' + value % 10);
+		value /= 10;
+	} while (value > 0);
+
+	const char* start = out;
+	while (count > 0) {
+		*out++ = digits[--count];
+	}
+	while (out - start < width) {
+		*out++ = ' ';
+	}
+	return out;
+}
+
+/*
+* Append a mark given in tenths as "%.1f" prints it
+*/
+static char* table_mark(char* out, int tenths)
+{
+	out = table_int(out, tenths / 10, 0);
+	*out++ = '.';
+	*out++ = (char)('0' + tenths % 10);
+	return out;
+}
+
+/*
+* Column separator: one space after a padded column, or a tab
+*/
+static char* table_column(const TableWriter* table, char* out, const char* text, int width)
+{
+	out = table_text(out, text, table->aligned ? width : 0);
+	*out++ = table->aligned ? ' ' : '\t';
+	return out;
+}
+
+/*
+* Start a table on standard output and print its header row
+* layout is one of TABLE_LAYOUT_*, rank_column adds a Rank column in front of the ID
+*/
+void table_begin(TableWriter* table, int layout, int rank_column)
+{
+	//text printed before the table has to come out first
+	fflush(stdout);
+	table_begin_fd(table, stdout_descriptor(),
+		(layout == TABLE_LAYOUT_AUTO) ? stdout_is_terminal() : (layout == TABLE_LAYOUT_ALIGNED), rank_column);
+}
+
+/*
+* Start a table written to the open descriptor fd, aligned = 1 for padded columns, 0 for tabs
+*/
+void table_begin_fd(TableWriter* table, int fd, int aligned, int rank_column)
+{
+	table->buffer = table_buffer;
+	table->used = 0;
+	table->fd = fd;
+	table->aligned = aligned;
+	table->rank_column = rank_column;
+
+	char* out = table->buffer;
+	if (rank_column) {
+		out = table_column(table, out, "Rank", TABLE_RANK_WIDTH);
+	}
+	out = table_column(table, out, "ID", DISPLAY_ID_WIDTH);
+	out = table_column(table, out, "Name", DISPLAY_NAME_WIDTH);
+	out = table_column(table, out, "Programme", DISPLAY_PROGRAMME_WIDTH);
+	out = table_text(out, "Mark", 0);
+	*out++ = '\n';
+	table->used = (size_t)(out - table->buffer);
+}
+
+/*
+* Add one row, rank is only printed if the table has a Rank column
+*/
+void table_row(TableWriter* table, int rank, int id, const char* name, const char* programme, int mark_tenths)
+{
+	if (table->used + TABLE_ROW_MAX > TABLE_BUFFER_SIZE) {
+		table_flush(table);
+	}
+	char* out = table->buffer + table->used;
+	if (table->rank_column) {
+		out = table_int(out, rank, table->aligned ? TABLE_RANK_WIDTH : 0);
+		*out++ = table->aligned ? ' ' : '\t';
+	}
+	out = table_int(out, id, table->aligned ? DISPLAY_ID_WIDTH : 0);
+	*out++ = table->aligned ? ' ' : '\t';
+	out = table_column(table, out, name, DISPLAY_NAME_WIDTH);
+	out = table_column(table, out, programme, DISPLAY_PROGRAMME_WIDTH);
+	out = table_mark(out, mark_tenths);
+	*out++ = '\n';
+	table->used = (size_t)(out - table->buffer);
+}
+
+/*
+* Add the record in an arena slot
+*/
+void table_slot(TableWriter* table, const CMSdb* db, int slot)
+{
+	const StoredRecord* record = arena_record(&db->arena, slot);
+	table_row(table, 0, record->id, record->name, slot_programme(db, slot), record->mark_tenths);
+}
+
+/*
+* Write out the rest of the table
+*/
+void table_end(TableWriter* table)
+{
+	table_flush(table);
+}
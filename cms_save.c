@@ -0,0 +1,247 @@
+/*
+* Course Management System (CMS)
+* Incremental save - remembers where every record sits in the saved file and what changed since,
+* so saving after a few edits copies the unchanged parts of the old file instead of formatting them again
+* text files: unchanged lines are copied from the old file (copy_file_range on Linux), changed ones formatted
+* binary files: edited records are patched in place (cms_binary.c) while no record was added, removed or moved
+* and the change log is on (it repairs an interrupted patch), otherwise a new file replaces the old one
+*/
+
+#include "cms.h"
+
+#define SAVE_BUFFER_SIZE (64 * 1024) //formatted lines are collected and written in blocks of this size
+#define SAVE_LINE_MAX (MAX_NAME_LENGTH + MAX_PROGRAMME_LENGTH + 48)
+
+/*
+* Make sure sources covers slot, returns 0 if out of memory
+*/
+static int tracker_reserve(SaveTracker* tracker, int slot)
+{
+	if (slot < tracker->capacity) {
+		return 1;
+	}
+	int capacity = (tracker->capacity > 0) ? tracker->capacity : INITIAL_ORDER_CAPACITY;
+	while (capacity <= slot) {
+		capacity *= 2;
+	}
+	RecordSource* grown = (RecordSource*)realloc(tracker->sources, (size_t)capacity * sizeof(RecordSource));
+	if (grown == NULL) {
+		return 0;
+	}
+	for (int i = tracker->capacity; i < capacity; i++) {
+		grown[i].offset = -1;
+		grown[i].length = 0;
+		grown[i].changed = 0;
+	}
+	tracker->sources = grown;
+	tracker->capacity = capacity;
+	return 1;
+}
+
+/*
+* Remember where the record in slot is stored in the file being loaded or saved
+* if memory runs out the slot simply stays unknown and is written out in full
+*/
+void tracker_set_source(CMSdb* db, int slot, long long offset, int length)
+{
+	SaveTracker* tracker = &db->save_tracker;
+
+	if (tracker_reserve(tracker, slot)) {
+		tracker->sources[slot].offset = offset;
+		tracker->sources[slot].length = length;
+		tracker->sources[slot].changed = 0;
+	}
+}
+
+/*
+* A new record moved into slot (the slot may have held a deleted record before)
+*/
+void tracker_forget_slot(CMSdb* db, int slot)
+{
+	SaveTracker* tracker = &db->save_tracker;
+
+	if (slot < tracker->capacity) {
+		tracker->sources[slot].offset = -1;
+		tracker->sources[slot].changed = 0;
+	}
+	tracker->layout_changed = 1;
+}
+
+/*
+* The record in slot was edited in place
+*/
+void tracker_mark_changed(CMSdb* db, int slot)
+{
+	SaveTracker* tracker = &db->save_tracker;
+
+	if (slot >= tracker->capacity || tracker->sources[slot].offset < 0 || tracker->sources[slot].changed) {
+		return; //not in the saved file or already listed
+	}
+	if (!grow_int_array(&tracker->changed_slots, &tracker->changed_capacity, tracker->changed_count + 1)) {
+		tracker->sources[slot].offset = -1; //without the list entry it is treated like a new record
+		tracker->layout_changed = 1;
+		return;
+	}
+	tracker->sources[slot].changed = 1;
+	tracker->changed_slots[tracker->changed_count++] = slot;
+}
+
+/*
+* Records were added, removed or reordered
+*/
+void tracker_mark_layout_changed(CMSdb* db)
+{
+	db->save_tracker.layout_changed = 1;
+}
+
+/*
+* Forget everything, the next save writes the whole file
+*/
+void tracker_reset(CMSdb* db)
+{
+	db->save_tracker.tracking = 0;
+	db->save_tracker.changed_count = 0;
+	db->save_tracker.layout_changed = 1;
+}
+
+/*
+* The records now match the file just loaded or saved, start counting changes from here
+*/
+void tracker_start(CMSdb* db, int format)
+{
+	SaveTracker* tracker = &db->save_tracker;
+
+	for (int i = 0; i < tracker->changed_count; i++) {
+		tracker->sources[tracker->changed_slots[i]].changed = 0;
+	}
+	tracker->changed_count = 0;
+	tracker->layout_changed = 0;
+	tracker->tracking = 1;
+	tracker->format = format;
+}
+
+/*
+* A binary file was just written, record i of the file is the record shown at position i
+*/
+void tracker_start_binary(CMSdb* db)
+{
+	for (int i = 0; i < db->record_count; i++) {
+		tracker_set_source(db, db->order[i], i, 0);
+	}
+	tracker_start(db, FILE_FORMAT_BINARY);
+}
+
+/*
+* Release the tracker's memory
+*/
+void tracker_free(CMSdb* db)
+{
+	free(db->save_tracker.sources);
+	free(db->save_tracker.changed_slots);
+	memset(&db->save_tracker, 0, sizeof(db->save_tracker));
+}
+
+/*
+* Output of save_text_incremental: formatted lines wait in a buffer,
+* runs of unchanged lines that follow each other in the old file are copied with one call
+*/
+typedef struct {
+	int fd;
+	int source_fd;
+	char* buffer;
+	size_t used;
+	long long copy_offset; //pending run in the old file
+	long long copy_length;
+} TextWriter;
+
+static int writer_flush_buffer(TextWriter* writer)
+{
+	int ok = writer->used == 0 || file_write(writer->fd, writer->buffer, writer->used);
+	writer->used = 0;
+	return ok;
+}
+
+static int writer_flush_copy(TextWriter* writer)
+{
+	int ok = writer->copy_length == 0 || file_copy_range(writer->source_fd, writer->copy_offset, writer->copy_length, writer->fd);
+	writer->copy_length = 0;
+	return ok;
+}
+
+/*
+* Write every record to filename as tab separated text, in display order
+* records unchanged since the last load or save of source_filename are copied from it byte for byte,
+* all others are formatted; without a usable old file this is a plain full rewrite
+* returns 1 on success, 0 on failure (change tracking is reset then)
+*/
+int save_text_incremental(CMSdb* db, const char* source_filename, const char* filename, SaveReport* report)
+{
+	SaveTracker* tracker = &db->save_tracker;
+	TextWriter writer = { -1, -1, NULL, 0, 0, 0 };
+	long long position = 0;
+	int ok = 1;
+
+	memset(report, 0, sizeof(*report));
+
+	writer.buffer = (char*)malloc(SAVE_BUFFER_SIZE);
+	if (writer.buffer == NULL) {
+		return 0;
+	}
+	writer.fd = file_create(filename);
+	if (writer.fd < 0) {
+		free(writer.buffer);
+		return 0;
+	}
+	if (tracker->tracking && tracker->format == FILE_FORMAT_TEXT) {
+		writer.source_fd = file_open_read(source_filename); //-1: every record is formatted
+	}
+
+	for (int i = 0; i < db->record_count && ok; i++) {
+		int slot = db->order[i];
+		const RecordSource* source = (slot < tracker->capacity) ? &tracker->sources[slot] : NULL;
+		int length;
+
+		if (writer.source_fd >= 0 && source != NULL && source->offset >= 0 && !source->changed) {
+			long long offset = source->offset;
+			length = source->length;
+			//extend the pending run when this line directly follows it in the old file
+			if (writer.copy_length == 0 || writer.copy_offset + writer.copy_length != offset) {
+				ok = writer_flush_buffer(&writer) && writer_flush_copy(&writer);
+				writer.copy_offset = offset;
+			}
+			writer.copy_length += length;
+			report->bytes_copied += length;
+		}
+		else {
+			const StoredRecord* record = arena_record(&db->arena, slot);
+			ok = writer_flush_copy(&writer);
+			if (writer.used + SAVE_LINE_MAX > SAVE_BUFFER_SIZE) {
+				ok = writer_flush_buffer(&writer) && ok;
+			}
+			length = snprintf(writer.buffer + writer.used, SAVE_LINE_MAX, "%d\t%s\t%s\t%.1f\n",
+				record->id, record->name, slot_programme(db, slot), tenths_to_mark(record->mark_tenths));
+			writer.used += (size_t)length;
+			report->bytes_written += length;
+			report->records_written++;
+		}
+
+		//where the line sits in the new file
+		tracker_set_source(db, slot, position, length);
+		position += length;
+	}
+	ok = ok && writer_flush_copy(&writer) && writer_flush_buffer(&writer);
+
+	ok = file_close(writer.fd, 1) && ok;
+	if (writer.source_fd >= 0) {
+		file_close(writer.source_fd, 0);
+		report->incremental = 1;
+	}
+	free(writer.buffer);
+
+	if (!ok) {
+		tracker_reset(db);
+		return 0;
+	}
+	report->file_bytes = position;
+	return 1;
+}
@@ -0,0 +1,571 @@
+/*
+* Course Management System (CMS)
+* Text search - case-insensitive substring matching over the folded columns of the arena
+* names are lowercased once when a record is stored (cms_store.c), so a query only folds its own text
+* and then runs strstr straight over the column blocks
+* programmes are matched once per dictionary entry, then only the 2 byte programme codes are scanned
+*
+* trigram index: for every three byte sequence of a folded name, the sorted list of slots containing it
+* a query of 3+ characters intersects the lists of its own trigrams and only checks those candidates with strstr
+* (sharing every trigram does not mean the text is contiguous); shorter queries always scan
+* the index is built on first use and then kept up to date by cms_store.c, running out of memory drops it
+*/
+
+#include "cms.h"
+
+/*
+* Lowercase copy of text into folded (size bytes, always terminated)
+*/
+void fold_text(char* folded, const char* text, size_t size)
+{
+	size_t i = 0;
+	for (; i + 1 < size && text[i] != '\0'; i++) {
+		folded[i] = (char)tolower((unsigned char)text[i]);
+	}
+	folded[i] = '\0';
+}
+
+/*
+* Find every record whose name or programme (field = SEARCH_FIELD_*) contains text, ignoring case, without the index
+* the columns are scanned slot by slot in memory order and hits are marked in a bitmap,
+* then the order array turns them into display positions, so results come out in display order
+* stores the display indices in *matches (grown as needed) and returns how many there are, -1 if out of memory
+*/
+int search_records_scan(const CMSdb* db, int field, const char* text, int** matches, int* capacity)
+{
+	const RecordArena* arena = &db->arena;
+	const ProgrammeDictionary* programmes = &db->programmes;
+	size_t width = (field == SEARCH_FIELD_NAME) ? MAX_NAME_LENGTH : MAX_PROGRAMME_LENGTH;
+	char needle[MAX_NAME_LENGTH > MAX_PROGRAMME_LENGTH ? MAX_NAME_LENGTH : MAX_PROGRAMME_LENGTH];
+	unsigned char* wanted = NULL; //programme codes whose text matches
+	int count = 0;
+
+	fold_text(needle, text, width);
+	if (db->record_count == 0) {
+		return 0;
+	}
+	if (field == SEARCH_FIELD_PROGRAMME) {
+		int wanted_count = 0;
+		wanted = (unsigned char*)calloc((size_t)programmes->count, 1);
+		if (wanted == NULL) {
+			return -1;
+		}
+		for (int code = 0; code < programmes->count; code++) {
+			wanted[code] = strstr(programmes->folded[code], needle) != NULL;
+			wanted_count += wanted[code];
+		}
+		if (wanted_count == 0) {
+			free(wanted);
+			return 0;
+		}
+	}
+
+	unsigned char* hits = (unsigned char*)calloc((size_t)arena->slot_count / 8 + 1, 1);
+	if (hits == NULL) {
+		free(wanted);
+		return -1;
+	}
+	//deleted slots are scanned too, they never appear in the order array so their hits are ignored
+	for (int chunk = 0; chunk < arena->chunk_count; chunk++) {
+		int first = chunk * RECORD_CHUNK_SIZE;
+		int slots = arena->slot_count - first;
+		if (slots > RECORD_CHUNK_SIZE) {
+			slots = RECORD_CHUNK_SIZE;
+		}
+		if (field == SEARCH_FIELD_NAME) {
+			const char* column = arena->folded_names[chunk];
+			for (int i = 0; i < slots; i++) {
+				if (strstr(column + (size_t)i * MAX_NAME_LENGTH, needle) != NULL) {
+					hits[(first + i) >> 3] |= (unsigned char)(1u << ((first + i) & 7));
+				}
+			}
+		}
+		else {
+			const unsigned short* codes = arena->programme_codes[chunk];
+			for (int i = 0; i < slots; i++) {
+				if (wanted[codes[i]]) {
+					hits[(first + i) >> 3] |= (unsigned char)(1u << ((first + i) & 7));
+				}
+			}
+		}
+	}
+	free(wanted);
+
+	for (int i = 0; i < db->record_count; i++) {
+		int slot = db->order[i];
+		if (hits[slot >> 3] & (1u << (slot & 7))) {
+			if (!grow_int_array(matches, capacity, count + 1)) {
+				free(hits);
+				return -1;
+			}
+			(*matches)[count++] = i;
+		}
+	}
+	free(hits);
+	return count;
+}
+
+/*
+* Trigram of the three bytes at text, as stored in TrigramIndex.keys (never 0 for folded text)
+*/
+static unsigned int trigram_key(const char* text)
+{
+	return ((unsigned int)(unsigned char)text[0] << 16) | ((unsigned int)(unsigned char)text[1] << 8) | (unsigned char)text[2];
+}
+
+static unsigned int trigram_hash(unsigned int key, int capacity)
+{
+	return (key * 2654435761u) & (unsigned int)(capacity - 1);
+}
+
+/*
+* Posting list of key, NULL if no slot has that trigram
+*/
+static PostingList* trigram_find(const TrigramIndex* index, unsigned int key)
+{
+	if (index->capacity == 0) {
+		return NULL;
+	}
+	for (unsigned int i = trigram_hash(key, index->capacity); index->keys[i] != 0; i = (i + 1) & (unsigned int)(index->capacity - 1)) {
+		if (index->keys[i] == key) {
+			return &index->lists[i];
+		}
+	}
+	return NULL;
+}
+
+/*
+* Double the table (or allocate the first one), returns 0 if out of memory
+*/
+static int trigram_grow(TrigramIndex* index)
+{
+	int capacity = (index->capacity > 0) ? index->capacity * 2 : 1024;
+	unsigned int* keys = (unsigned int*)calloc((size_t)capacity, sizeof(unsigned int));
+	PostingList* lists = (PostingList*)malloc((size_t)capacity * sizeof(PostingList));
+	if (keys == NULL || lists == NULL) {
+		free(keys);
+		free(lists);
+		return 0;
+	}
+	for (int i = 0; i < index->capacity; i++) {
+		if (index->keys[i] != 0) {
+			unsigned int j = trigram_hash(index->keys[i], capacity);
+			while (keys[j] != 0) {
+				j = (j + 1) & (unsigned int)(capacity - 1);
+			}
+			keys[j] = index->keys[i];
+			lists[j] = index->lists[i];
+		}
+	}
+	free(index->keys);
+	free(index->lists);
+	index->keys = keys;
+	index->lists = lists;
+	index->capacity = capacity;
+	return 1;
+}
+
+/*
+* Posting list of key, created empty if it does not exist yet, NULL if out of memory
+*/
+static PostingList* trigram_get(TrigramIndex* index, unsigned int key)
+{
+	PostingList* list = trigram_find(index, key);
+	if (list != NULL) {
+		return list;
+	}
+	//keep the table at most 3/4 full
+	if ((index->count + 1) * 4 > index->capacity * 3 && !trigram_grow(index)) {
+		return NULL;
+	}
+	unsigned int i = trigram_hash(key, index->capacity);
+	while (index->keys[i] != 0) {
+		i = (i + 1) & (unsigned int)(index->capacity - 1);
+	}
+	index->keys[i] = key;
+	index->lists[i].slots = NULL;
+	index->lists[i].count = 0;
+	index->lists[i].capacity = 0;
+	index->count++;
+	return &index->lists[i];
+}
+
+static void trigram_free(TrigramIndex* index)
+{
+	for (int i = 0; i < index->capacity; i++) {
+		if (index->keys[i] != 0) {
+			free(index->lists[i].slots);
+		}
+	}
+	free(index->keys);
+	free(index->lists);
+	memset(index, 0, sizeof(*index));
+}
+
+/*
+* First position in slots[from..count) holding a value >= slot
+*/
+static int posting_lower_bound(const int* slots, int from, int count, int slot)
+{
+	while (from < count) {
+		int middle = from + (count - from) / 2;
+		if (slots[middle] < slot) {
+			from = middle + 1;
+		}
+		else {
+			count = middle;
+		}
+	}
+	return from;
+}
+
+/*
+* Add slot to a posting list, keeping it sorted, a slot already listed is not added again
+* lists start small and double (most trigrams belong to a handful of records)
+* returns 0 if out of memory
+*/
+int posting_insert(PostingList* list, int slot)
+{
+	int at = list->count;
+	if (at > 0 && list->slots[at - 1] >= slot) {
+		at = posting_lower_bound(list->slots, 0, list->count, slot);
+		if (at < list->count && list->slots[at] == slot) {
+			return 1; //the trigram appears twice in the same text
+		}
+	}
+	if (list->count == list->capacity) {
+		int capacity = (list->capacity > 0) ? list->capacity * 2 : 4;
+		int* grown = (int*)realloc(list->slots, (size_t)capacity * sizeof(int));
+		if (grown == NULL) {
+			return 0;
+		}
+		list->slots = grown;
+		list->capacity = capacity;
+	}
+	memmove(&list->slots[at + 1], &list->slots[at], (size_t)(list->count - at) * sizeof(int));
+	list->slots[at] = slot;
+	list->count++;
+	return 1;
+}
+
+void posting_remove(PostingList* list, int slot)
+{
+	int at = posting_lower_bound(list->slots, 0, list->count, slot);
+	if (at < list->count && list->slots[at] == slot) {
+		memmove(&list->slots[at], &list->slots[at + 1], (size_t)(list->count - at - 1) * sizeof(int));
+		list->count--;
+	}
+}
+
+/*
+* Add every trigram of a folded text for slot, returns 0 if out of memory
+*/
+static int trigram_add_text(TrigramIndex* index, const char* folded, int slot)
+{
+	size_t length = strlen(folded);
+	for (size_t i = 0; i + SEARCH_TRIGRAM_LENGTH <= length; i++) {
+		PostingList* list = trigram_get(index, trigram_key(folded + i));
+		if (list == NULL || !posting_insert(list, slot)) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static void trigram_remove_text(TrigramIndex* index, const char* folded, int slot)
+{
+	size_t length = strlen(folded);
+	for (size_t i = 0; i + SEARCH_TRIGRAM_LENGTH <= length; i++) {
+		PostingList* list = trigram_find(index, trigram_key(folded + i));
+		if (list != NULL) {
+			posting_remove(list, slot); //empty lists stay in the table, the trigram may come back
+		}
+	}
+}
+
+void search_index_init(SearchIndex* search)
+{
+	memset(search, 0, sizeof(*search));
+}
+
+/*
+* Release the index, the next query that needs it builds it again
+*/
+void search_index_free(SearchIndex* search)
+{
+	trigram_free(&search->name);
+	free(search->positions);
+	search_index_init(search);
+}
+
+/*
+* Index every record, slots are visited in ascending order so every posting list is built by appending
+* returns 1 if the index is ready, 0 if memory ran out (queries then scan)
+*/
+int search_index_build(CMSdb* db)
+{
+	const RecordArena* arena = &db->arena;
+
+	if (db->search.built) {
+		return 1;
+	}
+	unsigned char* live = (unsigned char*)calloc((size_t)arena->slot_count / 8 + 1, 1);
+	if (live == NULL) {
+		return 0;
+	}
+	for (int i = 0; i < db->record_count; i++) {
+		live[db->order[i] >> 3] |= (unsigned char)(1u << (db->order[i] & 7));
+	}
+	int ok = 1;
+	for (int slot = 0; slot < arena->slot_count && ok; slot++) {
+		if (live[slot >> 3] & (1u << (slot & 7))) {
+			ok = trigram_add_text(&db->search.name, arena_folded_name(arena, slot), slot);
+		}
+	}
+	free(live);
+	if (!ok) {
+		search_index_free(&db->search);
+		return 0;
+	}
+	db->search.built = 1;
+	return 1;
+}
+
+/*
+* Index the folded text of slot (a record was inserted or edited), does nothing before the index is built
+*/
+void search_index_add(CMSdb* db, int slot)
+{
+	if (!db->search.built) {
+		return;
+	}
+	if (!trigram_add_text(&db->search.name, arena_folded_name(&db->arena, slot), slot)) {
+		search_index_free(&db->search); //an incomplete index would miss records, rebuild it later
+	}
+}
+
+/*
+* Forget the folded text of slot (a record is removed, or about to get new text)
+*/
+void search_index_remove(CMSdb* db, int slot)
+{
+	if (!db->search.built) {
+		return;
+	}
+	trigram_remove_text(&db->search.name, arena_folded_name(&db->arena, slot), slot);
+}
+
+/*
+* Check whether text contains the trigram starting at trigram
+*/
+static int has_trigram(const char* text, const char* trigram)
+{
+	for (size_t i = 0; text[i] != '\0' && text[i + 1] != '\0' && text[i + 2] != '\0'; i++) {
+		if (text[i] == trigram[0] && text[i + 1] == trigram[1] && text[i + 2] == trigram[2]) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+* Move slot from the lists of old_text's trigrams to those of new_text's, trigrams in both stay untouched
+* (posting lists of common trigrams are long, and most edits keep most of the text)
+* returns 0 if out of memory
+*/
+static int trigram_replace_text(TrigramIndex* index, const char* old_text, const char* new_text, int slot)
+{
+	size_t old_length = strlen(old_text);
+	size_t new_length = strlen(new_text);
+
+	for (size_t i = 0; i + SEARCH_TRIGRAM_LENGTH <= old_length; i++) {
+		if (!has_trigram(new_text, old_text + i)) {
+			PostingList* list = trigram_find(index, trigram_key(old_text + i));
+			if (list != NULL) {
+				posting_remove(list, slot);
+			}
+		}
+	}
+	for (size_t i = 0; i + SEARCH_TRIGRAM_LENGTH <= new_length; i++) {
+		if (!has_trigram(old_text, new_text + i)) {
+			PostingList* list = trigram_get(index, trigram_key(new_text + i));
+			if (list == NULL || !posting_insert(list, slot)) {
+				return 0;
+			}
+		}
+	}
+	return 1;
+}
+
+/*
+* The folded name of slot (still in the column) is about to be replaced by name
+*/
+void search_index_update(CMSdb* db, int slot, const char* name)
+{
+	if (!db->search.built) {
+		return;
+	}
+	if (!trigram_replace_text(&db->search.name, arena_folded_name(&db->arena, slot), name, slot)) {
+		search_index_free(&db->search);
+	}
+}
+
+/*
+* Display position of every slot, rebuilt with one pass over the order array after records move
+*/
+int search_positions(CMSdb* db)
+{
+	SearchIndex* search = &db->search;
+
+	if (search->positions_valid) {
+		return 1;
+	}
+	if (!grow_int_array(&search->positions, &search->positions_capacity, db->arena.slot_count)) {
+		return 0;
+	}
+	for (int i = 0; i < db->record_count; i++) {
+		search->positions[db->order[i]] = i;
+	}
+	search->positions_valid = 1;
+	return 1;
+}
+
+/*
+* Slots that contain every trigram of needle: the shortest posting list, filtered by binary searches in the others
+* candidates come out ascending, so each search starts where the previous one ended
+* returns the number of candidates, -1 if out of memory, -2 if even the shortest list is longer than max_candidates
+*/
+static int trigram_candidates(const TrigramIndex* index, const char* needle, int** candidates, int* capacity, int max_candidates)
+{
+	const PostingList* lists[MAX_NAME_LENGTH];
+	int cursors[MAX_NAME_LENGTH];
+	int list_count = 0;
+	size_t length = strlen(needle);
+	int count = 0;
+
+	for (size_t i = 0; i + SEARCH_TRIGRAM_LENGTH <= length; i++) {
+		const PostingList* list = trigram_find(index, trigram_key(needle + i));
+		if (list == NULL || list->count == 0) {
+			return 0; //no record has this trigram
+		}
+		lists[list_count] = list;
+		cursors[list_count++] = 0;
+	}
+	int shortest = 0;
+	for (int i = 1; i < list_count; i++) {
+		if (lists[i]->count < lists[shortest]->count) {
+			shortest = i;
+		}
+	}
+	if (lists[shortest]->count > max_candidates) {
+		return -2;
+	}
+
+	for (int k = 0; k < lists[shortest]->count; k++) {
+		int slot = lists[shortest]->slots[k];
+		int in_all = 1;
+		for (int i = 0; i < list_count && in_all; i++) {
+			if (i == shortest) {
+				continue;
+			}
+			cursors[i] = posting_lower_bound(lists[i]->slots, cursors[i], lists[i]->count, slot);
+			in_all = cursors[i] < lists[i]->count && lists[i]->slots[cursors[i]] == slot;
+		}
+		if (in_all) {
+			if (!grow_int_array(candidates, capacity, count + 1)) {
+				return -1;
+			}
+			(*candidates)[count++] = slot;
+		}
+	}
+	return count;
+}
+
+static int compare_position(const void* a, const void* b)
+{
+	int position_a = *(const int*)a;
+	int position_b = *(const int*)b;
+	return (position_a > position_b) - (position_a < position_b);
+}
+
+/*
+* Turn a list of matching slots (overwritten) into their display positions in display order, stored in *matches
+* a few matches are sorted, many are marked in a bitmap over positions and read back
+* returns count, or -1 if out of memory
+*/
+int search_display_order(CMSdb* db, int* slots, int count, int** matches, int* capacity)
+{
+	if (count == 0) {
+		return 0;
+	}
+	if (!search_positions(db) || !grow_int_array(matches, capacity, count)) {
+		return -1;
+	}
+	for (int i = 0; i < count; i++) {
+		slots[i] = db->search.positions[slots[i]];
+	}
+
+	if (count < db->record_count / 256 + 1) {
+		qsort(slots, (size_t)count, sizeof(int), compare_position);
+		memcpy(*matches, slots, (size_t)count * sizeof(int));
+		return count;
+	}
+	unsigned long long* hits = (unsigned long long*)calloc((size_t)db->record_count / 64 + 1, sizeof(unsigned long long));
+	if (hits == NULL) {
+		return -1;
+	}
+	for (int i = 0; i < count; i++) {
+		hits[slots[i] >> 6] |= 1ull << (slots[i] & 63);
+	}
+	int found = 0;
+	for (int word = 0; found < count; word++) {
+		for (unsigned long long bits = hits[word]; bits != 0; bits &= bits - 1) {
+			int bit = 0;
+			while (!(bits & (1ull << bit))) {
+				bit++;
+			}
+			(*matches)[found++] = word * 64 + bit;
+		}
+	}
+	free(hits);
+	return count;
+}
+
+/*
+* Find every record whose name or programme (field = SEARCH_FIELD_*) contains text, ignoring case
+* name queries of SEARCH_TRIGRAM_LENGTH+ characters go through the trigram index (built here on first use),
+* programme queries, shorter ones, or all of them in SEARCH_MODE_SCAN, use search_records_scan
+* stores the display indices in *matches (grown as needed) and returns how many there are, -1 if out of memory
+*/
+int search_records(CMSdb* db, int field, const char* text, int** matches, int* capacity)
+{
+	char needle[MAX_NAME_LENGTH];
+
+	fold_text(needle, text, sizeof(needle));
+	if (field != SEARCH_FIELD_NAME || db->options.search_mode != SEARCH_MODE_TRIGRAM ||
+		strlen(needle) < SEARCH_TRIGRAM_LENGTH || !search_index_build(db) || !search_positions(db)) {
+		return search_records_scan(db, field, text, matches, capacity);
+	}
+
+	const TrigramIndex* index = &db->search.name;
+	int* candidates = NULL;
+	int candidate_capacity = 0;
+	int candidate_count = trigram_candidates(index, needle, &candidates, &candidate_capacity, db->record_count / SEARCH_SCAN_FRACTION);
+	if (candidate_count == -2) {
+		return search_records_scan(db, field, text, matches, capacity); //too common, a straight scan is faster
+	}
+	if (candidate_count <= 0) {
+		free(candidates);
+		return candidate_count;
+	}
+
+	int count = 0;
+	for (int i = 0; i < candidate_count; i++) {
+		if (strstr(arena_folded_name(&db->arena, candidates[i]), needle) != NULL) {
+			candidates[count++] = candidates[i];
+		}
+	}
+	count = search_display_order(db, candidates, count, matches, capacity);
+	free(candidates);
+	return count;
+}
@@ -0,0 +1,177 @@
+/*
+* Course Management System (CMS)
+* Delimiter scanning - offsets of every tab and newline in a buffer
+* AVX2 (32 bytes per step) or SSE2 (16 bytes per step) when the CPU has them, byte loop otherwise
+*/
+
+#include "cms.h"
+
+#if defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define CMS_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(CMS_HAVE_SSE2) && (defined(_MSC_VER) || defined(__GNUC__) || defined(__clang__))
+#define CMS_HAVE_AVX2 1
+#include <immintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define CMS_TARGET_AVX2
+#else
+#define CMS_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+/*
+* Index of the lowest set bit, mask must not be 0
+*/
+static unsigned int lowest_bit(unsigned int mask)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return (unsigned int)index;
+#else
+	return (unsigned int)__builtin_ctz(mask);
+#endif
+}
+
+/*
+* Byte at a time, used for the tail of the buffer and on CPUs without SSE2
+*/
+static size_t scan_scalar(const char* data, size_t start, size_t length, unsigned int* offsets, size_t count)
+{
+	for (size_t i = start; i < length; i++) {
+		if (data[i] == '\t' || data[i] == '\n') {
+			offsets[count++] = (unsigned int)i;
+		}
+	}
+	return count;
+}
+
+#ifdef CMS_HAVE_SSE2
+static size_t scan_sse2(const char* data, size_t length, unsigned int* offsets)
+{
+	const __m128i tab = _mm_set1_epi8('\t');
+	const __m128i newline = _mm_set1_epi8('\n');
+	size_t count = 0;
+	size_t i = 0;
+
+	for (; i + 16 <= length; i += 16) {
+		__m128i block = _mm_loadu_si128((const __m128i*)(data + i));
+		__m128i hits = _mm_or_si128(_mm_cmpeq_epi8(block, tab), _mm_cmpeq_epi8(block, newline));
+		unsigned int mask = (unsigned int)_mm_movemask_epi8(hits);
+		while (mask != 0) {
+			offsets[count++] = (unsigned int)i + lowest_bit(mask);
+			mask &= mask - 1; //clear the lowest set bit
+		}
+	}
+	return scan_scalar(data, i, length, offsets, count);
+}
+#endif
+
+#ifdef CMS_HAVE_AVX2
+CMS_TARGET_AVX2
+static size_t scan_avx2(const char* data, size_t length, unsigned int* offsets)
+{
+	const __m256i tab = _mm256_set1_epi8('\t');
+	const __m256i newline = _mm256_set1_epi8('\n');
+	size_t count = 0;
+	size_t i = 0;
+
+	for (; i + 32 <= length; i += 32) {
+		__m256i block = _mm256_loadu_si256((const __m256i*)(data + i));
+		__m256i hits = _mm256_or_si256(_mm256_cmpeq_epi8(block, tab), _mm256_cmpeq_epi8(block, newline));
+		unsigned int mask = (unsigned int)_mm256_movemask_epi8(hits);
+		while (mask != 0) {
+			offsets[count++] = (unsigned int)i + lowest_bit(mask);
+			mask &= mask - 1;
+		}
+	}
+	return scan_scalar(data, i, length, offsets, count);
+}
+
+/*
+* AVX2 needs CPU support and OS support for saving the YMM registers
+*/
+static int cpu_has_avx2(void)
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) {
+		return 0;
+	}
+	__cpuid(info, 1);
+	if (!(info[2] & (1 << 27)) || !(info[2] & (1 << 28))) { //OSXSAVE and AVX
+		return 0;
+	}
+	if ((_xgetbv(0) & 6) != 6) {
+		return 0;
+	}
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+/*
+* Check whether a scanner can run on this machine
+*/
+int delimiter_scanner_available(int scanner)
+{
+	switch (scanner) {
+	case DELIM_SCANNER_SCALAR:
+		return 1;
+#ifdef CMS_HAVE_SSE2
+	case DELIM_SCANNER_SSE2:
+		return 1;
+#endif
+#ifdef CMS_HAVE_AVX2
+	case DELIM_SCANNER_AVX2:
+		return cpu_has_avx2();
+#endif
+	default:
+		return 0;
+	}
+}
+
+/*
+* Scan with one particular implementation (benchmarks compare them)
+* offsets must have room for "length" entries
+*/
+size_t scan_delimiters_with(int scanner, const char* data, size_t length, unsigned int* offsets)
+{
+	switch (scanner) {
+#ifdef CMS_HAVE_AVX2
+	case DELIM_SCANNER_AVX2:
+		return scan_avx2(data, length, offsets);
+#endif
+#ifdef CMS_HAVE_SSE2
+	case DELIM_SCANNER_SSE2:
+		return scan_sse2(data, length, offsets);
+#endif
+	default:
+		return scan_scalar(data, 0, length, offsets, 0);
+	}
+}
+
+/*
+* Write the offset of every '\t' and '\n' in data to offsets, in order, and return how many there are
+* offsets must have room for "length" entries, length must be below 4GB
+* the fastest scanner the CPU supports is picked on the first call
+*/
+size_t scan_delimiters(const char* data, size_t length, unsigned int* offsets)
+{
+	static int best_scanner = -1;
+
+	if (best_scanner < 0) {
+		best_scanner = delimiter_scanner_available(DELIM_SCANNER_AVX2) ? DELIM_SCANNER_AVX2 :
+			delimiter_scanner_available(DELIM_SCANNER_SSE2) ? DELIM_SCANNER_SSE2 : DELIM_SCANNER_SCALAR;
+	}
+	return scan_delimiters_with(best_scanner, data, length, offsets);
+}
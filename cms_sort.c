@@ -0,0 +1,1039 @@
+/*
+* Course Management System (CMS)
+* Sort engine - display orders by ID or mark without comparison callbacks
+* every key is copied once into an array next to its slot, then sorted by LSD radix sort:
+* 7 digit IDs take two passes of 12 bits, marks (0..1000 tenths) take one pass, which is a counting sort
+* the sort is stable, records with the same key keep their relative order
+* qsort with the comparators below is kept for when the key arrays cannot be allocated
+*
+* sort views: each order the sort menu offers is kept as its own permutation of the slots (SortViews),
+* built by the first sort by that key and then kept up to date by cms_store.c (binary search and one memmove),
+* so sorting again, or going back to insertion order, only swaps db->order with the cached permutation
+* sorted views have no ties: equal marks are ordered by ascending ID, so every view is one fixed order
+*
+* multi-key sort (SortSpec, e.g. "programme asc, mark desc, name asc"): every record gets a fixed-width
+* key built once, the fields one after another in big-endian bytes (inverted for descending), so a
+* single memcmp orders two records; programmes are ranked alphabetically through the dictionary, names
+* use the first SORT_NAME_PREFIX bytes of the folded column and only compare the rest when those are equal
+* the keys are merge sorted, which is stable: records equal in every field keep the order they had
+* the result is shown as the custom view, a one-off order that is not cached or kept sorted
+*
+* from SORT_PARALLEL_MIN records on both sorts split the array over options.thread_count threads (parallel_for):
+* the radix sort gives every range its own histogram, the merge sort sorts ranges and merges them in parallel,
+* and both produce exactly the order of the sequential sort
+*/
+
+#include "cms.h"
+#include <limits.h>
+
+#define SORT_RADIX_BITS 12
+#define SORT_RADIX_BUCKETS (1 << SORT_RADIX_BITS)
+#define SORT_RADIX_PASSES_MAX ((32 + SORT_RADIX_BITS - 1) / SORT_RADIX_BITS)
+#define SORT_NAME_PREFIX 16 //bytes of the folded name kept in a sort key
+#define SORT_KEY_BYTES (4 + 2 + 2 + SORT_NAME_PREFIX) //ID, mark, programme rank, name prefix
+#define SORT_INSERTION_RUN 32 //merge sort starts from runs of this many entries sorted by insertion sort
+#define SORT_PARALLEL_MIN 100000 //fewer records sort faster on one thread
+
+static int sort_key_value(const StoredRecord* record, int key)
+{
+	return (key == SORT_KEY_MARK) ? record->mark_tenths : record->id;
+}
+
+/*
+* One radix sort split into task_count contiguous ranges of the array
+* every step runs the ranges in parallel; each range has its own histogram, and the bucket offsets
+* are handed out range by range, so a parallel pass puts every entry exactly where a sequential one would
+*/
+typedef struct {
+	const RecordArena* arena;
+	int key;
+	int descending;
+	int count;
+	int task_count;
+	const int* slots; //input of the gather step
+	unsigned int* keys;
+	int* lows; //smallest and largest key of each range
+	int* highs;
+	unsigned int low, high; //of all keys
+	int shift; //digit of the current pass
+	const unsigned int* from_keys;
+	const int* from_slots;
+	unsigned int* to_keys;
+	int* to_slots;
+	unsigned int (*counts)[SORT_RADIX_BUCKETS]; //one histogram per range, then its first position in each bucket
+} RadixJob;
+
+static void radix_range(const RadixJob* job, int task, int* begin, int* end)
+{
+	*begin = (int)((long long)job->count * task / job->task_count);
+	*end = (int)((long long)job->count * (task + 1) / job->task_count);
+}
+
+//copy the keys of a range next to its slots, remembering the range's smallest and largest key
+static void radix_gather_task(void* context, int task)
+{
+	RadixJob* job = (RadixJob*)context;
+	int begin, end;
+	int low = INT_MAX, high = INT_MIN;
+
+	radix_range(job, task, &begin, &end);
+	for (int i = begin; i < end; i++) {
+		int value = sort_key_value(arena_record(job->arena, job->slots[i]), job->key);
+		job->keys[i] = (unsigned int)value;
+		if (value < low) low = value;
+		if (value > high) high = value;
+	}
+	job->lows[task] = low;
+	job->highs[task] = high;
+}
+
+//shift the keys so the smallest one is 0 (or the largest one for descending)
+static void radix_normalize_task(void* context, int task)
+{
+	RadixJob* job = (RadixJob*)context;
+	int begin, end;
+
+	radix_range(job, task, &begin, &end);
+	for (int i = begin; i < end; i++) {
+		job->keys[i] = job->descending ? job->high - job->keys[i] : job->keys[i] - job->low;
+	}
+}
+
+static void radix_count_task(void* context, int task)
+{
+	RadixJob* job = (RadixJob*)context;
+	unsigned int* counts = job->counts[task];
+	int begin, end;
+
+	radix_range(job, task, &begin, &end);
+	memset(counts, 0, sizeof(job->counts[task]));
+	for (int i = begin; i < end; i++) {
+		counts[(job->from_keys[i] >> job->shift) & (SORT_RADIX_BUCKETS - 1)]++;
+	}
+}
+
+static void radix_scatter_task(void* context, int task)
+{
+	RadixJob* job = (RadixJob*)context;
+	unsigned int* positions = job->counts[task];
+	int begin, end;
+
+	radix_range(job, task, &begin, &end);
+	for (int i = begin; i < end; i++) {
+		unsigned int position = positions[(job->from_keys[i] >> job->shift) & (SORT_RADIX_BUCKETS - 1)]++;
+		job->to_keys[position] = job->from_keys[i];
+		job->to_slots[position] = job->from_slots[i];
+	}
+}
+
+/*
+* Radix sort of count slots by key (SORT_KEY_*), descending reverses the key so ties still keep their order
+* runs on up to thread_count threads from SORT_PARALLEL_MIN records on, the result is the same either way
+* returns 1 if sorted, 0 if out of memory (slots is unchanged then)
+*/
+int sort_slots_radix(const RecordArena* arena, int* slots, int count, int key, int descending, int thread_count)
+{
+	RadixJob job;
+
+	if (count < 2) {
+		return 1;
+	}
+	job.arena = arena;
+	job.key = key;
+	job.descending = descending;
+	job.count = count;
+	job.task_count = (count >= SORT_PARALLEL_MIN && thread_count > 1) ? thread_count : 1;
+	job.slots = slots;
+	job.keys = (unsigned int*)malloc((size_t)count * sizeof(unsigned int));
+	unsigned int* key_temp = (unsigned int*)malloc((size_t)count * sizeof(unsigned int));
+	int* slot_temp = (int*)malloc((size_t)count * sizeof(int));
+	job.counts = (unsigned int (*)[SORT_RADIX_BUCKETS])malloc((size_t)job.task_count * sizeof(*job.counts));
+	job.lows = (int*)malloc((size_t)job.task_count * 2 * sizeof(int));
+	if (job.keys == NULL || key_temp == NULL || slot_temp == NULL || job.counts == NULL || job.lows == NULL) {
+		free(job.keys);
+		free(key_temp);
+		free(slot_temp);
+		free(job.counts);
+		free(job.lows);
+		return 0;
+	}
+	job.highs = job.lows + job.task_count;
+
+	parallel_for(job.task_count, job.task_count, radix_gather_task, &job);
+	int low = INT_MAX, high = INT_MIN;
+	for (int task = 0; task < job.task_count; task++) {
+		if (job.lows[task] < low) low = job.lows[task];
+		if (job.highs[task] > high) high = job.highs[task];
+	}
+	job.low = (unsigned int)low;
+	job.high = (unsigned int)high;
+	parallel_for(job.task_count, job.task_count, radix_normalize_task, &job);
+
+	//only as many passes as the key range needs
+	unsigned int range = job.high - job.low;
+	int passes = 0;
+	while (passes < SORT_RADIX_PASSES_MAX && (range >> (passes * SORT_RADIX_BITS)) != 0) {
+		passes++;
+	}
+
+	job.from_keys = job.keys;
+	job.from_slots = slots;
+	job.to_keys = key_temp;
+	job.to_slots = slot_temp;
+	for (int pass = 0; pass < passes; pass++) {
+		job.shift = pass * SORT_RADIX_BITS;
+		parallel_for(job.task_count, job.task_count, radix_count_task, &job);
+		unsigned int total = 0;
+		for (int b = 0; b < SORT_RADIX_BUCKETS; b++) {
+			for (int task = 0; task < job.task_count; task++) {
+				unsigned int c = job.counts[task][b];
+				job.counts[task][b] = total; //now where this range's entries of bucket b start
+				total += c;
+			}
+		}
+		parallel_for(job.task_count, job.task_count, radix_scatter_task, &job);
+
+		unsigned int* next_keys = job.to_keys;
+		int* next_slots = job.to_slots;
+		job.to_keys = (unsigned int*)job.from_keys;
+		job.to_slots = (int*)job.from_slots;
+		job.from_keys = next_keys;
+		job.from_slots = next_slots;
+	}
+	if (job.from_slots != slots) {
+		memcpy(slots, job.from_slots, (size_t)count * sizeof(int));
+	}
+
+	free(job.keys);
+	free(key_temp);
+	free(slot_temp);
+	free(job.counts);
+	free(job.lows);
+	return 1;
+}
+
+//comparison functions for qsort
+//qsort moves slot numbers, sort_arena lets the comparators reach the records behind them
+//equal marks are ordered by ID, the same order the radix sort gives when it sorts by ID first
+static const RecordArena* sort_arena;
+
+static int compare_id_asc(const void* a, const void* b)
+{
+	const StoredRecord* recordA = arena_record(sort_arena, *(const int*)a);
+	const StoredRecord* recordB = arena_record(sort_arena, *(const int*)b);
+	return (recordA->id > recordB->id) - (recordA->id < recordB->id);
+}
+static int compare_id_desc(const void* a, const void* b)
+{
+	return compare_id_asc(b, a);
+}
+static int compare_mark_asc(const void* a, const void* b)
+{
+	const StoredRecord* recordA = arena_record(sort_arena, *(const int*)a);
+	const StoredRecord* recordB = arena_record(sort_arena, *(const int*)b);
+	if (recordA->mark_tenths != recordB->mark_tenths) {
+		return (recordA->mark_tenths > recordB->mark_tenths) ? 1 : -1;
+	}
+	return compare_id_asc(a, b);
+}
+static int compare_mark_desc(const void* a, const void* b)
+{
+	const StoredRecord* recordA = arena_record(sort_arena, *(const int*)a);
+	const StoredRecord* recordB = arena_record(sort_arena, *(const int*)b);
+	if (recordA->mark_tenths != recordB->mark_tenths) {
+		return (recordA->mark_tenths < recordB->mark_tenths) ? 1 : -1;
+	}
+	return compare_id_asc(a, b);
+}
+
+/*
+* Sort count slots with qsort and a comparator
+*/
+void sort_slots_qsort(const RecordArena* arena, int* slots, int count, int key, int descending)
+{
+	int (*compare)(const void*, const void*);
+	if (key == SORT_KEY_MARK) {
+		compare = descending ? compare_mark_desc : compare_mark_asc;
+	}
+	else {
+		compare = descending ? compare_id_desc : compare_id_asc;
+	}
+	sort_arena = arena;
+	qsort(slots, (size_t)count, sizeof(int), compare);
+}
+
+/*
+* Where a record with this ID and mark goes in a sorted view: < 0 before the record in slot, > 0 after it
+*/
+static int view_compare(const RecordArena* arena, int view, int id, int tenths, int slot)
+{
+	const StoredRecord* other = arena_record(arena, slot);
+	if (view == SORT_VIEW_MARK_ASC && tenths != other->mark_tenths) {
+		return (tenths > other->mark_tenths) ? 1 : -1;
+	}
+	if (view == SORT_VIEW_MARK_DESC && tenths != other->mark_tenths) {
+		return (tenths < other->mark_tenths) ? 1 : -1;
+	}
+	if (view == SORT_VIEW_ID_DESC) {
+		return (id < other->id) - (id > other->id);
+	}
+	return (id > other->id) - (id < other->id);
+}
+
+/*
+* First position of a sorted view whose record does not come before (id, tenths)
+*/
+static int view_lower_bound(const RecordArena* arena, int view, const int* slots, int count, int id, int tenths)
+{
+	int low = 0, high = count;
+	while (low < high) {
+		int middle = low + (high - low) / 2;
+		if (view_compare(arena, view, id, tenths, slots[middle]) > 0) {
+			low = middle + 1;
+		}
+		else {
+			high = middle;
+		}
+	}
+	return low;
+}
+
+/*
+* Position of slot in view, which holds count slots, -1 if it is not there
+* sorted views are searched by the record's ID and mark, the insertion and custom views are scanned
+*/
+static int view_find(const CMSdb* db, int view, const int* slots, int count, int slot)
+{
+	if (view == SORT_VIEW_INSERTION || view == SORT_VIEW_CUSTOM) {
+		for (int i = 0; i < count; i++) {
+			if (slots[i] == slot) {
+				return i;
+			}
+		}
+		return -1;
+	}
+	const StoredRecord* record = arena_record(&db->arena, slot);
+	int i = view_lower_bound(&db->arena, view, slots, count, record->id, record->mark_tenths);
+	return (i < count && slots[i] == slot) ? i : -1;
+}
+
+/*
+* Display position of slot when a view other than insertion order is shown (a binary search for sorted views),
+* -1 if not found or if insertion order is shown (the caller scans then)
+*/
+int sort_view_index_of_slot(const CMSdb* db, int slot)
+{
+	if (db->views.shown == SORT_VIEW_INSERTION) {
+		return -1;
+	}
+	return view_find(db, db->views.shown, db->order, db->record_count, slot);
+}
+
+/*
+* Display position a new record in slot gets while a sorted view (sort_view_is_keyed) is shown
+*/
+int sort_view_insert_position(const CMSdb* db, int slot)
+{
+	const StoredRecord* record = arena_record(&db->arena, slot);
+	return view_lower_bound(&db->arena, db->views.shown, db->order, db->record_count, record->id, record->mark_tenths);
+}
+
+/*
+* Forget a cached view, it is built again the next time it is shown
+*/
+static void view_drop(SortViews* views, int view)
+{
+	free(views->views[view].slots);
+	views->views[view].slots = NULL;
+	views->views[view].capacity = 0;
+}
+
+/*
+* A record was stored in slot: add it to every cached view that is not shown (db->order is done by the caller)
+* the insertion view gets it at the end, sorted views where its ID and mark put it
+* called before record_count counts the new record
+*/
+void sort_views_add(CMSdb* db, int slot)
+{
+	SortViews* views = &db->views;
+	const StoredRecord* record = arena_record(&db->arena, slot);
+	int count = db->record_count;
+
+	for (int view = 0; view < SORT_VIEW_COUNT; view++) {
+		SortPermutation* permutation = &views->views[view];
+		if (view == views->shown || permutation->slots == NULL) {
+			continue;
+		}
+		if (!grow_int_array(&permutation->slots, &permutation->capacity, count + 1)) {
+			view_drop(views, view); //an incomplete view would miss records
+			continue;
+		}
+		int position = (view == SORT_VIEW_INSERTION) ? count :
+			view_lower_bound(&db->arena, view, permutation->slots, count, record->id, record->mark_tenths);
+		memmove(&permutation->slots[position + 1], &permutation->slots[position], (size_t)(count - position) * sizeof(int));
+		permutation->slots[position] = slot;
+	}
+}
+
+/*
+* The record in slot is about to be removed: take it out of every cached view that is not shown
+* called while the record is still stored and counted in record_count
+*/
+void sort_views_remove(CMSdb* db, int slot)
+{
+	SortViews* views = &db->views;
+	int count = db->record_count;
+
+	for (int view = 0; view < SORT_VIEW_COUNT; view++) {
+		SortPermutation* permutation = &views->views[view];
+		if (view == views->shown || permutation->slots == NULL) {
+			continue;
+		}
+		int position = view_find(db, view, permutation->slots, count, slot);
+		if (position < 0) {
+			view_drop(views, view);
+			continue;
+		}
+		memmove(&permutation->slots[position], &permutation->slots[position + 1], (size_t)(count - position - 1) * sizeof(int));
+	}
+}
+
+/*
+* The records whose slots are set in marked are about to be removed (db_remove_marked):
+* compact every cached view that is not shown, the order of the others does not change
+*/
+void sort_views_remove_marked(CMSdb* db, const unsigned char* marked)
+{
+	SortViews* views = &db->views;
+
+	for (int view = 0; view < SORT_VIEW_COUNT; view++) {
+		int* slots = views->views[view].slots;
+		if (view == views->shown || slots == NULL) {
+			continue;
+		}
+		int kept = 0;
+		for (int i = 0; i < db->record_count; i++) {
+			if (!(marked[slots[i] >> 3] & (1u << (slots[i] & 7)))) {
+				slots[kept++] = slots[i];
+			}
+		}
+	}
+}
+
+/*
+* The mark of the record in slot is about to become tenths: move it within both mark views, the shown one included
+* called before the new mark is stored, the binary searches still see the old one
+*/
+void sort_views_update_mark(CMSdb* db, int slot, int tenths)
+{
+	SortViews* views = &db->views;
+	const StoredRecord* record = arena_record(&db->arena, slot);
+	int count = db->record_count;
+
+	for (int view = SORT_VIEW_MARK_ASC; view <= SORT_VIEW_MARK_DESC; view++) {
+		int* slots = (view == views->shown) ? db->order : views->views[view].slots;
+		if (slots == NULL) {
+			continue;
+		}
+		int from = view_find(db, view, slots, count, slot);
+		if (from < 0) {
+			if (view != views->shown) {
+				view_drop(views, view);
+			}
+			continue;
+		}
+		//take the slot out, then find its new place among the others
+		memmove(&slots[from], &slots[from + 1], (size_t)(count - from - 1) * sizeof(int));
+		int to = view_lower_bound(&db->arena, view, slots, count - 1, record->id, tenths);
+		memmove(&slots[to + 1], &slots[to], (size_t)(count - 1 - to) * sizeof(int));
+		slots[to] = slot;
+		if (view == views->shown && from != to) {
+			db_order_changed(db);
+		}
+	}
+}
+
+/*
+* Put slots (count of them) in the order of view
+* sorted views sort by ID first so equal marks end up by ascending ID, the insertion view
+* (only rebuilt after running out of memory) falls back to ascending slot numbers, which is load order
+* until records are deleted
+*/
+static void view_sort(const RecordArena* arena, int view, int* slots, int count, int thread_count)
+{
+	int key = (view == SORT_VIEW_MARK_ASC || view == SORT_VIEW_MARK_DESC) ? SORT_KEY_MARK : SORT_KEY_ID;
+	int descending = (view == SORT_VIEW_ID_DESC || view == SORT_VIEW_MARK_DESC);
+
+	if (view == SORT_VIEW_INSERTION) {
+		unsigned char* live = (unsigned char*)calloc((size_t)arena->slot_count / 8 + 1, 1);
+		if (live != NULL) {
+			for (int i = 0; i < count; i++) {
+				live[slots[i] >> 3] |= (unsigned char)(1u << (slots[i] & 7));
+			}
+			int n = 0;
+			for (int slot = 0; slot < arena->slot_count; slot++) {
+				if (live[slot >> 3] & (1u << (slot & 7))) {
+					slots[n++] = slot;
+				}
+			}
+			free(live);
+		}
+		return;
+	}
+	int sorted = sort_slots_radix(arena, slots, count, SORT_KEY_ID, key == SORT_KEY_ID && descending, thread_count);
+	if (sorted && key == SORT_KEY_MARK) {
+		sorted = sort_slots_radix(arena, slots, count, SORT_KEY_MARK, descending, thread_count);
+	}
+	if (!sorted) {
+		sort_slots_qsort(arena, slots, count, key, descending);
+	}
+}
+
+/*
+* Make the built view the one in db->order, the view shown until now is cached (a custom order is dropped)
+*/
+static void view_swap_in(CMSdb* db, int view)
+{
+	SortViews* views = &db->views;
+	SortPermutation* target = &views->views[view];
+	SortPermutation* current = &views->views[views->shown];
+
+	if (views->shown == SORT_VIEW_CUSTOM) {
+		free(db->order);
+	}
+	else {
+		current->slots = db->order;
+		current->capacity = db->order_capacity;
+	}
+	db->order = target->slots;
+	db->order_capacity = target->capacity;
+	target->slots = NULL;
+	target->capacity = 0;
+	views->shown = view;
+	db_order_changed(db);
+}
+
+/*
+* Show view (SORT_VIEW_*, not the custom one): swap it in as db->order, building it first if it is not cached
+* the view shown until now is kept, so switching back costs nothing
+* without memory for a second order db->order is sorted in place and the previous view is lost
+*/
+void sort_view_show(CMSdb* db, int view)
+{
+	SortViews* views = &db->views;
+	SortPermutation* target = &views->views[view];
+
+	if (view == views->shown) {
+		return;
+	}
+	if (target->slots == NULL) {
+		if (!grow_int_array(&target->slots, &target->capacity, db->record_count + 1)) {
+			view_sort(&db->arena, view, db->order, db->record_count, worker_thread_count(&db->options));
+			views->shown = view;
+			db_order_changed(db);
+			return;
+		}
+		memcpy(target->slots, db->order, (size_t)db->record_count * sizeof(int));
+		view_sort(&db->arena, view, target->slots, db->record_count, worker_thread_count(&db->options));
+	}
+
+	view_swap_in(db, view);
+}
+
+/*
+* A large batch of changes starts (db_begin_changes): cached sorted views are dropped, they are built again
+* when shown, and a sorted view being shown is treated as an unsorted custom order during the batch,
+* so inserts append to db->order instead of moving every later slot
+*/
+void sort_views_begin_changes(CMSdb* db)
+{
+	SortViews* views = &db->views;
+
+	for (int view = SORT_VIEW_ID_ASC; view <= SORT_VIEW_MARK_DESC; view++) {
+		if (view != views->shown) {
+			view_drop(views, view);
+		}
+	}
+	if (sort_view_is_keyed(views->shown)) {
+		views->batch_view = views->shown;
+		views->shown = SORT_VIEW_CUSTOM;
+	}
+}
+
+/*
+* The batch is done: sort db->order once to show the sorted view again
+*/
+void sort_views_end_changes(CMSdb* db)
+{
+	SortViews* views = &db->views;
+
+	if (sort_view_is_keyed(views->batch_view)) {
+		view_sort(&db->arena, views->batch_view, db->order, db->record_count, worker_thread_count(&db->options));
+		views->shown = views->batch_view;
+		views->batch_view = SORT_VIEW_INSERTION;
+		db_order_changed(db);
+	}
+}
+
+/*
+* Drop every cached view, the records are shown in insertion order again (db->order itself is kept)
+*/
+void sort_views_free(SortViews* views)
+{
+	for (int view = 0; view < SORT_VIEW_COUNT; view++) {
+		view_drop(views, view);
+	}
+	views->shown = SORT_VIEW_INSERTION;
+}
+
+/*
+* Multi-key sort
+*/
+typedef struct {
+	unsigned char key[SORT_KEY_BYTES];
+	int slot;
+	int truncated; //the folded name is longer than SORT_NAME_PREFIX
+} SortEntry;
+
+typedef struct {
+	const RecordArena* arena;
+	int width; //bytes of the key in use
+	int name_offset; //where the name prefix starts, -1 if the name is not a field
+	int name_end; //bytes up to the end of the name prefix (width if no name)
+	int name_descending;
+} SortLayout;
+
+static const char* sort_key_names[] = { "id", "mark", "name", "programme" };
+
+/*
+* Read a key spec: fields (id, name, programme, mark) separated by commas, each optionally followed by asc or desc
+* returns 1 if spec is filled, 0 if the text is not a valid spec (no field, unknown word, a field twice, too many)
+*/
+int sort_spec_parse(const char* text, SortSpec* spec)
+{
+	char words[2][16];
+	memset(spec, 0, sizeof(*spec));
+
+	while (*text != '\0') {
+		const char* end = strchr(text, ',');
+		size_t length = (end != NULL) ? (size_t)(end - text) : strlen(text);
+		char part[64];
+		if (length >= sizeof(part) || spec->count == SORT_SPEC_MAX) {
+			return 0;
+		}
+		memcpy(part, text, length);
+		part[length] = '\0';
+		fold_text(part, part, sizeof(part));
+
+		//one or two words: the field and the direction
+		int word_count = 0;
+		char* cursor = part;
+		while (word_count < 3) {
+			while (*cursor == ' ' || *cursor == '\t') cursor++;
+			if (*cursor == '\0') break;
+			if (word_count == 2) return 0;
+			size_t n = strcspn(cursor, " \t");
+			if (n >= sizeof(words[0])) return 0;
+			memcpy(words[word_count], cursor, n);
+			words[word_count][n] = '\0';
+			word_count++;
+			cursor += n;
+		}
+		if (word_count == 0) {
+			return 0;
+		}
+		int key = -1;
+		for (int k = 0; k < SORT_KEY_COUNT; k++) {
+			if (strcmp(words[0], sort_key_names[k]) == 0) key = k;
+		}
+		for (int i = 0; i < spec->count && key >= 0; i++) {
+			if (spec->keys[i] == key) key = -1;
+		}
+		if (key < 0) {
+			return 0;
+		}
+		int descending = 0;
+		if (word_count == 2) {
+			if (strcmp(words[1], "desc") == 0) descending = 1;
+			else if (strcmp(words[1], "asc") != 0) return 0;
+		}
+		spec->keys[spec->count] = key;
+		spec->descending[spec->count] = descending;
+		spec->count++;
+
+		text += length;
+		if (*text == ',') text++;
+	}
+	return spec->count > 0;
+}
+
+/*
+* "programme asc, mark desc" form of spec, for messages
+*/
+void sort_spec_format(const SortSpec* spec, char* text, size_t size)
+{
+	size_t used = 0;
+	text[0] = '\0';
+	for (int i = 0; i < spec->count && used < size; i++) {
+		int n = snprintf(text + used, size - used, "%s%s %s", (i > 0) ? ", " : "",
+			sort_key_names[spec->keys[i]], spec->descending[i] ? "desc" : "asc");
+		if (n < 0) break;
+		used += (size_t)n;
+	}
+}
+
+static const ProgrammeDictionary* sort_dictionary;
+
+static int compare_programme_code(const void* a, const void* b)
+{
+	int codeA = *(const int*)a, codeB = *(const int*)b;
+	int result = strcmp(sort_dictionary->folded[codeA], sort_dictionary->folded[codeB]);
+	return (result != 0) ? result : strcmp(sort_dictionary->names[codeA], sort_dictionary->names[codeB]);
+}
+
+/*
+* Alphabetical rank (ignoring case) of every programme code, so programmes sort as 2 byte numbers
+* returns NULL if out of memory
+*/
+static unsigned short* programme_ranks(const ProgrammeDictionary* dictionary)
+{
+	int* codes = (int*)malloc((size_t)(dictionary->count + 1) * sizeof(int));
+	unsigned short* ranks = (unsigned short*)malloc((size_t)(dictionary->count + 1) * sizeof(unsigned short));
+	if (codes == NULL || ranks == NULL) {
+		free(codes);
+		free(ranks);
+		return NULL;
+	}
+	for (int code = 0; code < dictionary->count; code++) {
+		codes[code] = code;
+	}
+	sort_dictionary = dictionary;
+	qsort(codes, (size_t)dictionary->count, sizeof(int), compare_programme_code);
+	for (int rank = 0; rank < dictionary->count; rank++) {
+		ranks[codes[rank]] = (unsigned short)rank;
+	}
+	free(codes);
+	return ranks;
+}
+
+static void put_big_endian(unsigned char* out, unsigned int value, int bytes, int descending)
+{
+	for (int i = bytes - 1; i >= 0; i--) {
+		out[i] = (unsigned char)(descending ? ~value : value);
+		value >>= 8;
+	}
+}
+
+/*
+* Fill the sort key of the record in slot
+*/
+static void build_sort_entry(const CMSdb* db, const SortSpec* spec, const unsigned short* ranks, int slot, SortEntry* entry)
+{
+	const StoredRecord* record = arena_record(&db->arena, slot);
+	unsigned char* out = entry->key;
+
+	entry->slot = slot;
+	entry->truncated = 0;
+	for (int i = 0; i < spec->count; i++) {
+		int descending = spec->descending[i];
+		switch (spec->keys[i]) {
+		case SORT_KEY_ID:
+			put_big_endian(out, (unsigned int)record->id ^ 0x80000000u, 4, descending);
+			out += 4;
+			break;
+		case SORT_KEY_MARK:
+			put_big_endian(out, (unsigned int)record->mark_tenths, 2, descending);
+			out += 2;
+			break;
+		case SORT_KEY_PROGRAMME:
+			put_big_endian(out, ranks[*arena_programme_code(&db->arena, slot)], 2, descending);
+			out += 2;
+			break;
+		case SORT_KEY_NAME: {
+			const char* folded = arena_folded_name(&db->arena, slot);
+			size_t length = strlen(folded);
+			size_t kept = (length < SORT_NAME_PREFIX) ? length : SORT_NAME_PREFIX;
+			memcpy(out, folded, kept);
+			memset(out + kept, 0, SORT_NAME_PREFIX - kept); //shorter names come first
+			if (descending) {
+				for (int b = 0; b < SORT_NAME_PREFIX; b++) out[b] = (unsigned char)~out[b];
+			}
+			entry->truncated = length > SORT_NAME_PREFIX;
+			out += SORT_NAME_PREFIX;
+			break;
+		}
+		}
+	}
+}
+
+/*
+* Order of two entries: one memcmp, except that names longer than the prefix compare the rest of the folded name
+*/
+static int compare_entries(const SortLayout* layout, const SortEntry* a, const SortEntry* b)
+{
+	int result = memcmp(a->key, b->key, (size_t)layout->name_end);
+	if (result != 0 || layout->name_offset < 0) {
+		return result;
+	}
+	if (a->truncated || b->truncated) {
+		result = strcmp(arena_folded_name(layout->arena, a->slot) + SORT_NAME_PREFIX,
+			arena_folded_name(layout->arena, b->slot) + SORT_NAME_PREFIX);
+		if (result != 0) {
+			return layout->name_descending ? -result : result;
+		}
+	}
+	return memcmp(a->key + layout->name_end, b->key + layout->name_end, (size_t)(layout->width - layout->name_end));
+}
+
+/*
+* Stable insertion sort of a short run
+*/
+static void insertion_sort_entries(const SortLayout* layout, SortEntry* entries, int count)
+{
+	for (int i = 1; i < count; i++) {
+		SortEntry entry = entries[i];
+		int j = i;
+		while (j > 0 && compare_entries(layout, &entries[j - 1], &entry) > 0) {
+			entries[j] = entries[j - 1];
+			j--;
+		}
+		entries[j] = entry;
+	}
+}
+
+/*
+* Merge the sorted runs left (left_count entries) and right into to, equal entries from the left run first
+*/
+static void merge_entries(const SortLayout* layout, const SortEntry* left, int left_count,
+	const SortEntry* right, int right_count, SortEntry* to)
+{
+	int a = 0, b = 0;
+	while (a < left_count && b < right_count) {
+		if (compare_entries(layout, &right[b], &left[a]) < 0) {
+			*to++ = right[b++];
+		}
+		else {
+			*to++ = left[a++];
+		}
+	}
+	memcpy(to, left + a, (size_t)(left_count - a) * sizeof(SortEntry));
+	memcpy(to + (left_count - a), right + b, (size_t)(right_count - b) * sizeof(SortEntry));
+}
+
+/*
+* How many of the first k merged entries come from the left run (a binary search, ties taken from the left)
+* lets several threads merge one pair of runs, each writing its own part of the output
+*/
+static int merge_split(const SortLayout* layout, const SortEntry* left, int left_count,
+	const SortEntry* right, int right_count, int k)
+{
+	int low = (k > right_count) ? k - right_count : 0;
+	int high = (k < left_count) ? k : left_count;
+	while (low < high) {
+		int i = low + (high - low) / 2;
+		if (compare_entries(layout, &left[i], &right[k - i - 1]) <= 0) {
+			low = i + 1; //left[i] is merged before right[k - i - 1], so more than i come from the left
+		}
+		else {
+			high = i;
+		}
+	}
+	return low;
+}
+
+/*
+* Bottom-up merge sort of count entries, temp is scratch space of the same size
+* returns the buffer holding the result (entries or temp)
+*/
+static SortEntry* merge_sort_entries(const SortLayout* layout, SortEntry* entries, SortEntry* temp, int count)
+{
+	for (int low = 0; low < count; low += SORT_INSERTION_RUN) {
+		int n = (count - low < SORT_INSERTION_RUN) ? count - low : SORT_INSERTION_RUN;
+		insertion_sort_entries(layout, entries + low, n);
+	}
+	SortEntry* from = entries;
+	SortEntry* to = temp;
+	for (int width = SORT_INSERTION_RUN; width < count; width *= 2) {
+		for (int low = 0; low < count; low += 2 * width) {
+			int middle = (low + width < count) ? low + width : count;
+			int high = (low + 2 * width < count) ? low + 2 * width : count;
+			merge_entries(layout, from + low, middle - low, from + middle, high - middle, to + low);
+		}
+		SortEntry* swap = from;
+		from = to;
+		to = swap;
+	}
+	return from;
+}
+
+/*
+* One multi-key sort split into chunk_count ranges: each chunk builds its keys and is merge sorted on its own,
+* then the sorted chunks are merged pairwise, each merge split into pieces when there are fewer pairs than threads
+*/
+typedef struct {
+	const CMSdb* db;
+	const SortSpec* spec;
+	const SortLayout* layout;
+	const unsigned short* ranks;
+	const int* slots;
+	SortEntry* entries;
+	SortEntry* temp;
+	int count;
+	int chunk_count;
+	int* bounds; //runs of the current round: run r is [bounds[r], bounds[r + 1])
+	int run_count;
+	int pieces; //parts each pair of runs is merged in
+	const SortEntry* from;
+	SortEntry* to;
+} MergeJob;
+
+static void merge_chunk_task(void* context, int chunk)
+{
+	MergeJob* job = (MergeJob*)context;
+	int begin = job->bounds[chunk], end = job->bounds[chunk + 1];
+
+	for (int i = begin; i < end; i++) {
+		build_sort_entry(job->db, job->spec, job->ranks, job->slots[i], &job->entries[i]);
+	}
+	SortEntry* sorted = merge_sort_entries(job->layout, job->entries + begin, job->temp + begin, end - begin);
+	if (sorted != job->entries + begin) {
+		memcpy(job->entries + begin, sorted, (size_t)(end - begin) * sizeof(SortEntry));
+	}
+}
+
+static void merge_piece_task(void* context, int task)
+{
+	MergeJob* job = (MergeJob*)context;
+	int pair = task / job->pieces, piece = task % job->pieces;
+	int low = job->bounds[2 * pair];
+	int middle = (2 * pair + 1 < job->run_count) ? job->bounds[2 * pair + 1] : job->bounds[job->run_count];
+	int high = (2 * pair + 2 <= job->run_count) ? job->bounds[2 * pair + 2] : middle; //a last run without a partner is copied
+	const SortEntry* left = job->from + low;
+	const SortEntry* right = job->from + middle;
+	int left_count = middle - low, right_count = high - middle;
+	int total = high - low;
+
+	int first = (int)((long long)total * piece / job->pieces);
+	int last = (int)((long long)total * (piece + 1) / job->pieces);
+	int left_first = merge_split(job->layout, left, left_count, right, right_count, first);
+	int left_last = merge_split(job->layout, left, left_count, right, right_count, last);
+	merge_entries(job->layout, left + left_first, left_last - left_first,
+		right + (first - left_first), (last - left_last) - (first - left_first), job->to + low + first);
+}
+
+/*
+* Stable sort of count slots by spec, on up to thread_count threads from SORT_PARALLEL_MIN records on
+* (the result is the same either way)
+* returns 1 if sorted, 0 if out of memory (slots is unchanged then)
+*/
+int sort_slots_by_spec(const CMSdb* db, const SortSpec* spec, int* slots, int count, int thread_count)
+{
+	SortLayout layout;
+	MergeJob job;
+	unsigned short* ranks = NULL;
+
+	layout.arena = &db->arena;
+	layout.width = 0;
+	layout.name_offset = -1;
+	layout.name_descending = 0;
+	for (int i = 0; i < spec->count; i++) {
+		switch (spec->keys[i]) {
+		case SORT_KEY_ID: layout.width += 4; break;
+		case SORT_KEY_MARK: layout.width += 2; break;
+		case SORT_KEY_PROGRAMME: layout.width += 2; break;
+		case SORT_KEY_NAME:
+			layout.name_offset = layout.width;
+			layout.name_descending = spec->descending[i];
+			layout.width += SORT_NAME_PREFIX;
+			break;
+		}
+	}
+	layout.name_end = (layout.name_offset >= 0) ? layout.name_offset + SORT_NAME_PREFIX : layout.width;
+	if (count < 2) {
+		return 1;
+	}
+
+	int needs_ranks = 0;
+	for (int i = 0; i < spec->count; i++) {
+		needs_ranks |= (spec->keys[i] == SORT_KEY_PROGRAMME);
+	}
+	if (needs_ranks) {
+		ranks = programme_ranks(&db->programmes);
+	}
+	job.chunk_count = (count >= SORT_PARALLEL_MIN && thread_count > 1) ? thread_count : 1;
+	job.entries = (SortEntry*)malloc((size_t)count * sizeof(SortEntry));
+	job.temp = (SortEntry*)malloc((size_t)count * sizeof(SortEntry));
+	job.bounds = (int*)malloc((size_t)(job.chunk_count + 1) * sizeof(int));
+	if (job.entries == NULL || job.temp == NULL || job.bounds == NULL || (needs_ranks && ranks == NULL)) {
+		free(job.entries);
+		free(job.temp);
+		free(job.bounds);
+		free(ranks);
+		return 0;
+	}
+	job.db = db;
+	job.spec = spec;
+	job.layout = &layout;
+	job.ranks = ranks;
+	job.slots = slots;
+	job.count = count;
+	for (int chunk = 0; chunk <= job.chunk_count; chunk++) {
+		job.bounds[chunk] = (int)((long long)count * chunk / job.chunk_count);
+	}
+	parallel_for(job.chunk_count, job.chunk_count, merge_chunk_task, &job);
+
+	//merge rounds, each halves the number of runs
+	job.run_count = job.chunk_count;
+	job.from = job.entries;
+	job.to = job.temp;
+	while (job.run_count > 1) {
+		int pairs = (job.run_count + 1) / 2;
+		job.pieces = (job.chunk_count + pairs - 1) / pairs;
+		parallel_for(pairs * job.pieces, job.chunk_count, merge_piece_task, &job);
+		for (int run = 0; run < pairs; run++) {
+			job.bounds[run] = job.bounds[2 * run];
+		}
+		job.bounds[pairs] = count;
+		job.run_count = pairs;
+		SortEntry* swap = (SortEntry*)job.from;
+		job.from = job.to;
+		job.to = swap;
+	}
+
+	for (int i = 0; i < count; i++) {
+		slots[i] = job.from[i].slot;
+	}
+	free(job.entries);
+	free(job.temp);
+	free(job.bounds);
+	free(ranks);
+	return 1;
+}
+
+/*
+* Show the records ordered by spec as the custom view (sorting the current custom order again if it is shown)
+* returns 1 if sorted, 0 if out of memory (nothing changes then)
+*/
+int sort_view_show_spec(CMSdb* db, const SortSpec* spec)
+{
+	SortViews* views = &db->views;
+
+	if (views->shown == SORT_VIEW_CUSTOM) {
+		if (!sort_slots_by_spec(db, spec, db->order, db->record_count, worker_thread_count(&db->options))) {
+			return 0;
+		}
+		db_order_changed(db);
+		return 1;
+	}
+	SortPermutation* target = &views->views[SORT_VIEW_CUSTOM];
+	if (!grow_int_array(&target->slots, &target->capacity, db->record_count + 1)) {
+		return 0;
+	}
+	memcpy(target->slots, db->order, (size_t)db->record_count * sizeof(int));
+	if (!sort_slots_by_spec(db, spec, target->slots, db->record_count, worker_thread_count(&db->options))) {
+		view_drop(views, SORT_VIEW_CUSTOM);
+		return 0;
+	}
+	view_swap_in(db, SORT_VIEW_CUSTOM);
+	return 1;
+}
@@ -0,0 +1,174 @@
+/*
+* Course Management System (CMS)
+* Programme statistics - count, sum and sum of squares of the marks of every programme code are updated
+* by every insert, update and delete (undo and redo go through the same store functions), so the report
+* per programme reads one entry per programme instead of scanning the records
+* every programme keeps a histogram of its marks (1001 counts, like the mark index): when the record with
+* the lowest or highest mark goes, the next one is found by walking the histogram, never the records
+* a histogram (4 KB) is allocated when its programme gets its first record, codes that never had one cost nothing
+* only running out of memory loses the table, the next report then recounts it with one pass over the records
+*/
+
+#include "cms.h"
+
+#define STATS_MARKS (MARK_TENTHS_MAX + 1) //histogram entries per programme
+
+/*
+* Entry of a programme code, the table grows to cover it and the code gets its histogram
+* returns NULL if out of memory
+*/
+static ProgrammeStats* stats_group(GroupStats* stats, int code)
+{
+	if (code >= stats->capacity) {
+		int capacity = (stats->capacity > 0) ? stats->capacity : 64;
+		while (capacity <= code) {
+			capacity *= 2;
+		}
+		ProgrammeStats* groups = (ProgrammeStats*)realloc(stats->groups, (size_t)capacity * sizeof(ProgrammeStats));
+		if (groups == NULL) {
+			return NULL;
+		}
+		stats->groups = groups;
+		int** histograms = (int**)realloc(stats->histograms, (size_t)capacity * sizeof(int*));
+		if (histograms == NULL) {
+			return NULL;
+		}
+		stats->histograms = histograms;
+		memset(groups + stats->capacity, 0, (size_t)(capacity - stats->capacity) * sizeof(ProgrammeStats));
+		memset(histograms + stats->capacity, 0, (size_t)(capacity - stats->capacity) * sizeof(int*));
+		stats->capacity = capacity;
+	}
+	if (stats->histograms[code] == NULL) {
+		stats->histograms[code] = (int*)calloc(STATS_MARKS, sizeof(int));
+		if (stats->histograms[code] == NULL) {
+			return NULL;
+		}
+	}
+	return &stats->groups[code];
+}
+
+/*
+* Count one mark in the group of a programme code (stats_group has given it a histogram)
+*/
+static void stats_add_mark(GroupStats* stats, int code, int tenths)
+{
+	ProgrammeStats* group = &stats->groups[code];
+
+	if (group->count == 0 || tenths < group->min_tenths) group->min_tenths = (short)tenths;
+	if (group->count == 0 || tenths > group->max_tenths) group->max_tenths = (short)tenths;
+	group->count++;
+	group->sum_tenths += tenths;
+	group->sum_squares += (long long)tenths * tenths;
+	stats->histograms[code][tenths]++;
+}
+
+/*
+* The record in slot was stored (or got new values)
+*/
+void group_stats_add(CMSdb* db, int slot)
+{
+	if (db->stats.stale == GROUP_STATS_LOST) {
+		return; //counts are lost, the next report recounts everything
+	}
+	int code = *arena_programme_code(&db->arena, slot);
+	if (stats_group(&db->stats, code) == NULL) {
+		db->stats.stale = GROUP_STATS_LOST;
+		return;
+	}
+	stats_add_mark(&db->stats, code, arena_record(&db->arena, slot)->mark_tenths);
+}
+
+/*
+* The record in slot is removed, or its programme or mark is about to change
+*/
+void group_stats_remove(CMSdb* db, int slot)
+{
+	int code = *arena_programme_code(&db->arena, slot);
+	int tenths = arena_record(&db->arena, slot)->mark_tenths;
+
+	if (db->stats.stale == GROUP_STATS_LOST || code >= db->stats.capacity || db->stats.histograms[code] == NULL) {
+		return;
+	}
+	ProgrammeStats* group = &db->stats.groups[code];
+	int* histogram = db->stats.histograms[code];
+	group->count--;
+	group->sum_tenths -= tenths;
+	group->sum_squares -= (long long)tenths * tenths;
+	histogram[tenths]--;
+	if (group->count > 0 && histogram[tenths] == 0) {
+		//the last record with the lowest or highest mark: the next one is the nearest mark still counted
+		if (tenths == group->min_tenths) {
+			while (histogram[group->min_tenths] == 0) group->min_tenths++;
+		}
+		if (tenths == group->max_tenths) {
+			while (histogram[group->max_tenths] == 0) group->max_tenths--;
+		}
+	}
+}
+
+/*
+* Recount the table with one pass over the records after running out of memory
+* returns 1 if the table is up to date, 0 if out of memory
+*/
+int group_stats_refresh(CMSdb* db)
+{
+	GroupStats* stats = &db->stats;
+
+	if (stats->stale == GROUP_STATS_CURRENT) {
+		return 1;
+	}
+	for (int code = 0; code < stats->capacity; code++) {
+		memset(&stats->groups[code], 0, sizeof(ProgrammeStats));
+		if (stats->histograms[code] != NULL) {
+			memset(stats->histograms[code], 0, STATS_MARKS * sizeof(int));
+		}
+	}
+	for (int i = 0; i < db->record_count; i++) {
+		int slot = db->order[i];
+		int code = *arena_programme_code(&db->arena, slot);
+		if (stats_group(stats, code) == NULL) {
+			return 0;
+		}
+		stats_add_mark(stats, code, arena_record(&db->arena, slot)->mark_tenths);
+	}
+	stats->stale = GROUP_STATS_CURRENT;
+	return 1;
+}
+
+static const ProgrammeDictionary* stats_dictionary; //for the qsort comparator
+
+static int compare_programme_names(const void* a, const void* b)
+{
+	int codeA = *(const int*)a, codeB = *(const int*)b;
+	int result = strcmp(stats_dictionary->folded[codeA], stats_dictionary->folded[codeB]);
+	return (result != 0) ? result : strcmp(stats_dictionary->names[codeA], stats_dictionary->names[codeB]);
+}
+
+/*
+* The codes of every programme with records, in alphabetical order (ignoring case)
+* codes must hold db->programmes.count entries, returns how many were stored
+*/
+int group_stats_codes(const CMSdb* db, int* codes)
+{
+	int count = 0;
+	int limit = (db->programmes.count < db->stats.capacity) ? db->programmes.count : db->stats.capacity;
+
+	for (int code = 0; code < limit; code++) {
+		if (db->stats.groups[code].count > 0) {
+			codes[count++] = code;
+		}
+	}
+	stats_dictionary = &db->programmes;
+	qsort(codes, (size_t)count, sizeof(int), compare_programme_names);
+	return count;
+}
+
+void group_stats_free(GroupStats* stats)
+{
+	for (int code = 0; code < stats->capacity; code++) {
+		free(stats->histograms[code]);
+	}
+	free(stats->groups);
+	free(stats->histograms);
+	memset(stats, 0, sizeof(*stats));
+}
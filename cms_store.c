@@ -0,0 +1,370 @@
+/*
+* Course Management System (CMS)
+* Record store - chunked arena for StudentRecords and the display order
+* every write goes through here so the programme codes and folded (lowercase) names always match the records
+*/
+
+#include "cms.h"
+
+/*
+* Grow a heap int array so it can hold at least "needed" entries
+* capacity doubles so appends are amortized O(1)
+*/
+int grow_int_array(int** array, int* capacity, int needed)
+{
+	if (needed <= *capacity) {
+		return 1;
+	}
+
+	int new_capacity = (*capacity > 0) ? *capacity : INITIAL_ORDER_CAPACITY;
+	while (new_capacity < needed) {
+		new_capacity *= 2;
+	}
+
+	int* grown = (int*)realloc(*array, (size_t)new_capacity * sizeof(int));
+	if (grown == NULL) {
+		return 0;
+	}
+	*array = grown;
+	*capacity = new_capacity;
+	return 1;
+}
+
+/*
+* Resize one of the arena's per-chunk pointer tables, returns 0 if out of memory
+*/
+static int grow_chunk_table(void** table, int capacity)
+{
+	void* grown = realloc(*table, (size_t)capacity * sizeof(void*));
+	if (grown == NULL) {
+		return 0;
+	}
+	*table = grown;
+	return 1;
+}
+
+/*
+* Hand out a free slot, reusing deleted slots first
+* returns the slot number or -1 if out of memory
+*/
+int arena_alloc_slot(RecordArena* arena)
+{
+	if (arena->free_count > 0) {
+		return arena->free_slots[--arena->free_count];
+	}
+
+	//current chunks are full, add another one
+	if (arena->slot_count == arena->chunk_count * RECORD_CHUNK_SIZE) {
+		if (arena->chunk_count == arena->chunk_capacity) {
+			int new_capacity = (arena->chunk_capacity > 0) ? arena->chunk_capacity * 2 : 16;
+			if (!grow_chunk_table((void**)&arena->chunks, new_capacity) ||
+				!grow_chunk_table((void**)&arena->programme_codes, new_capacity) ||
+				!grow_chunk_table((void**)&arena->folded_names, new_capacity)) {
+				return -1; //tables that did grow are simply larger than needed
+			}
+			arena->chunk_capacity = new_capacity;
+		}
+
+		StoredRecord* chunk = (StoredRecord*)malloc((size_t)RECORD_CHUNK_SIZE * sizeof(StoredRecord));
+		unsigned short* codes = (unsigned short*)malloc((size_t)RECORD_CHUNK_SIZE * sizeof(unsigned short));
+		char* names = (char*)malloc((size_t)RECORD_CHUNK_SIZE * MAX_NAME_LENGTH);
+		if (chunk == NULL || codes == NULL || names == NULL) {
+			free(chunk);
+			free(codes);
+			free(names);
+			return -1;
+		}
+		arena->programme_codes[arena->chunk_count] = codes;
+		arena->folded_names[arena->chunk_count] = names;
+		arena->chunks[arena->chunk_count++] = chunk;
+	}
+	return arena->slot_count++;
+}
+
+/*
+* Give a slot back to the arena so the next insert can reuse it
+*/
+void arena_release_slot(RecordArena* arena, int slot)
+{
+	if (!grow_int_array(&arena->free_slots, &arena->free_capacity, arena->free_count + 1)) {
+		return; //slot is not reused until the database is cleared
+	}
+	arena->free_slots[arena->free_count++] = slot;
+}
+
+/*
+* Release every chunk held by the arena
+*/
+void arena_free(RecordArena* arena)
+{
+	for (int i = 0; i < arena->chunk_count; i++) {
+		free(arena->chunks[i]);
+		free(arena->programme_codes[i]);
+		free(arena->folded_names[i]);
+	}
+	free(arena->chunks);
+	free(arena->programme_codes);
+	free(arena->folded_names);
+	free(arena->free_slots);
+	memset(arena, 0, sizeof(*arena));
+}
+
+/*
+* Copy of the record in slot with its programme text filled in from the dictionary
+*/
+void db_get_record(const CMSdb* db, int slot, StudentRecord* record)
+{
+	const StoredRecord* stored = arena_record(&db->arena, slot);
+	record->id = stored->id;
+	memcpy(record->name, stored->name, sizeof(record->name));
+	strcpy_s(record->programme, sizeof(record->programme), slot_programme(db, slot));
+	record->mark = tenths_to_mark(stored->mark_tenths);
+}
+
+/*
+* Insert a copy of record so that it is shown at position "index"
+* records from index onwards move one position down
+* returns 1 on success, -1 if the student ID is already used,
+* 0 if out of memory (or PROGRAMME_CODE_LIMIT different programmes are in use)
+*/
+int db_insert_record_at(CMSdb* db, int index, const StudentRecord* record)
+{
+	if (index < 0 || index > db->record_count) {
+		return 0;
+	}
+	if (!grow_int_array(&db->order, &db->order_capacity, db->record_count + 1)) {
+		return 0;
+	}
+	//a rejected duplicate must not leave a programme code behind that no record uses
+	if (db_contains_id(db, record->id)) {
+		return -1;
+	}
+	int code = programme_intern(&db->programmes, record->programme);
+	if (code < 0) {
+		return 0;
+	}
+
+	int slot = arena_alloc_slot(&db->arena);
+	if (slot < 0) {
+		return 0;
+	}
+	int added = id_index_insert(&db->id_index, record->id, slot);
+	if (added != 1) {
+		arena_release_slot(&db->arena, slot);
+		return added;
+	}
+	StoredRecord* stored = arena_record(&db->arena, slot);
+	stored->id = record->id;
+	memcpy(stored->name, record->name, sizeof(stored->name));
+	stored->mark_tenths = (short)mark_to_tenths(record->mark);
+	*arena_programme_code(&db->arena, slot) = (unsigned short)code;
+	fold_text(arena_folded_name(&db->arena, slot), record->name, MAX_NAME_LENGTH);
+	search_index_add(db, slot);
+	mark_index_add(db, slot);
+	group_stats_add(db, slot);
+	sort_views_add(db, slot);
+	tracker_forget_slot(db, slot); //not in the saved file yet
+	db->search.positions_valid = 0;
+	if (sort_view_is_keyed(db->views.shown)) {
+		index = sort_view_insert_position(db, slot); //a sorted view keeps its order, index only applies to the others
+	}
+
+	//only the 4 byte slot numbers move, the records stay in place
+	memmove(&db->order[index + 1], &db->order[index], (size_t)(db->record_count - index) * sizeof(int));
+	db->order[index] = slot;
+	db->record_count++;
+	return 1;
+}
+
+/*
+* Add a copy of record after the last record, same return values as db_insert_record_at
+*/
+int db_append_record(CMSdb* db, const StudentRecord* record)
+{
+	return db_insert_record_at(db, db->record_count, record);
+}
+
+/*
+* Remove the record shown at position "index", later records move up one position
+*/
+void db_remove_record_at(CMSdb* db, int index)
+{
+	if (index < 0 || index >= db->record_count) {
+		return;
+	}
+	int slot = db->order[index];
+	id_index_remove(&db->id_index, arena_record(&db->arena, slot)->id);
+	search_index_remove(db, slot);
+	mark_index_remove(db, slot);
+	group_stats_remove(db, slot);
+	sort_views_remove(db, slot);
+	arena_release_slot(&db->arena, slot);
+	memmove(&db->order[index], &db->order[index + 1], (size_t)(db->record_count - index - 1) * sizeof(int));
+	db->record_count--;
+	db_order_changed(db);
+}
+
+/*
+* Remove every record whose slot is set in the bitmap marked (bit slot & 7 of byte slot >> 3)
+* one pass over the display order and the cached views instead of moving them once per record,
+* used when a merge or a batch deletes many records at once
+*/
+void db_remove_marked(CMSdb* db, const unsigned char* marked)
+{
+	sort_views_remove_marked(db, marked);
+	int kept = 0;
+	for (int i = 0; i < db->record_count; i++) {
+		int slot = db->order[i];
+		if (!(marked[slot >> 3] & (1u << (slot & 7)))) {
+			db->order[kept++] = slot;
+			continue;
+		}
+		int id = arena_record(&db->arena, slot)->id;
+		if (id_index_find(&db->id_index, id) == slot) {
+			id_index_remove(&db->id_index, id); //db_mark_removed has not released it already
+		}
+		search_index_remove(db, slot);
+		mark_index_remove(db, slot);
+		group_stats_remove(db, slot);
+		arena_release_slot(&db->arena, slot);
+	}
+	if (kept != db->record_count) {
+		db->record_count = kept;
+		db_order_changed(db);
+	}
+}
+
+/*
+* Set slot in the db_remove_marked bitmap marked and release its student ID straight away:
+* the record stays in place until db_remove_marked, but lookups no longer find it and the ID can be inserted again
+*/
+void db_mark_removed(CMSdb* db, unsigned char* marked, int slot)
+{
+	marked[slot >> 3] |= (unsigned char)(1u << (slot & 7));
+	id_index_remove(&db->id_index, arena_record(&db->arena, slot)->id);
+}
+
+/*
+* Give the record in slot new values (same ID): name, programme and mark, and tell the save tracker
+* the trigram index compares the old folded name with the new one before it is overwritten,
+* the mark index moves the slot to another bucket only when the mark changes, and so do the mark sort views,
+* the programme statistics take the old values out and put the new ones in
+* returns 1 on success, 0 if the programme cannot be added to the dictionary (nothing is changed then)
+*/
+int db_update_record(CMSdb* db, int slot, const StudentRecord* record)
+{
+	char name[MAX_NAME_LENGTH];
+	int code = programme_intern(&db->programmes, record->programme);
+	if (code < 0) {
+		return 0;
+	}
+
+	StoredRecord* stored = arena_record(&db->arena, slot);
+	int tenths = mark_to_tenths(record->mark);
+	group_stats_remove(db, slot);
+	if (tenths != stored->mark_tenths) {
+		mark_index_remove(db, slot);
+		sort_views_update_mark(db, slot, tenths);
+		stored->mark_tenths = (short)tenths;
+		mark_index_add(db, slot);
+	}
+	memcpy(stored->name, record->name, sizeof(stored->name));
+	*arena_programme_code(&db->arena, slot) = (unsigned short)code;
+	group_stats_add(db, slot);
+	fold_text(name, record->name, sizeof(name));
+	search_index_update(db, slot, name);
+	memcpy(arena_folded_name(&db->arena, slot), name, sizeof(name));
+	tracker_mark_changed(db, slot);
+	return 1;
+}
+
+/*
+* Records were reordered (sorted) or removed, display positions cached for searching are stale
+*/
+void db_order_changed(CMSdb* db)
+{
+	db->search.positions_valid = 0;
+	tracker_mark_layout_changed(db);
+}
+
+/*
+* A batch of change_count inserts, updates and deletes follows (batch mode, cms_batch.c)
+* the change log is written through once at the end, and indexes whose upkeep over the whole batch costs more
+* than building them again are dropped (or left unsorted) and built once afterwards:
+* a sorted view moves up to every slot per change, so a few hundred changes cost as much as one radix sort,
+* the trigram index and mark buckets are cheap per change, they are rebuilt when 1/BATCH_REBUILD_FRACTION
+* of the records change
+*/
+#define BATCH_RESORT_MIN 256
+#define BATCH_REBUILD_FRACTION 64
+
+void db_begin_changes(CMSdb* db, int change_count)
+{
+	wal_defer(db, 1);
+	if (change_count >= BATCH_RESORT_MIN) {
+		sort_views_begin_changes(db);
+	}
+	if (change_count >= db->record_count / BATCH_REBUILD_FRACTION) {
+		search_index_free(&db->search); //built again by the next name query
+		mark_index_drop_buckets(&db->marks); //the histogram stays, the buckets come back with the next mark query
+	}
+}
+
+/*
+* The batch is done: a sorted view shown during it is sorted again and the change log is flushed and synced
+*/
+void db_end_changes(CMSdb* db)
+{
+	sort_views_end_changes(db);
+	wal_defer(db, 0);
+}
+
+/*
+* Drop all records but keep the allocated chunks for reuse
+*/
+void db_clear_records(CMSdb* db)
+{
+	db->arena.slot_count = 0;
+	db->arena.free_count = 0;
+	db->record_count = 0;
+	id_index_clear(&db->id_index);
+	programme_dictionary_clear(&db->programmes);
+	search_index_free(&db->search); //rebuilt by the next query
+	mark_index_free(&db->marks);
+	group_stats_free(&db->stats);
+	sort_views_free(&db->views); //back to insertion order
+	tracker_reset(db);
+}
+
+/*
+* Find the arena slot holding a student ID, -1 if there is none
+*/
+int db_find_slot(const CMSdb* db, int id)
+{
+	return id_index_find(&db->id_index, id);
+}
+
+/*
+* Check whether a student ID is already used (one bitmap read in direct index mode)
+*/
+int db_contains_id(const CMSdb* db, int id)
+{
+	return id_index_contains(&db->id_index, id);
+}
+
+/*
+* Display position of an arena slot, -1 if the slot is not in use
+* while a sorted view is shown this is a binary search, otherwise only the 4 byte order array is scanned
+*/
+int db_index_of_slot(const CMSdb* db, int slot)
+{
+	if (db->views.shown != SORT_VIEW_INSERTION) {
+		return sort_view_index_of_slot(db, slot);
+	}
+	for (int i = 0; i < db->record_count; i++) {
+		if (db->order[i] == slot) {
+			return i;
+		}
+	}
+	return -1;
+}
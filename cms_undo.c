@@ -0,0 +1,192 @@
+/*
+* Course Management System (CMS)
+* Undo journal - every insert, update and delete is stored as the change it made (the record with its
+* position, or the old and new values), not as a copy of the database
+* undo applies the change backwards, redo applies it again; entries find their record by student ID,
+* so sorting in between does not matter
+* the journal is a ring of options.undo_limit entries, the oldest entry is dropped when it is full
+*/
+
+#include "cms.h"
+
+/*
+* Start an empty journal, the ring is allocated on the first change
+*/
+void undo_journal_init(UndoJournal* journal, int limit)
+{
+	memset(journal, 0, sizeof(*journal));
+	journal->limit = (limit > 0) ? limit : 1;
+}
+
+/*
+* Drop every entry (after a save the changes are committed) but keep the memory
+*/
+void undo_journal_clear(UndoJournal* journal)
+{
+	journal->start = 0;
+	journal->count = 0;
+	journal->undo_count = 0;
+}
+
+void undo_journal_free(UndoJournal* journal)
+{
+	free(journal->entries);
+	undo_journal_init(journal, journal->limit);
+}
+
+/*
+* Entry number i, counted from the oldest one kept
+*/
+static UndoEntry* journal_entry(UndoJournal* journal, int i)
+{
+	return &journal->entries[(journal->start + i) % journal->limit];
+}
+
+/*
+* Add an entry for a change that was just made, entries that could be redone are dropped
+*/
+static void journal_push(CMSdb* db, int type, int index, const StudentRecord* before, const StudentRecord* after)
+{
+	UndoJournal* journal = &db->undo;
+
+	if (journal->entries == NULL) {
+		journal->entries = (UndoEntry*)malloc((size_t)journal->limit * sizeof(UndoEntry));
+		if (journal->entries == NULL) {
+			printf("CMS: Warning - Not enough memory to keep undo information.\n");
+			return;
+		}
+	}
+
+	journal->count = journal->undo_count; //a new change makes the undone ones unreachable
+	if (journal->count == journal->limit) {
+		journal->start = (journal->start + 1) % journal->limit; //forget the oldest change
+		journal->count--;
+	}
+
+	UndoEntry* entry = journal_entry(journal, journal->count);
+	entry->type = type;
+	entry->index = index;
+	if (before != NULL) entry->before = *before;
+	if (after != NULL) entry->after = *after;
+	journal->count++;
+	journal->undo_count = journal->count;
+}
+
+void undo_record_insert(CMSdb* db, int index, const StudentRecord* record)
+{
+	journal_push(db, UNDO_INSERT, index, NULL, record);
+}
+
+void undo_record_update(CMSdb* db, const StudentRecord* before, const StudentRecord* after)
+{
+	journal_push(db, UNDO_UPDATE, -1, before, after);
+}
+
+void undo_record_delete(CMSdb* db, int index, const StudentRecord* record)
+{
+	journal_push(db, UNDO_DELETE, index, record, NULL);
+}
+
+/*
+* The three changes a journal entry can make, each also goes to the change log and the save tracker
+* return 0 if the database does not look the way the entry expects (nothing is changed then)
+*/
+static int journal_add(CMSdb* db, int index, const StudentRecord* record)
+{
+	if (index < 0 || index > db->record_count) {
+		index = db->record_count;
+	}
+	if (db_insert_record_at(db, index, record) != 1) {
+		return 0;
+	}
+	wal_log_insert(db, index, record);
+	return 1;
+}
+
+static int journal_remove(CMSdb* db, int id)
+{
+	int slot = db_find_slot(db, id);
+	if (slot < 0) {
+		return 0;
+	}
+	db_remove_record_at(db, db_index_of_slot(db, slot));
+	wal_log_delete(db, id);
+	return 1;
+}
+
+static int journal_set(CMSdb* db, const StudentRecord* record)
+{
+	int slot = db_find_slot(db, record->id);
+	if (slot < 0) {
+		return 0;
+	}
+	if (!db_update_record(db, slot, record)) {
+		return 0;
+	}
+	wal_log_update(db, record);
+	return 1;
+}
+
+/*
+* Revert the newest change that has not been undone
+* returns 1 and copies the entry to *undone, 0 if there is nothing to undo or it cannot be applied
+*/
+int undo_journal_undo(CMSdb* db, UndoEntry* undone)
+{
+	UndoJournal* journal = &db->undo;
+	int applied = 0;
+
+	if (journal->undo_count == 0) {
+		return 0;
+	}
+	const UndoEntry* entry = journal_entry(journal, journal->undo_count - 1);
+	switch (entry->type) {
+	case UNDO_INSERT:
+		applied = journal_remove(db, entry->after.id);
+		break;
+	case UNDO_UPDATE:
+		applied = journal_set(db, &entry->before);
+		break;
+	case UNDO_DELETE:
+		applied = journal_add(db, entry->index, &entry->before);
+		break;
+	}
+	if (!applied) {
+		return 0;
+	}
+	*undone = *entry;
+	journal->undo_count--;
+	return 1;
+}
+
+/*
+* Make the most recently undone change again
+* returns 1 and copies the entry to *redone, 0 if there is nothing to redo or it cannot be applied
+*/
+int undo_journal_redo(CMSdb* db, UndoEntry* redone)
+{
+	UndoJournal* journal = &db->undo;
+	int applied = 0;
+
+	if (journal->undo_count == journal->count) {
+		return 0;
+	}
+	const UndoEntry* entry = journal_entry(journal, journal->undo_count);
+	switch (entry->type) {
+	case UNDO_INSERT:
+		applied = journal_add(db, entry->index, &entry->after);
+		break;
+	case UNDO_UPDATE:
+		applied = journal_set(db, &entry->after);
+		break;
+	case UNDO_DELETE:
+		applied = journal_remove(db, entry->before.id);
+		break;
+	}
+	if (!applied) {
+		return 0;
+	}
+	*redone = *entry;
+	journal->undo_count++;
+	return 1;
+}
@@ -0,0 +1,314 @@
+/*
+* Course Management System (CMS)
+* Write-ahead log - every insert, update and delete is appended to "<file>.wal"
+* so a change is kept without rewriting the whole file; opening the file replays the log,
+* save_file compacts (writes a new base file, then empties the log)
+*
+* log layout: "CMSW", uint32 version, then entries of
+*   uint8 type, uint8 name length, uint8 programme length, uint8 0,
+*   int32 id, int32 index, float mark, name, programme, uint32 checksum (FNV-1a of everything before it)
+* a crash can leave the last entry half written, the checksum finds it and replay stops there
+*
+* replaying an entry that is already in the base file changes nothing (an insert of an existing ID
+* is skipped, update and delete set the same final values), so a crash between writing the new base
+* file and emptying the log is harmless
+*/
+
+#include "cms.h"
+#include <stdint.h>
+
+#define WAL_MAGIC "CMSW"
+#define WAL_VERSION 1
+#define WAL_FILE_HEADER_SIZE 8
+#define WAL_ENTRY_HEADER_SIZE 16
+#define WAL_ENTRY_MAX_SIZE (WAL_ENTRY_HEADER_SIZE + MAX_NAME_LENGTH + MAX_PROGRAMME_LENGTH + 4)
+
+/*
+* "<filename>.wal", returns 0 if it does not fit in size
+*/
+static int wal_path(const char* filename, char* path, size_t size)
+{
+	int length = snprintf(path, size, "%s.wal", filename);
+	return length > 0 && (size_t)length < size;
+}
+
+static uint32_t wal_checksum(const unsigned char* data, size_t length)
+{
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < length; i++) {
+		hash = (hash ^ data[i]) * 16777619u;
+	}
+	return hash;
+}
+
+/*
+* Start logging changes of the currently opened file (only when options.wal_enabled is set)
+* returns 1 if the log is open (or logging is off), 0 if it cannot be opened
+*/
+int wal_open(CMSdb* db)
+{
+	char path[sizeof(db->current_filename) + 8];
+
+	if (!db->options.wal_enabled || db->wal.file != NULL) {
+		return 1;
+	}
+	if (!wal_path(db->current_filename, path, sizeof(path))) {
+		return 0;
+	}
+	db->wal.file = fopen(path, "ab");
+	if (db->wal.file == NULL) {
+		return 0;
+	}
+	db->wal.pending = 0;
+
+	//a new log starts with its header
+	fseek(db->wal.file, 0, SEEK_END);
+	if (ftell(db->wal.file) == 0) {
+		uint32_t version = WAL_VERSION;
+		fwrite(WAL_MAGIC, 1, 4, db->wal.file);
+		fwrite(&version, sizeof(version), 1, db->wal.file);
+		flush_to_disk(db->wal.file);
+	}
+	return 1;
+}
+
+/*
+* Force logged entries to disk
+* entries are flushed to the operating system as they are written (a crash of the program loses nothing),
+* the disk sync that also survives a power cut is batched over options.wal_sync_every entries
+*/
+int wal_sync(CMSdb* db)
+{
+	if (db->wal.file == NULL || db->wal.pending == 0) {
+		return 1;
+	}
+	db->wal.pending = 0;
+	return flush_to_disk(db->wal.file);
+}
+
+/*
+* Sync and close the log, the file stays on disk until the next save
+*/
+void wal_close(CMSdb* db)
+{
+	if (db->wal.file != NULL) {
+		wal_sync(db);
+		fclose(db->wal.file);
+		db->wal.file = NULL;
+	}
+}
+
+/*
+* Delete the log of filename after its changes went into a new base file
+* logging starts again with an empty log when it is enabled
+*/
+void wal_discard(CMSdb* db, const char* filename)
+{
+	char path[sizeof(db->current_filename) + 8];
+
+	if (db->wal.file != NULL) {
+		fclose(db->wal.file);
+		db->wal.file = NULL;
+	}
+	if (wal_path(filename, path, sizeof(path))) {
+		remove(path);
+	}
+	if (db->is_open) {
+		wal_open(db);
+	}
+}
+
+/*
+* Append one entry, does nothing when no log is open
+*/
+static void wal_append(CMSdb* db, int type, int index, const StudentRecord* record)
+{
+	unsigned char entry[WAL_ENTRY_MAX_SIZE];
+	size_t name_length = strlen(record->name);
+	size_t programme_length = strlen(record->programme);
+	int32_t id = record->id;
+	int32_t position = index;
+	float mark = record->mark;
+
+	if (db->wal.file == NULL) {
+		return;
+	}
+
+	entry[0] = (unsigned char)type;
+	entry[1] = (unsigned char)name_length;
+	entry[2] = (unsigned char)programme_length;
+	entry[3] = 0;
+	memcpy(entry + 4, &id, 4);
+	memcpy(entry + 8, &position, 4);
+	memcpy(entry + 12, &mark, 4);
+	size_t length = WAL_ENTRY_HEADER_SIZE;
+	memcpy(entry + length, record->name, name_length);
+	length += name_length;
+	memcpy(entry + length, record->programme, programme_length);
+	length += programme_length;
+	uint32_t checksum = wal_checksum(entry, length);
+	memcpy(entry + length, &checksum, 4);
+	length += 4;
+
+	//one fwrite per entry, flushed right away so only a power cut can lose it before the next sync
+	if (fwrite(entry, 1, length, db->wal.file) != length || (!db->wal.deferred && fflush(db->wal.file) != 0)) {
+		printf("CMS: Warning - Could not write the change log, save the file to keep this change.\n");
+		return;
+	}
+	db->wal.pending++;
+	if (db->wal.pending >= db->options.wal_sync_every && !db->wal.deferred) {
+		wal_sync(db);
+	}
+}
+
+/*
+* Batch mode: while deferred is 1 entries stay in the stdio buffer, turning it off flushes and syncs them
+* all at once (a crash in the middle of a batch can lose that batch)
+*/
+void wal_defer(CMSdb* db, int deferred)
+{
+	db->wal.deferred = deferred;
+	if (!deferred && db->wal.file != NULL) {
+		if (fflush(db->wal.file) != 0) {
+			printf("CMS: Warning - Could not write the change log, save the file to keep these changes.\n");
+		}
+		wal_sync(db);
+	}
+}
+
+void wal_log_insert(CMSdb* db, int index, const StudentRecord* record)
+{
+	wal_append(db, WAL_INSERT, index, record);
+}
+
+void wal_log_update(CMSdb* db, const StudentRecord* record)
+{
+	wal_append(db, WAL_UPDATE, -1, record);
+}
+
+void wal_log_delete(CMSdb* db, int id)
+{
+	StudentRecord record;
+	memset(&record, 0, sizeof(record));
+	record.id = id;
+	wal_append(db, WAL_DELETE, -1, &record);
+}
+
+/*
+* Apply one decoded entry to db
+*/
+static void wal_apply(CMSdb* db, int type, int index, const StudentRecord* record)
+{
+	int slot = db_find_slot(db, record->id);
+
+	switch (type) {
+	case WAL_INSERT:
+		if (slot < 0 && check_student_record(record, 0)) {
+			if (index < 0 || index > db->record_count) {
+				index = db->record_count;
+			}
+			db_insert_record_at(db, index, record);
+		}
+		break;
+	case WAL_UPDATE:
+		if (slot >= 0 && check_student_record(record, 0)) {
+			db_update_record(db, slot, record); //same ID, the index does not change
+		}
+		break;
+	case WAL_DELETE:
+		if (slot >= 0) {
+			db_remove_record_at(db, db_index_of_slot(db, slot));
+		}
+		break;
+	}
+}
+
+/*
+* Apply the log of filename (if there is one) on top of the records just loaded from it
+* a damaged tail (half written last entry) is cut off so new entries follow the good ones
+* returns the number of entries applied, or -1 if the log exists but is not a CMS log
+*/
+int wal_replay(CMSdb* db, const char* filename)
+{
+	char path[sizeof(db->current_filename) + 8];
+	MappedFile map;
+	uint32_t version = 0;
+	int applied = 0;
+
+	if (!wal_path(filename, path, sizeof(path)) || !map_file(path, &map)) {
+		return 0; //no log, nothing changed since the last save
+	}
+	if (map.size < WAL_FILE_HEADER_SIZE || memcmp(map.data, WAL_MAGIC, 4) != 0) {
+		unmap_file(&map);
+		printf("CMS: Warning - \"%s\" is not a CMS change log, ignored\n", path);
+		return -1;
+	}
+	memcpy(&version, map.data + 4, 4);
+	if (version != WAL_VERSION) {
+		unmap_file(&map);
+		printf("CMS: Warning - Change log \"%s\" has unsupported version %u, ignored\n", path, (unsigned int)version);
+		return -1;
+	}
+
+	const unsigned char* data = (const unsigned char*)map.data;
+	size_t position = WAL_FILE_HEADER_SIZE;
+	while (map.size - position >= WAL_ENTRY_HEADER_SIZE + 4)
+	{
+		const unsigned char* entry = data + position;
+		size_t name_length = entry[1];
+		size_t programme_length = entry[2];
+		size_t length = WAL_ENTRY_HEADER_SIZE + name_length + programme_length;
+		uint32_t checksum;
+
+		if (name_length >= MAX_NAME_LENGTH || programme_length >= MAX_PROGRAMME_LENGTH ||
+			map.size - position < length + 4) {
+			break;
+		}
+		memcpy(&checksum, entry + length, 4);
+		if (checksum != wal_checksum(entry, length)) {
+			break;
+		}
+
+		StudentRecord record;
+		int32_t id, index;
+		memcpy(&id, entry + 4, 4);
+		memcpy(&index, entry + 8, 4);
+		memcpy(&record.mark, entry + 12, 4);
+		record.id = id;
+		memcpy(record.name, entry + WAL_ENTRY_HEADER_SIZE, name_length);
+		record.name[name_length] = '\0';
+		memcpy(record.programme, entry + WAL_ENTRY_HEADER_SIZE + name_length, programme_length);
+		record.programme[programme_length] = '\0';
+
+		wal_apply(db, entry[0], index, &record);
+		applied++;
+		position += length + 4;
+	}
+
+	if (position < map.size) {
+		printf("CMS: Warning - Change log \"%s\" ends with %zu damaged bytes (interrupted write), ignored\n",
+			path, map.size - position);
+		//keep only the good entries: write them to a new log and swap it in
+		char temp_path[sizeof(path) + 4];
+		snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+		FILE* temp = fopen(temp_path, "wb");
+		int rewritten = temp != NULL && fwrite(map.data, 1, position, temp) == position;
+		if (temp != NULL) {
+			rewritten = flush_to_disk(temp) && rewritten;
+			rewritten = (fclose(temp) == 0) && rewritten;
+		}
+		unmap_file(&map);
+		if (!rewritten || !replace_file(temp_path, path)) {
+			remove(temp_path);
+			printf("CMS: Warning - Could not repair the change log, save the file before making changes.\n");
+		}
+	}
+	else {
+		unmap_file(&map);
+	}
+
+	if (applied > 0) {
+		printf("CMS: Replayed %d unsaved change(s) from \"%s\"\n", applied, path);
+	}
+	return applied;
+}
@@ -10,7 +10,7 @@ int get_valid_menu_choice(void) {
 
 	while (1) {
 		show_menu();
-		printf("Enter your choice (1-10): ");
+		printf("Enter your choice (%d-%d): ", MENU_CHOICES_MIN, MENU_CHOICES_MAX);
 
 		if (fgets(input, sizeof(input), stdin) == NULL) 
 		{
@@ -24,39 +24,126 @@ int get_valid_menu_choice(void) {
 			clear_input_buffer();
 		}
 
-		if (strlen(input) == 3 && input[0] == '1' && input[1] == '0' && input[2] == '\n') 
+		//one or two digits followed by the newline
+		size_t length = strcspn(input, "\n");
+		if (length < 1 || length > 2 || input[length] != '\n' || !isdigit((unsigned char)input[0]) ||
+			(length == 2 && !isdigit((unsigned char)input[1])))
 		{
-			return 10;  // Return 10 for exit
-		}
-		if (strlen(input) != 2 || input[1] != '\n') //check input length is only 1 digit
-		{
-			printf("Invalid input! Please enter a single digit (1-10).\n");
+			printf("Invalid input! Please enter a number (%d-%d).\n", MENU_CHOICES_MIN, MENU_CHOICES_MAX);
 			continue;
 		}
 
-		if (input[0] < '1' || input[0] > '9') 
+		choice = atoi(input);
+		if (choice < MENU_CHOICES_MIN || choice > MENU_CHOICES_MAX) 
 		{
-			printf("Invalid choice! Please enter a number between 1-10.\n");
+			printf("Invalid choice! Please enter a number between %d-%d.\n", MENU_CHOICES_MIN, MENU_CHOICES_MAX);
 			continue;
 		}
-		choice = input[0] - '0';
 		break;
 	}
 	return choice;
 }
 
+/*
+* Read command line settings into options
+* returns 0 if an argument is not recognised
+*/
+int parse_command_line(int argc, char* argv[], CMSOptions* options) {
+	default_options(options);
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--index=hash") == 0)
+		{
+			options->id_index_mode = ID_INDEX_HASH;
+		}
+		else if (strcmp(argv[i], "--index=direct") == 0)
+		{
+			options->id_index_mode = ID_INDEX_DIRECT; //bitmap over all 7 digit IDs
+		}
+		else if (strncmp(argv[i], "--threads=", 10) == 0 && atoi(argv[i] + 10) > 0)
+		{
+			options->thread_count = atoi(argv[i] + 10); //loader threads, default one per CPU
+		}
+		else if (strcmp(argv[i], "--wal") == 0)
+		{
+			options->wal_enabled = 1; //log every change to <file>.wal
+		}
+		else if (strncmp(argv[i], "--wal-sync=", 11) == 0 && atoi(argv[i] + 11) > 0)
+		{
+			options->wal_enabled = 1;
+			options->wal_sync_every = atoi(argv[i] + 11); //changes per disk sync
+		}
+		else if (strncmp(argv[i], "--undo-limit=", 13) == 0 && atoi(argv[i] + 13) > 0)
+		{
+			options->undo_limit = atoi(argv[i] + 13); //changes kept for undo / redo
+		}
+		else if (strcmp(argv[i], "--search=trigram") == 0)
+		{
+			options->search_mode = SEARCH_MODE_TRIGRAM;
+		}
+		else if (strcmp(argv[i], "--search=scan") == 0)
+		{
+			options->search_mode = SEARCH_MODE_SCAN; //no trigram index, saves its memory
+		}
+		else if (strncmp(argv[i], "--batch=", 8) == 0 && argv[i][8] != '\0')
+		{
+			options->batch_file = argv[i] + 8; //run a command file instead of the menu (cms_batch.c)
+		}
+		else if (strncmp(argv[i], "--page-size=", 12) == 0 && isdigit((unsigned char)argv[i][12]))
+		{
+			options->page_size = atoi(argv[i] + 12); //rows per page on a terminal, 0 = print everything
+		}
+		else if (strcmp(argv[i], "--table=aligned") == 0)
+		{
+			options->table_layout = TABLE_LAYOUT_ALIGNED; //padded columns even when redirected
+		}
+		else if (strcmp(argv[i], "--table=tabs") == 0)
+		{
+			options->table_layout = TABLE_LAYOUT_TABS; //tab separated rows even on a terminal
+		}
+		else
+		{
+			printf("Unknown option \"%s\"\n", argv[i]);
+			printf("Usage: p7_7_CMS [--index=hash|--index=direct] [--threads=N] [--wal] [--wal-sync=N] [--undo-limit=N]\n");
+			printf("                [--search=trigram|--search=scan] [--batch=<command file>|--batch=-]\n");
+			printf("                [--table=aligned|--table=tabs] [--page-size=N]\n");
+			printf("       p7_7_CMS --bench <name> [max records]\n");
+			return 0;
+		}
+	}
+	return 1;
+}
+
 /*
 * Main function
 * flow of the CMS program
 */
 
-int main() {
+int main(int argc, char* argv[]) {
 	CMSdb db;
+	CMSOptions options;
 	int choice;
 	int result;
 
+	//"--bench" runs the performance benchmarks instead of the interactive menu
+	if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+		return run_benchmarks(argc - 2, argv + 2);
+	}
+
+	if (!parse_command_line(argc, argv, &options)) {
+		return 1;
+	}
+
 	//initialise the database
-	initialize_db(&db);
+	initialize_db_with_options(&db, &options);
+
+	//"--batch" runs the commands of a file without the menu or any prompt
+	if (options.batch_file != NULL) {
+		result = run_batch(&db, options.batch_file);
+		free_db(&db);
+		return result;
+	}
 
 	printf("=== Course Management System (CMS) ===\n");
 	printf("Welcome to the Student Database Management System\n");
@@ -103,5 +190,6 @@ int main() {
 
 	//Program ending message
 	printf("\nThank you for using the Course Management System. Goodbye!\n");
+	free_db(&db);
 	return 0;
 }
\ No newline at end of file